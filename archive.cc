@@ -0,0 +1,286 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "archive.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cognon {
+
+void OutputArchive::WriteFixed32(uint32 v) {
+  char bytes[4];
+  for (int32 i = 0; i < 4; ++i) {
+    bytes[i] = static_cast<char>(v >> (8 * i));
+  }
+  output_->append(bytes, sizeof(bytes));
+}
+
+void OutputArchive::WriteVarint(uint32 v) {
+  while (0x80 <= v) {
+    output_->push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  output_->push_back(static_cast<char>(v));
+}
+
+void OutputArchive::WriteHeader() {
+  WriteFixed32(kArchiveMagic);
+  WriteVarint(version_);
+}
+
+OutputArchive& OutputArchive::operator&(bool v) {
+  output_->push_back(v ? 1 : 0);
+  return *this;
+}
+
+OutputArchive& OutputArchive::operator&(int32 v) {
+  // Zigzag, so that small negative values are short too
+  WriteVarint((static_cast<uint32>(v) << 1) ^ static_cast<uint32>(v >> 31));
+  return *this;
+}
+
+OutputArchive& OutputArchive::operator&(double v) {
+  uint64 bits;
+  memcpy(&bits, &v, sizeof(bits));
+  WriteFixed32(static_cast<uint32>(bits));
+  WriteFixed32(static_cast<uint32>(bits >> 32));
+  return *this;
+}
+
+OutputArchive& OutputArchive::operator&(const vector<double>& v) {
+  *this & static_cast<int32>(v.size());
+  for (int32 i = 0; i < v.size(); ++i) {
+    *this & v[i];
+  }
+  return *this;
+}
+
+uint32 InputArchive::ReadFixed32() {
+  if (!ok_ || size_ - position_ < 4) {
+    ok_ = false;
+    return 0;
+  }
+  const unsigned char* bytes =
+      reinterpret_cast<const unsigned char*>(data_ + position_);
+  position_ += 4;
+  return (static_cast<uint32>(bytes[0])
+          | (static_cast<uint32>(bytes[1]) << 8)
+          | (static_cast<uint32>(bytes[2]) << 16)
+          | (static_cast<uint32>(bytes[3]) << 24));
+}
+
+uint32 InputArchive::ReadVarint() {
+  uint32 v = 0;
+  for (int32 shift = 0; ok_ && shift < 35; shift += 7) {
+    if (size_ <= position_) break;
+    uint32 byte = static_cast<unsigned char>(data_[position_++]);
+    v |= (byte & 0x7f) << shift;
+    if (byte < 0x80) return v;
+  }
+  ok_ = false;
+  return 0;
+}
+
+bool InputArchive::ReadHeader() {
+  if (ReadFixed32() != kArchiveMagic) ok_ = false;
+  uint32 version = ReadVarint();
+  if (!ok_ || version < 1 || kArchiveVersion < version) {
+    ok_ = false;
+    return false;
+  }
+  version_ = version;
+  return true;
+}
+
+int32 InputArchive::ReadSize(size_t min_bytes) {
+  int32 size = 0;
+  *this & size;
+  if (size < 0 || (size_ - position_) / min_bytes < size) {
+    ok_ = false;
+    return 0;
+  }
+  return size;
+}
+
+InputArchive& InputArchive::operator&(bool& v) {
+  v = false;
+  if (!ok_ || size_ <= position_) {
+    ok_ = false;
+    return *this;
+  }
+  char c = data_[position_++];
+  if (c != 0 && c != 1) ok_ = false;
+  v = (c == 1);
+  return *this;
+}
+
+InputArchive& InputArchive::operator&(int32& v) {
+  uint32 zigzag = ReadVarint();
+  v = static_cast<int32>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+  return *this;
+}
+
+InputArchive& InputArchive::operator&(double& v) {
+  uint64 bits = ReadFixed32();
+  bits |= static_cast<uint64>(ReadFixed32()) << 32;
+  memcpy(&v, &bits, sizeof(v));
+  return *this;
+}
+
+InputArchive& InputArchive::operator&(vector<double>& v) {
+  int32 size = ReadSize(sizeof(double));
+  v.resize(size);
+  for (int32 i = 0; i < size; ++i) {
+    *this & v[i];
+  }
+  return *this;
+}
+
+uint32 Checksum(const char* data, size_t size) {
+  uint32 hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+RecordWriter::RecordWriter() : file_(NULL) {
+}
+
+RecordWriter::~RecordWriter() {
+  Close();
+}
+
+bool RecordWriter::Open(const string& filename, size_t size) {
+  Close();
+  file_ = fopen(filename.c_str(), "ab");
+  if (file_ == NULL) return false;
+
+  fseek(file_, 0, SEEK_END);
+  if (size < ftell(file_) && ftruncate(fileno(file_), size) != 0) {
+    Close();
+    return false;
+  }
+  fseek(file_, 0, SEEK_END);
+  if (ftell(file_) == 0) {
+    string header;
+    OutputArchive out(&header);
+    out.WriteHeader();
+    fwrite(header.data(), 1, header.size(), file_);
+    fflush(file_);
+  }
+  return true;
+}
+
+void RecordWriter::Close() {
+  if (file_ != NULL) fclose(file_);
+  file_ = NULL;
+}
+
+bool RecordWriter::Write(const string& record) {
+  if (file_ == NULL) return false;
+
+  // One write per record, so that a crash leaves at most a partial
+  // record at the end of the file.
+  //
+  string framed;
+  OutputArchive out(&framed);
+  out.WriteFixed32(record.size());
+  out.WriteFixed32(Checksum(record.data(), record.size()));
+  framed += record;
+  if (fwrite(framed.data(), 1, framed.size(), file_) != framed.size())
+    return false;
+  return fflush(file_) == 0;
+}
+
+RecordReader::RecordReader()
+    : data_(NULL), size_(0), position_(0), version_(kArchiveVersion),
+      bad_tail_(false) {
+}
+
+RecordReader::~RecordReader() {
+  Close();
+}
+
+bool RecordReader::Open(const string& filename) {
+  Close();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return (errno == ENOENT);
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    return false;
+  }
+  if (status.st_size == 0) {
+    close(fd);
+    return true;
+  }
+  void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  data_ = static_cast<const char*>(data);
+  size_ = status.st_size;
+
+  InputArchive in(data_, size_);
+  if (!in.ReadHeader()) {
+    Close();
+    return false;
+  }
+  version_ = in.version();
+  position_ = in.position();
+  return true;
+}
+
+void RecordReader::Close() {
+  if (data_ != NULL) munmap(const_cast<char*>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+  position_ = 0;
+  version_ = kArchiveVersion;
+  bad_tail_ = false;
+}
+
+bool RecordReader::Next(const char** data, size_t* size) {
+  if (bad_tail_ || size_ <= position_) return false;
+
+  InputArchive in(data_ + position_, size_ - position_);
+  uint32 length = in.ReadFixed32();
+  uint32 checksum = in.ReadFixed32();
+  if (!in.ok() || size_ - position_ - in.position() < length) {
+    bad_tail_ = true;
+    return false;
+  }
+  const char* record = data_ + position_ + in.position();
+  if (Checksum(record, length) != checksum) {
+    bad_tail_ = true;
+    return false;
+  }
+  *data = record;
+  *size = length;
+  position_ += in.position() + length;
+  return true;
+}
+
+}  // namespace cognon
@@ -0,0 +1,248 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Versioned binary archives for the serialize() methods of the value
+// classes in compat.h, and files of archived records.
+//
+//    string bytes;
+//    SerializeToString(result, &bytes);
+//    ...
+//    CHECK(ParseFromString(bytes.data(), bytes.size(), &result));
+//
+// The encoding is compact: integers are zigzag varints, a field that
+// is not set is just its has_ flag, and doubles (including the values
+// of a Statistic) are packed 8-byte IEEE little-endian, whatever the
+// host byte order.  Each archive has a version, passed to serialize()
+// so that classes can read archives written before a field was added.
+//
+// A RecordWriter appends archives as checksummed records to a file,
+// and a RecordReader maps such a file into memory and hands out each
+// record in place, without copying it, so loading is a single pass
+// over the file.
+//
+#ifndef COGNON_ARCHIVE_H_
+#define COGNON_ARCHIVE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "compat.h"
+
+namespace cognon {
+
+// The archive version written by this code.  Version 1 is the first
+// versioned encoding; version 2 adds Statistic::m2 and max_values,
+// version 3 stores Histogram densely, version 4 numbers the
+// repetitions in result cache records, and version 5 adds
+// NeuronStatistics::false_rejected.
+//
+const int32 kArchiveVersion = 5;
+
+// Archives and record files start with this magic number ("COGN") and
+// then the version.
+//
+const uint32 kArchiveMagic = 0x4e474f43;
+
+class OutputArchive {
+ public:
+  // Appends to output, which the caller retains ownership of
+  explicit OutputArchive(string* output)
+      : output_(output), version_(kArchiveVersion) { }
+  ~OutputArchive() { }
+
+  int32 version() const { return version_; }
+
+  // Write the magic number and version that ParseFromString() expects
+  void WriteHeader();
+
+  OutputArchive& operator&(bool v);
+  OutputArchive& operator&(int32 v);
+  OutputArchive& operator&(double v);
+  OutputArchive& operator&(const vector<double>& v);
+
+  template<class T> OutputArchive& operator&(const vector<T>& v) {
+    *this & static_cast<int32>(v.size());
+    for (int32 i = 0; i < v.size(); ++i) {
+      *this & v[i];
+    }
+    return *this;
+  }
+
+  // Value classes write themselves
+  template<class T> OutputArchive& operator&(const T& v) {
+    const_cast<T&>(v).serialize(*this, version_);
+    return *this;
+  }
+
+  void WriteFixed32(uint32 v);
+  void WriteVarint(uint32 v);
+
+ private:
+  string* output_;
+  int32 version_;
+};
+
+class InputArchive {
+ public:
+  // Reads archive version from data, which must outlive the
+  // InputArchive
+  //
+  InputArchive(const char* data, size_t size, int32 version = kArchiveVersion)
+      : data_(data), size_(size), position_(0), version_(version),
+        ok_(true) { }
+  ~InputArchive() { }
+
+  int32 version() const { return version_; }
+
+  // Read the header written by OutputArchive::WriteHeader(), taking
+  // the version from it.  Fails on a newer version than this code's.
+  //
+  bool ReadHeader();
+
+  InputArchive& operator&(bool& v);
+  InputArchive& operator&(int32& v);
+  InputArchive& operator&(double& v);
+  InputArchive& operator&(vector<double>& v);
+
+  template<class T> InputArchive& operator&(vector<T>& v) {
+    int32 size = ReadSize();
+    v.clear();
+    v.resize(size);
+    for (int32 i = 0; i < size; ++i) {
+      *this & v[i];
+    }
+    return *this;
+  }
+
+  template<class T> InputArchive& operator&(T& v) {
+    v.serialize(*this, version_);
+    return *this;
+  }
+
+  uint32 ReadFixed32();
+  uint32 ReadVarint();
+
+  // False once a read has run past the end of the data or found an
+  // impossible value; values read after that are zero.
+  //
+  bool ok() const { return ok_; }
+
+  // The number of bytes read so far
+  size_t position() const { return position_; }
+
+ private:
+  // Read a vector size, each element taking at least min_bytes
+  int32 ReadSize(size_t min_bytes = 1);
+
+  const char* data_;
+  size_t size_;
+  size_t position_;
+  int32 version_;
+  bool ok_;
+};
+
+// The FNV-1a hash of data, which record files use as a checksum to
+// catch records damaged in ways the length does not show
+//
+uint32 Checksum(const char* data, size_t size);
+
+// Set output to the header and archive of value
+template<class T> void SerializeToString(const T& value, string* output) {
+  output->clear();
+  OutputArchive out(output);
+  out.WriteHeader();
+  out & value;
+}
+
+// Read value from the output of SerializeToString(), returning false
+// if it is malformed or from a newer version.
+//
+template<class T> bool ParseFromString(const char* data, size_t size,
+                                       T* value) {
+  InputArchive in(data, size);
+  if (!in.ReadHeader()) return false;
+  value->clear();
+  in & *value;
+  return in.ok() && in.position() == size;
+}
+
+// Appends records to a file of records.  Each record is its length,
+// a checksum and the bytes of the record; the file starts with the
+// archive header.
+//
+class RecordWriter {
+ public:
+  RecordWriter();
+  ~RecordWriter();
+
+  // Open filename for appending, first truncating it to size bytes
+  // (e.g. RecordReader::end(), to drop a partial record).  Writes the
+  // header if the file is empty.  Returns false on error.
+  //
+  bool Open(const string& filename, size_t size);
+  void Close();
+
+  // Append one record, flushing it to the file
+  bool Write(const string& record);
+
+ private:
+  FILE* file_;
+};
+
+// Reads a file of records written by a RecordWriter in place.
+class RecordReader {
+ public:
+  RecordReader();
+  ~RecordReader();
+
+  // Map filename into memory.  A missing or empty file has no records.
+  // Returns false if the file cannot be read or is not a record file
+  // of this or an earlier version.
+  //
+  bool Open(const string& filename);
+  void Close();
+
+  // Set data and size to the next record, which stays valid until
+  // Close(), or return false at the end of the good records.
+  //
+  bool Next(const char** data, size_t* size);
+
+  // The archive version of the records
+  int32 version() const { return version_; }
+
+  // The offset just past the last good record read by Next()
+  size_t end() const { return position_; }
+
+  // True if Next() stopped at a partial or corrupt record rather than
+  // at the end of the file
+  //
+  bool bad_tail() const { return bad_tail_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t position_;
+  int32 version_;
+  bool bad_tail_;
+};
+
+}  // namespace cognon
+
+#endif  // COGNON_ARCHIVE_H_
@@ -0,0 +1,200 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Tests the archives and record files.
+//
+
+#include "archive.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "cognon.h"
+
+namespace cognon {
+
+class ArchiveTest : public testing::Test {
+};
+
+static void SetConfig(TrainConfig* config) {
+  config->set_w(50);
+  config->set_num_test_words(1000);
+  config->mutable_config()->set_c(1);
+  config->mutable_config()->set_d1(1);
+  config->mutable_config()->set_d2(1);
+  config->mutable_config()->set_h(10);
+  config->mutable_config()->set_q(0.362000);
+  config->mutable_config()->set_r(30);
+}
+
+TEST_F(ArchiveTest, CheckEncoding) {
+  string bytes;
+  OutputArchive out(&bytes);
+  out & static_cast<int32>(-1);
+  out & static_cast<int32>(300);
+  out & 1.0;
+  EXPECT_EQ(bytes.size(), 1 + 2 + 8);
+  EXPECT_EQ(bytes[0], 1);
+  EXPECT_EQ(static_cast<unsigned char>(bytes[1]), 0xd8);
+  EXPECT_EQ(bytes[2], 4);
+  EXPECT_EQ(static_cast<unsigned char>(bytes[10]), 0x3f);
+
+  int32 a, b;
+  double c;
+  InputArchive in(bytes.data(), bytes.size());
+  in & a;
+  in & b;
+  in & c;
+  EXPECT_TRUE(in.ok());
+  EXPECT_EQ(a, -1);
+  EXPECT_EQ(b, 300);
+  EXPECT_EQ(c, 1.0);
+
+  // An unset field costs only its flag
+  TrainConfig config;
+  SerializeToString(config, &bytes);
+  EXPECT_EQ(bytes.size(), 4 + 1 + 5);
+  SetConfig(&config);
+  SerializeToString(config, &bytes);
+  TrainConfig copy;
+  EXPECT_TRUE(ParseFromString(bytes.data(), bytes.size(), &copy));
+  EXPECT_EQ(copy.w(), 50);
+  EXPECT_EQ(copy.num_test_words(), 1000);
+  EXPECT_EQ(copy.config().q(), 0.362000);
+  EXPECT_EQ(copy.config().r(), 30);
+  EXPECT_TRUE(!copy.config().has_g_m() && !copy.has_num_active());
+
+  // Newer versions are refused
+  bytes[4] = kArchiveVersion + 1;
+  EXPECT_TRUE(!ParseFromString(bytes.data(), bytes.size(), &copy));
+}
+
+TEST_F(ArchiveTest, CheckNeuronStatistics) {
+  TrainConfig config;
+  SetConfig(&config);
+  NeuronStatistics result;
+  RunExperiment(config, &result);
+  RunExperiment(config, &result);
+
+  string bytes;
+  SerializeToString(result, &bytes);
+
+  NeuronStatistics copy;
+  EXPECT_TRUE(ParseFromString(bytes.data(), bytes.size(), &copy));
+  EXPECT_EQ(copy.config().w(), 50);
+  EXPECT_EQ(copy.true_true().count(), result.true_true().count());
+  EXPECT_EQ(copy.true_true().values_size(), result.true_true().values_size());
+  EXPECT_EQ(Mean(copy.true_true()), Mean(result.true_true()));
+  EXPECT_EQ(Stddev(copy.false_true()), Stddev(result.false_true()));
+  EXPECT_EQ(copy.delay_histogram().values_size(),
+            result.delay_histogram().values_size());
+  for (int32 i = 0; i < result.h_histogram().values_size(); ++i) {
+    EXPECT_EQ(Mean(copy.h_histogram().values(i)),
+              Mean(result.h_histogram().values(i)));
+  }
+
+  // Version 2 histograms, a Statistic per bucket, still parse
+  vector<Statistic> buckets(2);
+  AddSample(3.0, &buckets[0]);
+  AddSample(5.0, &buckets[0]);
+  AddSample(0.0, &buckets[1]);
+  AddSample(2.0, &buckets[1]);
+  string legacy;
+  OutputArchive out(&legacy);
+  out & buckets;
+  InputArchive in(legacy.data(), legacy.size(), 2);
+  Histogram h;
+  in & h;
+  EXPECT_TRUE(in.ok());
+  EXPECT_EQ(h.values_size(), 2);
+  EXPECT_EQ(h.values(1).count(), 2);
+  EXPECT_EQ(Mean(h.values(0)), 4.0);
+  EXPECT_EQ(Mean(h.values(1)), 1.0);
+
+  // Truncated archives are detected
+  for (int32 size = 0; size < bytes.size(); size += 7) {
+    EXPECT_TRUE(!ParseFromString(bytes.data(), size, &copy))
+        << "Parsed an archive truncated to " << size << " bytes\n";
+  }
+}
+
+TEST_F(ArchiveTest, CheckRecords) {
+  string filename = StringPrintf("/tmp/archive_test.%d.records", getpid());
+  unlink(filename.c_str());
+
+  RecordReader reader;
+  const char* data;
+  size_t size;
+  EXPECT_TRUE(reader.Open(filename));
+  EXPECT_TRUE(!reader.Next(&data, &size));
+
+  RecordWriter writer;
+  EXPECT_TRUE(writer.Open(filename, 0));
+  EXPECT_TRUE(writer.Write("first"));
+  EXPECT_TRUE(writer.Write(""));
+  EXPECT_TRUE(writer.Write("third"));
+  writer.Close();
+
+  EXPECT_TRUE(reader.Open(filename));
+  EXPECT_EQ(reader.version(), kArchiveVersion);
+  EXPECT_TRUE(reader.Next(&data, &size));
+  EXPECT_EQ(string(data, size), "first");
+  EXPECT_TRUE(reader.Next(&data, &size));
+  EXPECT_EQ(size, 0);
+  EXPECT_TRUE(reader.Next(&data, &size));
+  EXPECT_EQ(string(data, size), "third");
+  EXPECT_TRUE(!reader.Next(&data, &size));
+  EXPECT_TRUE(!reader.bad_tail());
+  size_t end = reader.end();
+  reader.Close();
+
+  // A partial record is reported, and can be dropped before appending
+  FILE* file = fopen(filename.c_str(), "ab");
+  fwrite("\010\0\0\0\0\0\0\0abc", 1, 11, file);
+  fclose(file);
+  EXPECT_TRUE(reader.Open(filename));
+  for (int32 i = 0; i < 3; ++i) EXPECT_TRUE(reader.Next(&data, &size));
+  EXPECT_TRUE(!reader.Next(&data, &size));
+  EXPECT_TRUE(reader.bad_tail());
+  EXPECT_EQ(reader.end(), end);
+  reader.Close();
+
+  EXPECT_TRUE(writer.Open(filename, end));
+  EXPECT_TRUE(writer.Write("fourth"));
+  writer.Close();
+  EXPECT_TRUE(reader.Open(filename));
+  for (int32 i = 0; i < 4; ++i) EXPECT_TRUE(reader.Next(&data, &size));
+  EXPECT_EQ(string(data, size), "fourth");
+  EXPECT_TRUE(!reader.bad_tail());
+  reader.Close();
+
+  // Other files are refused
+  file = fopen(filename.c_str(), "wb");
+  fputs("W,num active\n", file);
+  fclose(file);
+  EXPECT_TRUE(!reader.Open(filename));
+
+  unlink(filename.c_str());
+}
+
+}  // namespace cognon
+
+int main(int argc, char **argv) {
+  CALL_TEST(cognon::CheckEncoding);
+  CALL_TEST(cognon::CheckNeuronStatistics);
+  CALL_TEST(cognon::CheckRecords);
+}
@@ -17,8 +17,9 @@
 //
 
 #include <math.h>
+#include <omp.h>
 
-#include <set>
+#include <algorithm>
 
 #include "bob.h"
 #include "cognon.h"
@@ -27,7 +28,69 @@
 
 namespace cognon {
 
-Bob::Bob() { }
+// Return the (natural) log of the choose function
+inline double lchoose(double n, double k) {
+    return lgamma(n + 1) - lgamma(n - k + 1) - lgamma(k + 1);
+}
+
+void TestCorpus::Init(int32 num_words, const Wordset& words, uint32 seed) {
+  CHECK(0 <= num_words);
+  word_length_ = words.word_length();
+  num_delays_ = words.num_delays();
+  refractory_period_ = words.refractory_period();
+  num_active_ = words.num_active();
+
+  int32 num_chunks = (num_words + kChunk - 1) / kChunk;
+  vector<Word> chunks(num_chunks);
+  vector<vector<int32> > lengths(num_chunks);
+  RandomBase initialized;  // Create every thread's generator first
+#pragma omp parallel
+  {
+    // Each thread puts its own stream of random numbers back afterwards
+    RandomBase random;
+    vector<MTRand::uint32> state;
+    random.SaveState(&state);
+    Wordset chunk;
+#pragma omp for schedule(dynamic)
+    for (int32 k = 0; k < num_chunks; ++k) {
+      random.Seed(seed ^ (static_cast<uint32>(k) * 2654435761U));
+      chunk.CopyFrom(min(kChunk, num_words - k * kChunk), words);
+      for (int32 i = 0; i < chunk.size(); ++i) {
+        const Word& word = chunk.get_word(i);
+        chunks[k].insert(chunks[k].end(), word.begin(), word.end());
+        lengths[k].push_back(word.size());
+      }
+    }
+    random.LoadState(state);
+  }
+
+  int32 total = 0;
+  for (int32 k = 0; k < num_chunks; ++k) total += chunks[k].size();
+  signals_.clear();
+  signals_.reserve(total);
+  start_.resize(num_words + 1);
+  start_[0] = 0;
+  int32 i = 0;
+  for (int32 k = 0; k < num_chunks; ++k) {
+    signals_.insert(signals_.end(), chunks[k].begin(), chunks[k].end());
+    for (int32 j = 0; j < lengths[k].size(); ++j, ++i) {
+      start_[i + 1] = start_[i] + lengths[k][j];
+    }
+  }
+}
+
+bool TestCorpus::Matches(const Wordset& words) const {
+  return (word_length_ == words.word_length()
+          && num_delays_ == words.num_delays()
+          && (0 < refractory_period_
+              ? refractory_period_ == words.refractory_period()
+              : num_active_ == words.num_active()));
+}
+
+Bob::Bob()
+    : false_positive_estimator_(TrainConfig::UNIFORM_SAMPLING),
+      random_(CreateRandom()), corpus_(NULL) {
+}
 
 void Bob::Test(int32 num_test_words,
                Wordset& words, Neuron& neuron, NeuronStatistics* stats) {
@@ -39,29 +102,258 @@ void Bob::Test(int32 num_test_words,
   int32 false_true = 0;
 
   TestTrainingSet(words, neuron, &true_true, &true_false);
+
+  double total;
+  double prob_false;
+  double prob_not_false;
+  double effective_count;
+  double lower;
+  double upper;
+  bool exact = (false_positive_estimator_ == TrainConfig::EXACT
+                || false_positive_estimator_ == TrainConfig::EXACT_CROSS_CHECK);
+  if (exact && ComputeTestSet(words, neuron, &prob_false, &lower, &upper)) {
+    // No words were sampled
+    prob_not_false = 1.0 - prob_false;
+    total = 0.0;
+    effective_count = 0.0;
+    if (false_positive_estimator_ == TrainConfig::EXACT_CROSS_CHECK) {
+      TestTestSet(words, neuron, num_test_words, &false_true, &false_false);
+      AddSample(false_true / static_cast<double>(false_true + false_false),
+                stats->mutable_false_true_sampled());
+    }
+  } else if (false_positive_estimator_ == TrainConfig::IMPORTANCE_SAMPLING
+             && 0 < words.refractory_period()) {
+    TestTestSetImportance(words, neuron, num_test_words,
+                          &prob_false, &effective_count);
+    prob_not_false = 1.0 - prob_false;
+    total = static_cast<double>(num_test_words);
+  } else {
+    int64 exposures = neuron.exposures();
+    int64 rejections = neuron.rejections();
+    TestTestSet(words, neuron, num_test_words, &false_true, &false_false);
+    total = static_cast<double>(false_true + false_false);
+    prob_false = false_true / total;
+    prob_not_false = false_false / total;
+    if (neuron.exposures() != exposures) {
+      // The test words went through Neuron::Expose()
+      AddSample((neuron.rejections() - rejections) / total,
+                stats->mutable_false_rejected());
+    }
+    effective_count = total;
+    lower = upper = prob_false;
+    if (exact) AddSample(prob_false, stats->mutable_false_true_sampled());
+  }
+  AddTestStatistics(words, neuron, true_true, true_false, prob_false,
+                    prob_not_false, total, effective_count, stats);
+  if (exact) {
+    AddSample(lower, stats->mutable_false_true_lower());
+    AddSample(upper, stats->mutable_false_true_upper());
+  }
+}
+
+void Bob::AddTestStatistics(const Wordset& words, const Neuron& neuron,
+                            int32 true_true, int32 true_false,
+                            double prob_false, double prob_not_false,
+                            double false_count, double effective_count,
+                            NeuronStatistics* stats) {
   double total = static_cast<double>(true_true + true_false);
   AddSample(true_true / total, stats->mutable_true_true());
   AddSample(true_false / total, stats->mutable_true_false());
   AddSample(total, stats->mutable_true_count());
 
-  TestTestSet(words, neuron, num_test_words, &false_true, &false_false);
-  total = static_cast<double>(false_true + false_false);
-  AddSample(false_true / total, stats->mutable_false_true());
-  AddSample(false_false / total, stats->mutable_false_false());
-  AddSample(total, stats->mutable_false_count());
-
-  AddSample(BitsPerNeuron(words.size(), true_true, true_false,
-                          false_true, false_false),
-            stats->mutable_bits_per_neuron());
-  AddSample(BitsPerNeuron(words.size(), true_true, true_false,
-                          false_true, false_false)
-            / static_cast<double>(neuron.config().r()),
+  AddSample(prob_false, stats->mutable_false_true());
+  AddSample(prob_not_false, stats->mutable_false_false());
+  AddSample(false_count, stats->mutable_false_count());
+  AddSample(effective_count, stats->mutable_false_effective_count());
+
+  double prob_learn = true_true / static_cast<double>(true_true + true_false);
+  double bits = BitsPerNeuron(words.size(), prob_learn,
+                              (1.0 / 360.0) + prob_false);
+  AddSample(bits, stats->mutable_bits_per_neuron());
+  AddSample(bits / static_cast<double>(neuron.config().r()),
             stats->mutable_bits_per_neuron_per_refractory_period());
-  AddSample(MutualInformation(neuron, true_true, true_false,
-                              false_true, false_false),
+  AddSample(MutualInformation(neuron, true_true, true_false, prob_false),
             stats->mutable_mutual_information());
 }
 
+void Bob::TestLockstep(int32 num_test_words, const vector<Bob*>& bobs,
+                       const vector<Wordset*>& words,
+                       const vector<Neuron*>& neurons,
+                       vector<vector<MTRand::uint32> >* random_states,
+                       const vector<NeuronStatistics*>& stats) {
+  // Test words are drawn for each lane in batches of this many
+  const int32 kBatch = 64;
+
+  int32 L = neurons.size();
+  CHECK(0 < L && bobs.size() == L && words.size() == L
+        && random_states->size() == L && stats.size() == L);
+  NeuronLanes& lanes = bobs[0]->lanes_;
+  lanes.Load(vector<const Neuron*>(neurons.begin(), neurons.end()));
+  int32 slots[NeuronLanes::kMaxLanes];
+  const Word* exposed[NeuronLanes::kMaxLanes];
+  vector<int32> true_true(L);
+  vector<int32> true_false(L);
+  vector<int32> false_true(L);
+  vector<int32> false_false(L);
+
+  // The training words, as TestTrainingSet()
+  int32 num_words = words[0]->size();
+  for (int32 l = 0; l < L; ++l) CHECK(words[l]->size() == num_words);
+  for (int32 i = 0; i < num_words; ++i) {
+    for (int32 l = 0; l < L; ++l) exposed[l] = &words[l]->get_word(i);
+    lanes.Expose(exposed, slots);
+    for (int32 l = 0; l < L; ++l) {
+      int32 slot = slots[l];
+      if (0 <= slot && slot == words[l]->delay(i)
+          && slot < neurons[l]->slots()) {
+        ++true_true[l];
+      } else {
+        ++true_false[l];
+      }
+    }
+  }
+
+  // The test words, as TestTestSet(), each lane continuing its own
+  // stream of random numbers or its own way through its corpus.  Lanes
+  // whose corpus runs out first are given an empty word.
+  //
+  RandomBase random;
+  for (int32 l = 0; l < L; ++l) {
+    random.LoadState((*random_states)[l]);
+    bobs[l]->test_.CopyFrom(1, *words[l]);
+    bobs[l]->RememberTrainingSet(*words[l]);
+    random.SaveState(&(*random_states)[l]);
+    const TestCorpus* corpus = bobs[l]->corpus_;
+    if (corpus != NULL) {
+      CHECK(corpus->Matches(*words[l]) && num_test_words <= corpus->size());
+    }
+  }
+  const Word empty;
+  vector<int32> next(L);
+  vector<int32> count(L);
+  for (;;) {
+    int32 n = 0;
+    for (int32 l = 0; l < L; ++l) {
+      Bob* bob = bobs[l];
+      if (bob->corpus_ == NULL) random.LoadState((*random_states)[l]);
+      count[l] = bob->NextTestWords(min(kBatch, num_test_words - next[l]),
+                                    num_test_words, &next[l]);
+      if (bob->corpus_ == NULL) random.SaveState(&(*random_states)[l]);
+      n = max(n, count[l]);
+    }
+    if (n == 0) break;
+    for (int32 i = 0; i < n; ++i) {
+      for (int32 l = 0; l < L; ++l) {
+        exposed[l] = (i < count[l] ? &bobs[l]->batch_[i] : &empty);
+      }
+      lanes.Expose(exposed, slots);
+      for (int32 l = 0; l < L; ++l) {
+        if (count[l] <= i) continue;
+        if (0 <= slots[l] && slots[l] < neurons[l]->slots()) {
+          ++false_true[l];
+        } else {
+          ++false_false[l];
+        }
+      }
+    }
+  }
+
+  for (int32 l = 0; l < L; ++l) {
+    double total = static_cast<double>(false_true[l] + false_false[l]);
+    bobs[l]->AddTestStatistics(*words[l], *neurons[l],
+                               true_true[l], true_false[l],
+                               false_true[l] / total, false_false[l] / total,
+                               total, total, stats[l]);
+  }
+}
+
+void Bob::TestThresholds(int32 num_test_words, Wordset& words, Neuron& neuron,
+                         const vector<double>& thresholds,
+                         vector<NeuronStatistics>* stats) {
+  CHECK(stats->size() == thresholds.size());
+  int32 T = thresholds.size();
+  vector<int32> true_true(T);
+  vector<int32> false_true(T);
+  vector<double> maxima;
+
+  // A training word is learned at threshold h when its trained slot
+  // is the first slot reaching h.
+  //
+  for (int32 i = 0; i < words.size(); ++i) {
+    neuron.ExposeMaxima(words.get_word(i), &maxima);
+    int32 slot = words.delay(i);
+    if (slot < 0 || neuron.slots() <= slot) continue;
+    double before = -1.0;
+    for (int32 d = 0; d < slot; ++d) before = max(before, maxima[d]);
+    for (int32 t = 0; t < T; ++t) {
+      double h = thresholds[t];
+      if (h <= maxima[slot] + kEpsilon && before + kEpsilon < h)
+        ++true_true[t];
+    }
+  }
+
+  // A test word fires at threshold h when any slot reaches h
+  test_.CopyFrom(1, words);
+  RememberTrainingSet(words);
+  if (corpus_ != NULL) {
+    CHECK(corpus_->Matches(words) && num_test_words <= corpus_->size());
+  }
+  int32 tested = 0;
+  int32 next = 0;
+  while (next < num_test_words
+         && NextTestWords(1, num_test_words, &next) == 1) {
+    ++tested;
+    neuron.ExposeMaxima(batch_[0], &maxima);
+    double most = *max_element(maxima.begin(), maxima.end());
+    for (int32 t = 0; t < T; ++t) {
+      if (thresholds[t] <= most + kEpsilon) ++false_true[t];
+    }
+  }
+
+  for (int32 t = 0; t < T; ++t) {
+    NeuronStatistics* s = &(*stats)[t];
+    double total = static_cast<double>(words.size());
+    double prob_learn = true_true[t] / total;
+    AddSample(prob_learn, s->mutable_true_true());
+    AddSample(1.0 - prob_learn, s->mutable_true_false());
+    AddSample(total, s->mutable_true_count());
+
+    total = static_cast<double>(tested);
+    double prob_false = false_true[t] / total;
+    AddSample(prob_false, s->mutable_false_true());
+    AddSample(1.0 - prob_false, s->mutable_false_false());
+    AddSample(total, s->mutable_false_count());
+    AddSample(total, s->mutable_false_effective_count());
+
+    double bits = BitsPerNeuron(words.size(), prob_learn,
+                                (1.0 / 360.0) + prob_false);
+    AddSample(bits, s->mutable_bits_per_neuron());
+    AddSample(bits / static_cast<double>(neuron.config().r()),
+              s->mutable_bits_per_neuron_per_refractory_period());
+    AddSample(MutualInformation(neuron, true_true[t],
+                                words.size() - true_true[t], prob_false),
+              s->mutable_mutual_information());
+  }
+}
+
+// Orders pointers to words by the words
+struct WordPointerLess {
+  bool operator()(const Word* a, const Word* b) const { return *a < *b; }
+};
+
+void Bob::RememberTrainingSet(const Wordset& words) {
+  training_.resize(words.size());
+  for (int32 i = 0; i < words.size(); ++i) {
+    training_[i] = &words.get_word(i);
+  }
+  sort(training_.begin(), training_.end(), WordPointerLess());
+}
+
+bool Bob::InTrainingSet(const Word& word) const {
+  return binary_search(training_.begin(), training_.end(), &word,
+                       WordPointerLess());
+}
+
 void Bob::TestTrainingSet(const Wordset& words, Neuron& neuron,
                           int32* true_true, int32* true_false) {
   for (int32 i = 0; i < words.size(); ++i) {
@@ -74,6 +366,27 @@ void Bob::TestTrainingSet(const Wordset& words, Neuron& neuron,
   }
 }
 
+int32 Bob::NextTestWords(int32 count, int32 num_test_words, int32* next) {
+  if (batch_.size() < count) batch_.resize(count);
+  int32 n = 0;
+  if (corpus_ == NULL) {
+    for (; n < count; ++n) {
+      test_.Init();
+      while (InTrainingSet(test_.get_word(0))) {
+        test_.Init();
+      }
+      batch_[n] = test_.get_word(0);
+    }
+    *next += n;
+    return n;
+  }
+  while (n < count && *next < num_test_words) {
+    corpus_->GetWord((*next)++, &batch_[n]);
+    if (!InTrainingSet(batch_[n])) ++n;
+  }
+  return n;
+}
+
 // TODO(staelin): currently this does not check that the
 // randomly generated test words are not also trained
 // words (words in the training set).
@@ -81,22 +394,39 @@ void Bob::TestTrainingSet(const Wordset& words, Neuron& neuron,
 void Bob::TestTestSet(Wordset& words, Neuron& neuron,
                       int32 num_test_words,
                       int32* false_true, int32* false_false) {
-  set<Word> training;
-  Wordset test;
-
-  test.CopyFrom(1, words);
-
-  // Remember what words the neuron was trained on
-  for (int32 i = 0; i < words.size(); ++i) {
-    training.insert(words.get_word(i));
+  test_.CopyFrom(1, words);
+  RememberTrainingSet(words);
+  if (corpus_ != NULL) {
+    CHECK(corpus_->Matches(words) && num_test_words <= corpus_->size());
   }
 
-  for (int32 i = 0; i < num_test_words; ++i) {
-    test.Init();
-    while (training.find(test.get_word(0)) != training.end()) {
-      test.Init();
+  // With several input delays, expose the same test words a batch at a
+  // time with the bit-sliced kernel
+  //
+  int32 next = 0;
+  if (1 < neuron.D1() && bitslice_.Load(neuron)) {
+    const int32 kBatch = NeuronBitSlice::kBatch;
+    const Word* exposed[kBatch];
+    int32 slots[kBatch];
+    int32 n;
+    while (0 < (n = NextTestWords(min(kBatch, num_test_words - next),
+                                  num_test_words, &next))) {
+      for (int32 i = 0; i < n; ++i) exposed[i] = &batch_[i];
+      bitslice_.Expose(exposed, n, slots);
+      for (int32 i = 0; i < n; ++i) {
+        if (0 <= slots[i] && slots[i] < neuron.slots()) {
+          ++*false_true;
+        } else {
+          ++*false_false;
+        }
+      }
     }
-    int32 slot = neuron.Expose(test.get_word(0));
+    return;
+  }
+
+  while (next < num_test_words) {
+    if (NextTestWords(1, num_test_words, &next) == 0) break;
+    int32 slot = neuron.Expose(batch_[0]);
     if (0 <= slot && slot < neuron.slots()) {
       ++*false_true;
     } else {
@@ -105,6 +435,433 @@ void Bob::TestTestSet(Wordset& words, Neuron& neuron,
   }
 }
 
+// Expected summation in one container and delay slot when synapse i
+// lands in it with probability rate * e^(theta * strength[i]) /
+// (1 - rate + rate * e^(theta * strength[i])).
+//
+static double TiltedMass(const vector<double>& strength, double rate,
+                         double theta, vector<double>* tilted) {
+  double mass = 0.0;
+  for (int32 i = 0; i < strength.size(); ++i) {
+    double e = rate * exp(theta * strength[i]);
+    if (tilted) (*tilted)[i] = e / (1.0 - rate + e);
+    mass += strength[i] * e / (1.0 - rate + e);
+  }
+  return mass;
+}
+
+// Solve for the exponential tilt theta >= 0 of the landing probabilities
+// of the synapses in one container and delay slot, so that the expected
+// summation in that slot is H.
+//
+static void TiltSlot(const vector<double>& strength, double rate, double H,
+                     vector<double>* tilted) {
+  double lo = 0.0;
+  double hi = 1.0;
+  while (TiltedMass(strength, rate, hi, NULL) < H && hi < 1000.0) hi *= 2.0;
+  for (int32 iteration = 0; iteration < 60; ++iteration) {
+    double theta = (lo + hi) / 2.0;
+    if (TiltedMass(strength, rate, theta, NULL) < H) {
+      lo = theta;
+    } else {
+      hi = theta;
+    }
+  }
+  tilted->resize(strength.size());
+  TiltedMass(strength, rate, lo, tilted);
+}
+
+void Bob::TestTestSetImportance(Wordset& words, Neuron& neuron,
+                                int32 num_test_words,
+                                double* prob_false, double* effective_count) {
+  // Fraction of the test words drawn uniformly, which bounds every
+  // likelihood ratio by 1 / kDefensive.
+  //
+  const double kDefensive = 0.1;
+  const double kScale = 4294967296.0;
+  double rate = 1.0 / static_cast<double>(words.refractory_period());
+  int32 D1 = words.num_delays();
+  int32 C = neuron.C();
+  int32 slots = neuron.slots();
+  double land = rate / static_cast<double>(D1);  // Pr[lands in a slot]
+
+  // A cell is a (container, delay slot) pair.  List the live synapses
+  // which can land in each cell, and keep those cells which could
+  // possibly reach the firing threshold.
+  //
+  vector<vector<int32> > members(C * slots);
+  vector<double> mass(C * slots);
+  for (int32 i = 0; i < neuron.length(); ++i) {
+    if (neuron.delays(i) == kDisabled || neuron.strength(i) <= 0.0) continue;
+    for (int32 u = 0; u < D1; ++u) {
+      int32 cell = neuron.containers(i) * slots + neuron.delays(i) + u;
+      members[cell].push_back(i);
+      mass[cell] += neuron.strength(i);
+    }
+  }
+  vector<int32> cells;
+  for (int32 k = 0; k < C * slots; ++k) {
+    if (neuron.H() <= mass[k] + kEpsilon) cells.push_back(k);
+  }
+  if (cells.size() == 0) {
+    // No word can make this neuron fire.
+    *prob_false = 0.0;
+    *effective_count = num_test_words;
+    return;
+  }
+
+  // The biased distribution for cell k tilts the probability that each
+  // of its synapses lands in it from land to tilted[k][j], scaling the
+  // remaining outcomes (inactive, or active in another slot) to match.
+  // Synapses with larger strengths, i.e. the strengthened ones, are
+  // biased the most.  For a word, the likelihood ratio of cell k's
+  // distribution to the uniform one is exp(base[k] + sum of gain[k][j]
+  // over the synapses j which landed in cell k).
+  //
+  double weight = (1.0 - kDefensive) / cells.size();
+  vector<vector<double> > tilted(cells.size());
+  vector<vector<double> > gain(cells.size());
+  vector<double> base(cells.size());
+  vector<int32> cell_index(C * slots, -1);
+  double ratio_untouched = kDefensive;
+  for (int32 k = 0; k < cells.size(); ++k) {
+    const vector<int32>& m = members[cells[k]];
+    vector<double> strength(m.size());
+    for (int32 j = 0; j < m.size(); ++j) {
+      strength[j] = neuron.strength(m[j]);
+    }
+    TiltSlot(strength, land, neuron.H(), &tilted[k]);
+    gain[k].resize(m.size());
+    for (int32 j = 0; j < m.size(); ++j) {
+      double t = tilted[k][j];
+      base[k] += log((1.0 - t) / (1.0 - land));
+      gain[k][j] = log(t / land) - log((1.0 - t) / (1.0 - land));
+    }
+    cell_index[cells[k]] = k;
+    ratio_untouched += weight * exp(base[k]);
+  }
+
+  RememberTrainingSet(words);
+
+  vector<int32> member_of(neuron.length());
+  vector<double> landed(cells.size());
+  vector<int32> touched;
+  Word word;
+  double sum_weight = 0.0;
+  double sum_weight_squared = 0.0;
+  double sum_fired = 0.0;
+  for (int32 i = 0; i < num_test_words; ++i) {
+    do {
+      // Choose the uniform distribution, or one of the cells to bias
+      // towards, and draw a word from it.
+      //
+      double choice = random_->Rand32() / kScale;
+      int32 k = -1;
+      if (kDefensive <= choice) {
+        k = static_cast<int32>((choice - kDefensive) / weight);
+        if (k >= static_cast<int32>(cells.size())) k = cells.size() - 1;
+      }
+      if (0 <= k) {
+        const vector<int32>& m = members[cells[k]];
+        for (int32 j = 0; j < m.size(); ++j) member_of[m[j]] = j + 1;
+      }
+      word.clear();
+      for (int32 j = 0; j < neuron.length(); ++j) {
+        double u = random_->Rand32() / kScale;
+        if (k < 0 || member_of[j] == 0) {
+          if (u < rate)
+            word.push_back(pair<int32, int32>(j, random_->Rand32() % D1));
+          continue;
+        }
+        // Synapse j can land in the chosen cell
+        int32 d = cells[k] % slots - neuron.delays(j);
+        double t = tilted[k][member_of[j] - 1];
+        if (u < t) {
+          word.push_back(pair<int32, int32>(j, d));
+        } else if (1 < D1
+                   && u < t + (1.0 - t) * (rate - land) / (1.0 - land)) {
+          int32 delay = random_->Rand32() % (D1 - 1);
+          if (d <= delay) ++delay;
+          word.push_back(pair<int32, int32>(j, delay));
+        }
+      }
+      if (0 <= k) {
+        const vector<int32>& m = members[cells[k]];
+        for (int32 j = 0; j < m.size(); ++j) member_of[m[j]] = 0;
+      }
+    } while (InTrainingSet(word));
+
+    // The likelihood ratio of the mixture to the uniform distribution
+    // only differs from its untouched value in the cells where some
+    // synapse landed.
+    //
+    touched.clear();
+    for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
+      int32 cell = neuron.containers(it->first) * slots
+          + neuron.delays(it->first) + it->second;
+      if (neuron.delays(it->first) == kDisabled
+          || cell_index[cell] < 0) continue;
+      int32 c = cell_index[cell];
+      const vector<int32>& m = members[cell];
+      int32 j = lower_bound(m.begin(), m.end(), it->first) - m.begin();
+
+      // Synapses without strength are not members, and are drawn
+      // uniformly whichever distribution is chosen
+      //
+      if (j == m.size() || m[j] != it->first) continue;
+      if (landed[c] == 0.0) touched.push_back(c);
+      landed[c] += gain[c][j];
+    }
+    double ratio = ratio_untouched;
+    for (int32 j = 0; j < touched.size(); ++j) {
+      int32 c = touched[j];
+      ratio += weight * (exp(base[c] + landed[c]) - exp(base[c]));
+      landed[c] = 0.0;
+    }
+
+    double w = 1.0 / ratio;
+    sum_weight += w;
+    sum_weight_squared += w * w;
+    int32 slot = neuron.Expose(word);
+    if (0 <= slot && slot < neuron.slots()) sum_fired += w;
+  }
+
+  // Normalized by the weight of the words kept rather than by their
+  // number, since rejecting the training words leaves the mean weight
+  // below one
+  //
+  *prob_false = (0.0 < sum_weight ? sum_fired / sum_weight : 0.0);
+  *effective_count = (0.0 < sum_weight_squared
+                      ? sum_weight * sum_weight / sum_weight_squared
+                      : 0.0);
+}
+
+// Return the probability that the summation of the given synapse
+// strengths reaches H, when each synapse is independently present with
+// probability land.  Synapses are grouped by strength: the counts of
+// all but the largest group are enumerated, and the largest group's
+// binomial tail completes the sum.  Returns -1.0 if there are too many
+// combinations to enumerate.
+//
+static double EnumerateSlot(const vector<double>& value,
+                            const vector<vector<double> >& pmf,
+                            double last_value, const vector<double>& tail,
+                            int32 g, double mass, double H) {
+  if (H <= mass + kEpsilon) return 1.0;
+  if (g == value.size()) {
+    // Smallest count of the last group which reaches H
+    int32 n = tail.size() - 1;
+    int32 k = static_cast<int32>(ceil((H - kEpsilon - mass) / last_value));
+    if (k < 0) k = 0;
+    while (0 < k && H <= mass + (k - 1) * last_value + kEpsilon) --k;
+    while (k <= n && mass + k * last_value + kEpsilon < H) ++k;
+    return (k <= n ? tail[k] : 0.0);
+  }
+  double result = 0.0;
+  for (int32 k = 0; k < pmf[g].size(); ++k) {
+    if (pmf[g][k] == 0.0) continue;
+    result += pmf[g][k] * EnumerateSlot(value, pmf, last_value, tail,
+                                        g + 1, mass + k * value[g], H);
+  }
+  return result;
+}
+
+static void BinomialPmf(int32 n, double p, vector<double>* pmf) {
+  pmf->assign(n + 1, 0.0);
+  if (1.0 <= p) {
+    (*pmf)[n] = 1.0;
+    return;
+  }
+  for (int32 k = 0; k <= n; ++k) {
+    (*pmf)[k] = exp(lchoose(n, k) + k * log(p) + (n - k) * log(1.0 - p));
+  }
+}
+
+static double SlotFireProbability(vector<double>* strength, double land,
+                                  double H) {
+  const double kMaxCombinations = 1.0e7;
+
+  sort(strength->begin(), strength->end());
+  vector<double> value;
+  vector<int32> count;
+  double mass = 0.0;
+  for (int32 i = 0; i < strength->size(); ++i) {
+    double v = (*strength)[i];
+    if (value.size() == 0 || kEpsilon < v - value.back()) {
+      value.push_back(v);
+      count.push_back(0);
+    }
+    ++count.back();
+    mass += v;
+  }
+  if (mass + kEpsilon < H) return 0.0;
+
+  // The largest group is summed by its binomial tail
+  int32 last = max_element(count.begin(), count.end()) - count.begin();
+  double last_value = value[last];
+  int32 last_count = count[last];
+  value.erase(value.begin() + last);
+  count.erase(count.begin() + last);
+
+  double combinations = 1.0;
+  for (int32 g = 0; g < count.size(); ++g) combinations *= count[g] + 1;
+  if (kMaxCombinations < combinations) return -1.0;
+
+  vector<vector<double> > pmf(value.size());
+  for (int32 g = 0; g < value.size(); ++g) {
+    BinomialPmf(count[g], land, &pmf[g]);
+  }
+  vector<double> tail;
+  BinomialPmf(last_count, land, &tail);
+  for (int32 k = last_count - 1; 0 <= k; --k) tail[k] += tail[k + 1];
+
+  double result = EnumerateSlot(value, pmf, last_value, tail, 0, 0.0, H);
+  return (1.0 < result ? 1.0 : result);
+}
+
+// As SlotFireProbability(), but for words with exactly k of the
+// neuron's length synapses active, all landing in this slot; the
+// counts drawn from each strength group are multivariate
+// hypergeometric.  Synapses not in strength are inactive or dead.
+//
+static double EnumerateFixedSlot(const vector<double>& value,
+                                 const vector<int32>& count,
+                                 double last_value, int32 last_count,
+                                 int32 g, double mass, int32 picked,
+                                 int32 remaining, double log_ways,
+                                 int32 k, int32 length, double H) {
+  if (H <= mass + kEpsilon) {
+    return exp(log_ways + lchoose(remaining, k - picked)
+               - lchoose(length, k));
+  }
+  if (g == value.size()) {
+    // Sum the hypergeometric tail of the last group
+    int32 left = k - picked;
+    int32 rest = remaining - last_count;
+    double result = 0.0;
+    for (int32 y = (left < rest ? 0 : left - rest);
+         y <= last_count && y <= left; ++y) {
+      if (mass + y * last_value + kEpsilon < H) continue;
+      result += exp(log_ways + lchoose(last_count, y) + lchoose(rest, left - y)
+                    - lchoose(length, k));
+    }
+    return result;
+  }
+  double result = 0.0;
+  for (int32 x = 0; x <= count[g] && picked + x <= k; ++x) {
+    if (k - picked - x > remaining - count[g]) continue;
+    result += EnumerateFixedSlot(value, count, last_value, last_count,
+                                 g + 1, mass + x * value[g], picked + x,
+                                 remaining - count[g],
+                                 log_ways + lchoose(count[g], x),
+                                 k, length, H);
+  }
+  return result;
+}
+
+static double FixedSlotFireProbability(vector<double>* strength,
+                                       int32 k, int32 length, double H) {
+  const double kMaxCombinations = 1.0e7;
+
+  sort(strength->begin(), strength->end());
+  vector<double> value;
+  vector<int32> count;
+  for (int32 i = 0; i < strength->size(); ++i) {
+    double v = (*strength)[i];
+    if (value.size() == 0 || kEpsilon < v - value.back()) {
+      value.push_back(v);
+      count.push_back(0);
+    }
+    ++count.back();
+  }
+  if (value.size() == 0) return 0.0;
+
+  int32 last = max_element(count.begin(), count.end()) - count.begin();
+  double last_value = value[last];
+  int32 last_count = count[last];
+  value.erase(value.begin() + last);
+  count.erase(count.begin() + last);
+
+  double combinations = 1.0;
+  for (int32 g = 0; g < count.size(); ++g) combinations *= count[g] + 1;
+  if (kMaxCombinations < combinations) return -1.0;
+
+  double result = EnumerateFixedSlot(value, count, last_value, last_count,
+                                     0, 0.0, 0, length, 0.0, k, length, H);
+  return (1.0 < result ? 1.0 : result);
+}
+
+// Words with a fixed number of active synapses have a closed form only
+// when D1 = 1 and every live synapse shares one container and delay
+// slot, as with C = D1 = D2 = 1.
+//
+static bool ComputeTestSetFixed(const Wordset& words, const Neuron& neuron,
+                                double* prob_false) {
+  if (words.num_delays() != 1) return false;
+
+  int32 cell = -1;
+  vector<double> strength;
+  for (int32 i = 0; i < neuron.length(); ++i) {
+    if (neuron.delays(i) == kDisabled || neuron.strength(i) <= 0.0) continue;
+    int32 c = neuron.containers(i) * neuron.slots() + neuron.delays(i);
+    if (0 <= cell && c != cell) return false;
+    cell = c;
+    strength.push_back(neuron.strength(i));
+  }
+  double p = FixedSlotFireProbability(&strength, words.num_active(),
+                                      neuron.length(), neuron.H());
+  if (p < 0.0) return false;
+  *prob_false = p;
+  return true;
+}
+
+bool Bob::ComputeTestSet(const Wordset& words, const Neuron& neuron,
+                         double* prob_false, double* lower, double* upper) {
+  if (words.refractory_period() <= 0) {
+    if (!ComputeTestSetFixed(words, neuron, prob_false)) return false;
+    *lower = *upper = *prob_false;
+    return true;
+  }
+
+  double rate = 1.0 / static_cast<double>(words.refractory_period());
+  int32 D1 = words.num_delays();
+  int32 slots = neuron.slots();
+  double land = rate / static_cast<double>(D1);  // Pr[lands in a slot]
+
+  // A cell is a (container, delay slot) pair; collect the strengths of
+  // the live synapses which can land in each cell.
+  //
+  vector<vector<double> > cells(neuron.C() * slots);
+  for (int32 i = 0; i < neuron.length(); ++i) {
+    if (neuron.delays(i) == kDisabled || neuron.strength(i) <= 0.0) continue;
+    for (int32 u = 0; u < D1; ++u) {
+      cells[neuron.containers(i) * slots + neuron.delays(i) + u]
+          .push_back(neuron.strength(i));
+    }
+  }
+
+  // Each synapse lands in at most one cell, so the cells' summations
+  // are negatively associated: the product of the cells' probabilities
+  // of not firing bounds the neuron's from above, and is exact when
+  // D1 = 1 since then no two cells share a synapse.  The union bound
+  // gives the upper bound.  This ignores that the test words exclude
+  // the training words.
+  //
+  double log_not_fire = 0.0;
+  double sum = 0.0;
+  for (int32 k = 0; k < cells.size(); ++k) {
+    if (cells[k].size() == 0) continue;
+    double p = SlotFireProbability(&cells[k], land, neuron.H());
+    if (p < 0.0) return false;
+    log_not_fire += log1p(-p);
+    sum += p;
+  }
+  *prob_false = -expm1(log_not_fire);
+  *lower = *prob_false;
+  *upper = (D1 == 1 ? *prob_false : (1.0 < sum ? 1.0 : sum));
+  return true;
+}
+
 double Bob::BitsPerNeuron(int32 num_words,
                           int32 true_true, int32 true_false,
                           int32 false_true, int32 false_false) {
@@ -113,6 +870,11 @@ double Bob::BitsPerNeuron(int32 num_words,
       + false_true / static_cast<double>(false_false + false_true);
   double prob_learn = true_true / static_cast<double>(true_true + true_false);
 
+  return BitsPerNeuron(num_words, prob_learn, prob_false);
+}
+
+double Bob::BitsPerNeuron(int32 num_words,
+                          double prob_learn, double prob_false) {
   if (prob_learn < prob_false) return 0.0;
 
   if (0.999999 <= prob_false) prob_false = 0.999999;
@@ -132,14 +894,9 @@ double Bob::BitsPerNeuron(int32 num_words,
   return (num_words * infoValue) / log(2.0);
 }
 
-// Return the (natural) log of the choose function
-inline double lchoose(double n, double k) {
-    return lgamma(n + 1) - lgamma(n - k + 1) - lgamma(k + 1);
-}
-
 double Bob::MutualInformation(const Neuron& neuron,
                               int32 true_true, int32 true_false,
-                              int32 false_true, int32 false_false) {
+                              double prob_false) {
   if (true_true == 0) return 0.0;
 
   double Z = pow(2.0, static_cast<double>(neuron.length()));
@@ -151,9 +908,6 @@ double Bob::MutualInformation(const Neuron& neuron,
   double prob_learn = true_true / static_cast<double>(true_true + true_false);
                                       // Probability of successfully training
                                       // a word (Wl / W)
-  double prob_false = false_true / static_cast<double>(false_true
-                                                       + false_false);
-                                      // Probability of a false positive
 
   // There is always some probability of a false positive
   if (prob_false < 0.0000001) prob_false = 0.000001;
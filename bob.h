@@ -24,16 +24,60 @@
 
 
 #include "cognon.h"
+#include "neuron.h"
+#include "wordset.h"
 
 namespace cognon {
 
 class Neuron;
-class Wordset;
 class NeuronStatistics;
 
 // Only in bob_test.cc for accessing private functions
 class TestBob;
 
+// A fixed set of random test words, generated once and then shared
+// read-only by any number of Bobs on any number of threads in place of
+// the test words each would draw for itself.  The words are packed end
+// to end in one array of signals.
+//
+class TestCorpus {
+ public:
+  // The words are generated this many at a time, each group from its
+  // own random numbers
+  //
+  static const int32 kChunk = 1024;
+
+  TestCorpus() : word_length_(0), num_delays_(0), refractory_period_(0),
+                 num_active_(0) { }
+  ~TestCorpus() { }
+
+  // Generate num_words random words configured as words is (see
+  // Wordset::CopyFrom()), in parallel.  Chunk k is drawn from random
+  // numbers seeded from seed and k, so the corpus is the same however
+  // many threads generate it.
+  //
+  void Init(int32 num_words, const Wordset& words, uint32 seed);
+
+  int32 size() const { return start_.size() - 1; }
+
+  // Whether the words are configured as words' are
+  bool Matches(const Wordset& words) const;
+
+  // Set word to word i
+  void GetWord(int32 i, Word* word) const {
+    word->assign(signals_.begin() + start_[i],
+                 signals_.begin() + start_[i + 1]);
+  }
+
+ private:
+  int32 word_length_;
+  int32 num_delays_;
+  int32 refractory_period_;
+  int32 num_active_;
+  vector<int32> start_;  // Word i is signals_[start_[i], start_[i + 1])
+  Word signals_;
+};
+
 // Bob is used to test a neuron to see how well it learned the
 // wordset.  It also checks the neuron's responses to words that
 // weren't learned during training.  It generates the full
@@ -42,6 +86,9 @@ class TestBob;
 // The caller retains ownership of config, neuron, and stats,
 // but must ensure that they all outlive Bob.
 //
+// A Bob keeps its scratch test words from one test to the next, so
+// reusing one avoids reallocating them.
+//
 class Bob {
  public:
   Bob();
@@ -51,7 +98,71 @@ class Bob {
   void Test(int num_test_words,
             Wordset& words, Neuron& neuron, NeuronStatistics* stats);
 
+  // Take a neuron trained on words and evaluate it at each of the
+  // given firing thresholds from a single pass over the training and
+  // test words, recording each word's per-slot maximum container sum.
+  // stats must hold one NeuronStatistics per threshold.  The false
+  // positive probability is always uniformly sampled.
+  //
+  void TestThresholds(int num_test_words, Wordset& words, Neuron& neuron,
+                      const vector<double>& thresholds,
+                      vector<NeuronStatistics>* stats);
+
+  // Test neurons[l], trained on words[l], in lockstep (see
+  // NeuronLanes), adding to stats[l] what Test() would add with
+  // uniformly sampled false positives.  Lane l draws its test words
+  // from the thread's random numbers as Test() would, continuing from
+  // the generator state (*random_states)[l], which is kept up to date.
+  // bobs[l] holds lane l's scratch test words.
+  //
+  static void TestLockstep(int32 num_test_words, const vector<Bob*>& bobs,
+                           const vector<Wordset*>& words,
+                           const vector<Neuron*>& neurons,
+                           vector<vector<MTRand::uint32> >* random_states,
+                           const vector<NeuronStatistics*>& stats);
+
+  // Select how the false positive probability is estimated; one of
+  // TrainConfig::FalsePositiveEstimator.
+  //
+  void set_false_positive_estimator(int32 estimator) {
+    false_positive_estimator_ = estimator;
+  }
+  int32 false_positive_estimator() const { return false_positive_estimator_; }
+
+  // Draw uniformly sampled test words from corpus instead of generating
+  // them: the first num_test_words words of corpus, less those in the
+  // training set.  The corpus must match the training words and hold at
+  // least num_test_words words.  NULL (the default) generates fresh
+  // test words for each test.  The caller retains ownership of corpus.
+  //
+  void set_test_corpus(const TestCorpus* corpus) { corpus_ = corpus; }
+  const TestCorpus* test_corpus() const { return corpus_; }
+
  private:
+  int32 false_positive_estimator_;
+  scoped_ptr<RandomBase> random_;  // Pointer to random number generator
+  Wordset test_;                   // Scratch test word
+  vector<const Word*> training_;   // The training words, sorted
+  vector<Word> batch_;             // Scratch batch of test words
+  NeuronLanes lanes_;              // Scratch lanes for TestLockstep()
+  NeuronBitSlice bitslice_;        // Scratch kernel for TestTestSet()
+  const TestCorpus* corpus_;       // Shared test words, or NULL
+
+  // Remember the words the neuron was trained on, which must outlive
+  // the test, so that test words can avoid them.
+  //
+  void RememberTrainingSet(const Wordset& words);
+  bool InTrainingSet(const Word& word) const;
+
+  // Set batch_[0, n) to the next n test words, up to count of them, and
+  // return n.  Without a corpus they are count new random words not in
+  // the training set; with one they are the words of the corpus from
+  // *next, skipping those in the training set, until count are found
+  // or *next reaches num_test_words.  *next is advanced past the
+  // words used or skipped.
+  //
+  int32 NextTestWords(int32 count, int32 num_test_words, int32* next);
+
   // Given a neuron and a set of (hopefully) learned words,
   // collect the confusion matrix statistics vis-a-vis the
   // learned words.
@@ -67,13 +178,56 @@ class Bob {
                    int32 num_test_words,
                    int32* false_true, int32* false_false);
 
+  // Estimate the probability that the neuron fires on a random word
+  // which was not learned, by importance sampling.  Most test words are
+  // drawn with the synapses that could reach the threshold in one
+  // container and delay slot biased to land there, the more so the
+  // stronger they are; each firing is weighted by the likelihood ratio
+  // of the uniform to the biased distribution, and the sum divided by
+  // the total weight of the words tested.  Only applies to words with
+  // independently active synapses (refractory_period() set).
+  //
+  void TestTestSetImportance(Wordset& words, Neuron& neuron,
+                             int32 num_test_words,
+                             double* prob_false, double* effective_count);
+
+  // Compute the probability that the neuron fires on a uniformly random
+  // word directly from its synapses' delays, containers and strengths.
+  // The result is exact when D1 = 1; otherwise prob_false assumes the
+  // container and delay slots are independent, and lower and upper
+  // bound the true probability.  Words with a fixed number of active
+  // synapses follow a multivariate hypergeometric distribution, which
+  // is only evaluated when the live synapses share one container and
+  // delay slot with D1 = 1.  Returns false where no calculation applies
+  // (including too many distinct synapse strengths).
+  //
+  // The calculation takes each synapse to be active independently with
+  // probability 1 / R.  Wordset reuses random bits from one synapse to
+  // the next, so the words it samples are active at a rate up to about
+  // 2% away from 1 / R (e.g. 1.7% above it for R = 30), which can move
+  // the sampled pF about 10% away from the computed one.
+  //
+  bool ComputeTestSet(const Wordset& words, const Neuron& neuron,
+                      double* prob_false, double* lower, double* upper);
+
+  // Add the statistics of a test of neuron, trained on words, with the
+  // given confusion counts for the training words and false positive
+  // probability estimate
+  //
+  void AddTestStatistics(const Wordset& words, const Neuron& neuron,
+                         int32 true_true, int32 true_false,
+                         double prob_false, double prob_not_false,
+                         double false_count, double effective_count,
+                         NeuronStatistics* stats);
+
   // This function calculates the information stored by a single neuron
   double BitsPerNeuron(int32 num_words,
                        int32 true_true, int32 true_false,
                        int32 false_true, int32 false_false);
+  double BitsPerNeuron(int32 num_words, double prob_learn, double prob_false);
   double MutualInformation(const Neuron& neuron,
                            int32 true_true, int32 true_false,
-                           int32 false_true, int32 false_false);
+                           double prob_false);
 
   friend class TestBob;
 };
@@ -21,7 +21,10 @@
 #include <stdio.h>
 #include <sys/param.h>
 
+#include "alice.h"
 #include "cognon.h"
+#include "neuron.h"
+#include "wordset.h"
 
 #define ABS(a) ((a) < 0.0 ? -(a) : (a))
 #define FLOAT_EQ(a, b) \
@@ -51,6 +54,280 @@ class TestBob {
       }
     }
   }
+
+  // Train a neuron, then compare the importance sampled false positive
+  // estimate against plain uniform sampling with many more words.
+  //
+  void CheckImportanceSampling(const NeuronConfig& config, int32 W) {
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    Alice alice;
+
+    neuron.Init(config);
+    words.Config(W, neuron.length(), config.d1(), config.r());
+    alice.Train(&words, &neuron);
+
+    int32 false_true = 0;
+    int32 false_false = 0;
+    bob.TestTestSet(words, neuron, 200000, &false_true, &false_false);
+    double prob_uniform = false_true / 200000.0;
+
+    double prob_importance;
+    double effective_count;
+    bob.TestTestSetImportance(words, neuron, 20000,
+                              &prob_importance, &effective_count);
+    printf("CheckImportanceSampling: uniform %f, importance %f (ess %f)\n",
+           prob_uniform, prob_importance, effective_count);
+
+    double error = sqrt(prob_uniform * (1.0 - prob_uniform) / 200000.0)
+        + prob_importance / sqrt(effective_count);
+    EXPECT_LE(ABS(prob_uniform - prob_importance), 4.0 * error + 1.0e-4)
+        << "Importance sampled pF " << prob_importance
+        << " should agree with uniformly sampled pF " << prob_uniform << "\n";
+    EXPECT_LE(0.0, effective_count);
+    EXPECT_LE(effective_count, 20000.0 + 1.0e-6);
+  }
+
+  // Train a neuron, then check that the computed false positive
+  // probability and its bounds agree with plain uniform sampling.
+  //
+  void CheckExactFalsePositive(const NeuronConfig& config, int32 W) {
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    Alice alice;
+
+    neuron.Init(config);
+    words.Config(W, neuron.length(), config.d1(), config.r());
+    alice.Train(&words, &neuron);
+
+    int32 false_true = 0;
+    int32 false_false = 0;
+    bob.TestTestSet(words, neuron, 200000, &false_true, &false_false);
+    double prob_uniform = false_true / 200000.0;
+
+    double prob_exact;
+    double lower;
+    double upper;
+    EXPECT_TRUE(bob.ComputeTestSet(words, neuron, &prob_exact,
+                                   &lower, &upper));
+    printf("CheckExactFalsePositive: uniform %f, exact %f [%f, %f]\n",
+           prob_uniform, prob_exact, lower, upper);
+
+    double error = 4.0 * sqrt(prob_uniform * (1.0 - prob_uniform) / 200000.0)
+        + 1.0e-4;
+    EXPECT_LE(lower, prob_exact);
+    EXPECT_LE(prob_exact, upper);
+    EXPECT_LE(lower - error, prob_uniform)
+        << "Uniformly sampled pF " << prob_uniform
+        << " is below the lower bound " << lower << "\n";
+    EXPECT_LE(prob_uniform, upper + error)
+        << "Uniformly sampled pF " << prob_uniform
+        << " is above the upper bound " << upper << "\n";
+    if (config.d1() == 1) EXPECT_FEQ(lower, upper);
+  }
+
+  // Wordset's words are not quite the independent words that
+  // ComputeTestSet() assumes (see bob.h).  Check that their active
+  // rate stays within 2.5% of 1 / R, and that the sampled pF stays within
+  // the bias that allows of the computed pF.
+  //
+  void CheckExactSamplingBias(const NeuronConfig& config, int32 W) {
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    Wordset sample;
+    Alice alice;
+
+    neuron.Init(config);
+    words.Config(W, neuron.length(), config.d1(), config.r());
+    alice.Train(&words, &neuron);
+
+    sample.CopyFrom(20000, words);
+    int64 active = 0;
+    for (int32 i = 0; i < sample.size(); ++i) {
+      active += sample.get_word(i).size();
+    }
+    double rate = active / (20000.0 * neuron.length());
+
+    int32 false_true = 0;
+    int32 false_false = 0;
+    bob.TestTestSet(words, neuron, 200000, &false_true, &false_false);
+    double prob_uniform = false_true / 200000.0;
+
+    double prob_exact;
+    double lower;
+    double upper;
+    EXPECT_TRUE(bob.ComputeTestSet(words, neuron, &prob_exact,
+                                   &lower, &upper));
+    printf("CheckExactSamplingBias: R * rate %f, uniform %f, exact %f\n",
+           rate * config.r(), prob_uniform, prob_exact);
+
+    EXPECT_LE(ABS(rate * config.r() - 1.0), 0.025)
+        << "Wordset's active rate " << rate << " should be near 1 / "
+        << config.r() << "\n";
+    double error = 4.0 * sqrt(prob_uniform * (1.0 - prob_uniform) / 200000.0)
+        + 0.15 * upper + 1.0e-4;
+    EXPECT_LE(ABS(prob_uniform - prob_exact), error)
+        << "Uniformly sampled pF " << prob_uniform
+        << " is further from computed pF " << prob_exact
+        << " than Wordset's bias explains\n";
+  }
+
+  // An untrained neuron with H = 1 fires whenever any synapse is active
+  void CheckExactUntrained() {
+    NeuronConfig config;
+    config.set_c(1);
+    config.set_d1(1);
+    config.set_d2(1);
+    config.set_h(1);
+    config.set_q(1.0);
+    config.set_r(20);
+
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    neuron.Init(config);
+    words.Config(1, neuron.length(), config.d1(), config.r());
+
+    double prob_false;
+    double lower;
+    double upper;
+    EXPECT_TRUE(bob.ComputeTestSet(words, neuron, &prob_false,
+                                   &lower, &upper));
+    EXPECT_FEQ(prob_false, 1.0 - pow(1.0 - 1.0 / 20.0, neuron.length()));
+  }
+
+  // Words with num_active synapses: a neuron with m live synapses and
+  // H = 1 fires unless every active synapse is dead.  Then train a
+  // neuron and compare against uniform sampling.
+  //
+  void CheckExactFixed(const NeuronConfig& config, int32 W, int32 active) {
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    Alice alice;
+    double prob_false;
+    double lower;
+    double upper;
+
+    neuron.Init(config);
+    words.ConfigFixed(W, neuron.length(), config.d1(), active);
+    int32 m = neuron.length() / 3;
+    neuron.set_H(1.0);
+    for (int32 i = m; i < neuron.length(); ++i) neuron.set_strength(i, 0.0);
+    EXPECT_TRUE(bob.ComputeTestSet(words, neuron, &prob_false,
+                                   &lower, &upper));
+    EXPECT_FEQ(prob_false,
+               1.0 - exp(lgamma(neuron.length() - m + 1.0)
+                         - lgamma(neuron.length() - m - active + 1.0)
+                         - lgamma(neuron.length() + 1.0)
+                         + lgamma(neuron.length() - active + 1.0)));
+
+    neuron.Init(config);
+    alice.Train(&words, &neuron);
+
+    int32 false_true = 0;
+    int32 false_false = 0;
+    bob.TestTestSet(words, neuron, 200000, &false_true, &false_false);
+    double prob_uniform = false_true / 200000.0;
+
+    EXPECT_TRUE(bob.ComputeTestSet(words, neuron, &prob_false,
+                                   &lower, &upper));
+    printf("CheckExactFixed: uniform %f, exact %f\n",
+           prob_uniform, prob_false);
+    double error = 4.0 * sqrt(prob_uniform * (1.0 - prob_uniform) / 200000.0)
+        + 1.0e-4;
+    EXPECT_LE(ABS(prob_uniform - prob_false), error)
+        << "Uniformly sampled pF " << prob_uniform
+        << " should agree with computed pF " << prob_false << "\n";
+  }
+
+  // Test a trained neuron at several thresholds in one pass: at its own
+  // threshold the learned words must match Test(), and raising the
+  // threshold can only lower pF.
+  //
+  void CheckTestThresholds(const NeuronConfig& config, int32 W) {
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    Alice alice;
+
+    neuron.Init(config);
+    words.Config(W, neuron.length(), config.d1(), config.r());
+    alice.Train(&words, &neuron);
+
+    vector<double> thresholds;
+    thresholds.push_back(neuron.H() - 1.0);
+    thresholds.push_back(neuron.H());
+    thresholds.push_back(neuron.H() + 1.0);
+    vector<NeuronStatistics> stats(thresholds.size());
+    bob.TestThresholds(100000, words, neuron, thresholds, &stats);
+
+    NeuronStatistics expected;
+    bob.Test(100000, words, neuron, &expected);
+
+    EXPECT_FEQ(Mean(stats[1].true_true()), Mean(expected.true_true()));
+    double prob_false = Mean(expected.false_true());
+    EXPECT_LE(ABS(Mean(stats[1].false_true()) - prob_false),
+              4.0 * sqrt(prob_false * (1.0 - prob_false) / 50000.0) + 1.0e-4);
+    for (int32 t = 1; t < thresholds.size(); ++t) {
+      printf("CheckTestThresholds: H_m %f pL %f pF %f\n", thresholds[t],
+             Mean(stats[t].true_true()), Mean(stats[t].false_true()));
+      EXPECT_LE(Mean(stats[t].false_true()), Mean(stats[t - 1].false_true()));
+    }
+  }
+
+  // Test a trained neuron on a shared corpus: the same seed gives the
+  // same corpus, and the test counts the corpus words outside the
+  // training set that fire the neuron.
+  //
+  void CheckTestCorpus(const NeuronConfig& config, int32 W) {
+    const int32 kNumTestWords = 3 * TestCorpus::kChunk + 17;
+    Bob bob;
+    Neuron neuron;
+    Wordset words;
+    Alice alice;
+
+    neuron.Init(config);
+    words.Config(W, neuron.length(), config.d1(), config.r());
+    alice.Train(&words, &neuron);
+
+    TestCorpus corpus;
+    TestCorpus again;
+    corpus.Init(kNumTestWords, words, 5);
+    again.Init(kNumTestWords, words, 5);
+    EXPECT_EQ(corpus.size(), kNumTestWords);
+    EXPECT_TRUE(corpus.Matches(words));
+
+    int32 expected_true = 0;
+    int32 expected_false = 0;
+    Word word;
+    Word other;
+    bob.RememberTrainingSet(words);
+    for (int32 i = 0; i < corpus.size(); ++i) {
+      corpus.GetWord(i, &word);
+      again.GetWord(i, &other);
+      EXPECT_TRUE(word == other) << "Corpus word " << i << " differs\n";
+      if (bob.InTrainingSet(word)) continue;
+      int32 slot = neuron.Expose(word);
+      if (0 <= slot && slot < neuron.slots()) {
+        ++expected_true;
+      } else {
+        ++expected_false;
+      }
+    }
+
+    int32 false_true = 0;
+    int32 false_false = 0;
+    bob.set_test_corpus(&corpus);
+    bob.TestTestSet(words, neuron, kNumTestWords, &false_true, &false_false);
+    printf("CheckTestCorpus: %d of %d test words fired\n",
+           false_true, false_true + false_false);
+    EXPECT_EQ(false_true, expected_true);
+    EXPECT_EQ(false_false, expected_false);
+  }
 };
 
 TEST_F(BobTest, CheckBitsPerNeuron) {
@@ -62,10 +339,148 @@ TEST_F(BobTest, CheckBitsPerNeuron) {
 TEST_F(BobTest, CheckMutualInformation) {
 }
 
+TEST_F(BobTest, CheckImportanceSampling) {
+  TestBob test;
+  NeuronConfig config;
+
+  config.set_c(1);
+  config.set_d1(1);
+  config.set_d2(1);
+  config.set_h(20);
+  config.set_q(1.0);
+  config.set_r(20);
+  config.set_g_m(1.5);
+  config.set_h_m(30.0);
+  test.CheckImportanceSampling(config, 3);
+
+  config.set_c(4);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(3.0);
+  config.set_r(10);
+  config.set_h_m(15.0);
+  test.CheckImportanceSampling(config, 30);
+}
+
+TEST_F(BobTest, CheckExactFalsePositive) {
+  TestBob test;
+  NeuronConfig config;
+
+  test.CheckExactUntrained();
+
+  config.set_c(1);
+  config.set_d1(1);
+  config.set_d2(1);
+  config.set_q(1.0);
+  config.set_r(20);
+  config.set_h(20);
+  config.set_g_m(1.5);
+  config.set_h_m(30.0);
+  test.CheckExactFalsePositive(config, 3);
+
+  config.set_c(4);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(3.0);
+  config.set_r(10);
+  config.set_h_m(15.0);
+  test.CheckExactFalsePositive(config, 30);
+}
+
+TEST_F(BobTest, CheckExactSamplingBias) {
+  TestBob test;
+  NeuronConfig config;
+
+  config.set_c(1);
+  config.set_d1(1);
+  config.set_d2(1);
+  config.set_q(1.0);
+  config.set_r(30);
+  config.set_h(10);
+  config.set_g_m(1.5);
+  config.set_h_m(15.0);
+  test.CheckExactSamplingBias(config, 3);
+
+  config.set_r(10);
+  test.CheckExactSamplingBias(config, 3);
+}
+
+TEST_F(BobTest, CheckExactFixed) {
+  TestBob test;
+  NeuronConfig config;
+
+  config.set_c(1);
+  config.set_d1(1);
+  config.set_d2(1);
+  config.set_h(10);
+  config.set_q(10.0);
+  config.set_r(1);
+  test.CheckExactFixed(config, 4, 10);
+
+  config.set_h(4);
+  config.set_q(25.0);
+  config.set_g_m(1.5);
+  config.set_h_m(6.0);
+  test.CheckExactFixed(config, 10, 5);
+}
+
+TEST_F(BobTest, CheckTestThresholds) {
+  TestBob test;
+  NeuronConfig config;
+
+  config.set_c(1);
+  config.set_d1(1);
+  config.set_d2(1);
+  config.set_h(20);
+  config.set_q(1.0);
+  config.set_r(20);
+  config.set_g_m(1.5);
+  config.set_h_m(30.0);
+  test.CheckTestThresholds(config, 5);
+
+  config.set_c(4);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(3.0);
+  config.set_r(10);
+  config.set_h_m(15.0);
+  test.CheckTestThresholds(config, 30);
+}
+
+TEST_F(BobTest, CheckTestCorpus) {
+  TestBob test;
+  NeuronConfig config;
+
+  config.set_c(1);
+  config.set_d1(1);
+  config.set_d2(1);
+  config.set_h(5);
+  config.set_q(1.0);
+  config.set_r(5);
+  test.CheckTestCorpus(config, 10);
+
+  config.set_c(4);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(4);
+  config.set_q(3.0);
+  config.set_r(10);
+  test.CheckTestCorpus(config, 30);
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
   CALL_TEST(cognon::CheckBitsPerNeuron);
+  CALL_TEST(cognon::CheckImportanceSampling);
+  CALL_TEST(cognon::CheckExactFalsePositive);
+  CALL_TEST(cognon::CheckExactSamplingBias);
+  CALL_TEST(cognon::CheckExactFixed);
+  CALL_TEST(cognon::CheckTestThresholds);
+  CALL_TEST(cognon::CheckTestCorpus);
   //  CALL_TEST(cognon::CheckMututalInformation);
   return 0;
 }
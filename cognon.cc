@@ -21,40 +21,109 @@
 #include "cognon.h"
 
 #include <math.h>
+#include <omp.h>
+#include <string.h>
 
 #include "alice.h"
 #include "bob.h"
 #include "neuron.h"
+#include "result_cache.h"
 #include "wordset.h"
 
 
 namespace cognon {
 
+// Check the invariants of a Statistic: its values are all of its
+// samples, none of them, or (with max_values) a sample of them.
+//
+static bool ValidStatistic(const Statistic& stat) {
+  if (!stat.has_count()) return stat.values_size() == 0;
+  if (0 < stat.count() && !(stat.has_sum() && stat.has_ssum())) return false;
+  if (stat.has_max_values())
+    return stat.values_size() <= min(stat.count(), stat.max_values());
+  return stat.values_size() == 0 || stat.count() == stat.values_size();
+}
+
+// Return true if the values are a uniform sample of all of the samples
+// (or all of them), rather than having been dropped.
+//
+static bool HasValues(const Statistic& stat) {
+  int32 count = stat.count();
+  if (stat.has_max_values()) count = min(count, stat.max_values());
+  return stat.values_size() == count;
+}
+
+// The summation of squared differences from the mean
+static double SquaredDeviations(const Statistic& stat) {
+  if (!stat.has_count() || stat.count() <= 0) return 0.0;
+  if (stat.has_m2()) return stat.m2();
+  double m2 = stat.ssum() - stat.sum() * stat.sum() / stat.count();
+  return (0.0 < m2 ? m2 : 0.0);
+}
+
+// Random numbers for sampling a statistic's values.  They come from a
+// stream seeded from the statistics themselves rather than from the
+// thread's generator, so sampling neither uses up the simulation's
+// random numbers nor depends on which thread adds the samples.  Each
+// number is a SplitMix64 step.
+//
+class SampleRandom {
+ public:
+  SampleRandom() : state_(0) { }
+
+  // Mix value into the seed
+  void Mix(uint64 value) { state_ = Next(state_ ^ value); }
+  void Mix(double value) {
+    uint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    Mix(bits);
+  }
+
+  uint32 Rand32() { return static_cast<uint32>(Next(state_) >> 32); }
+
+ private:
+  uint64 Next(uint64 seed) {
+    state_ = seed + 0x9e3779b97f4a7c15ULL;
+    uint64 z = state_;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64 state_;
+};
+
 void AddSample(double v, Statistic* stat) {
-  CHECK((!stat->has_count() && stat->values_size() == 0) ||
-        (stat->has_count() &&
-         (stat->values_size() == 0 || stat->count() == stat->values_size())));
-  CHECK(!stat->has_count()
-        || stat->count() == 0
-        || (0 < stat->count() && stat->has_sum() && stat->has_ssum()));
-
-  if (!stat->has_count()
-      || stat->count() == 0
-      || (stat->count() == stat->values_size()))
-    stat->add_values(v);
-
-  stat->set_count(stat->count() + 1);
+  CHECK(ValidStatistic(*stat));
+
+  int32 n = stat->count();
+  if (HasValues(*stat)) {
+    if (!stat->has_max_values() || n < stat->max_values()) {
+      stat->add_values(v);
+    } else if (0 < stat->max_values()) {
+      // Reservoir sampling: keep v with probability max_values / (n + 1)
+      SampleRandom random;
+      random.Mix(static_cast<uint64>(n));
+      random.Mix(stat->sum());
+      random.Mix(v);
+      int32 i = random.Rand32() % (n + 1);
+      if (i < stat->max_values()) *stat->mutable_values(i) = v;
+    }
+  }
+
+  // Welford's update
+  double mean = (0 < n ? stat->sum() / n : 0.0);
+  double delta = v - mean;
+  double m2 = SquaredDeviations(*stat) + delta * (v - (mean + delta / (n + 1)));
+
+  stat->set_count(n + 1);
   stat->set_sum(stat->sum() + v);
   stat->set_ssum(stat->ssum() + v * v);
+  stat->set_m2(m2);
 }
 
 double Mean(const Statistic& stat) {
-  CHECK((!stat.has_count() && stat.values_size() == 0) ||
-        (stat.has_count() &&
-         (stat.values_size() == 0 || stat.count() == stat.values_size())));
-  CHECK(!stat.has_count()
-        || stat.count() == 0
-        || (0 < stat.count() && stat.has_sum() && stat.has_ssum()));
+  CHECK(ValidStatistic(stat));
 
   if (stat.has_count() && stat.has_sum() && 0 < stat.count())
     return stat.sum() / static_cast<double>(stat.count());
@@ -62,17 +131,11 @@ double Mean(const Statistic& stat) {
 }
 
 double Stddev(const Statistic& stat) {
-  CHECK((!stat.has_count() && stat.values_size() == 0) ||
-        (stat.has_count() &&
-         (stat.values_size() == 0 || stat.count() == stat.values_size())));
-  CHECK(!stat.has_count()
-        || stat.count() == 0
-        || (0 < stat.count() && stat.has_sum() && stat.has_ssum()));
+  CHECK(ValidStatistic(stat));
 
   if (stat.has_count() && 1 < stat.count()
       && stat.has_sum() && stat.has_ssum()) {
-    double v = stat.count() * stat.ssum() - stat.sum() * stat.sum();
-    v /= static_cast<double>(stat.count() * (stat.count() - 1));
+    double v = SquaredDeviations(stat) / (stat.count() - 1);
     return (0.0 <= v ? sqrt(v) : 0.0);
   }
   return -1.0;
@@ -84,23 +147,58 @@ Statistic operator+(const Statistic& a, const Statistic& b) {
   return result;
 }
 
+// Set merged to a uniform sample of at most max_values of the union of
+// the populations of a and b, given uniform samples of each.
+//
+static void MergeSamples(const Statistic& a, const Statistic& b,
+                         int32 max_values, vector<double>* merged) {
+  vector<double> pool[2];
+  pool[0].assign(a.values_size() ? &a.values(0) : NULL,
+                 a.values_size() ? &a.values(0) + a.values_size() : NULL);
+  pool[1].assign(b.values_size() ? &b.values(0) : NULL,
+                 b.values_size() ? &b.values(0) + b.values_size() : NULL);
+  int32 remaining[2] = { a.count(), b.count() };
+  int32 k = min(max_values, a.count() + b.count());
+
+  // The number drawn from each population is hypergeometric, and each
+  // draw is uniform within its sample.
+  //
+  SampleRandom random;
+  random.Mix(static_cast<uint64>(a.count()));
+  random.Mix(static_cast<uint64>(b.count()));
+  random.Mix(a.sum());
+  random.Mix(b.sum());
+  merged->clear();
+  for (int32 i = 0; i < k; ++i) {
+    int32 total = remaining[0] + remaining[1];
+    int32 side = (random.Rand32() % total < remaining[0] ? 0 : 1);
+    --remaining[side];
+    vector<double>& p = pool[side];
+    int32 j = random.Rand32() % p.size();
+    merged->push_back(p[j]);
+    p[j] = p.back();
+    p.pop_back();
+  }
+}
+
 Statistic& operator+=(Statistic& a, const Statistic& b) {
-  CHECK((!a.has_count() && a.values_size() == 0) ||
-        (a.has_count() &&
-         (a.values_size() == 0 || a.count() == a.values_size())));
-  CHECK((!b.has_count() && b.values_size() == 0) ||
-        (b.has_count() &&
-         (b.values_size() == 0 || b.count() == b.values_size())));
-  CHECK(!a.has_count()
-        || a.count() == 0
-        || (0 < a.count() && a.has_sum() && a.has_ssum()));
-  CHECK(!b.has_count()
-        || b.count() == 0
-        || (0 < b.count() && b.has_sum() && b.has_ssum()));
-
-  if (a.has_count() && 0 < a.count()
-      && b.has_count() && 0 < b.count()
-      && (a.count() != a.values_size() || b.count() != b.values_size())) {
+  CHECK(ValidStatistic(a));
+  CHECK(ValidStatistic(b));
+
+  if (a.has_max_values() || b.has_max_values()) {
+    int32 max_values = (a.has_max_values() ? a.max_values() : b.max_values());
+    if (b.has_max_values()) max_values = min(max_values, b.max_values());
+    vector<double> merged;
+    if (HasValues(a) && HasValues(b)) MergeSamples(a, b, max_values, &merged);
+    a.clear_values();
+    for (int32 i = 0; i < merged.size(); ++i) {
+      a.add_values(merged[i]);
+    }
+    a.set_max_values(max_values);
+  } else if (a.has_count() && 0 < a.count()
+             && b.has_count() && 0 < b.count()
+             && (a.count() != a.values_size()
+                 || b.count() != b.values_size())) {
     // Only one of a and b has values(), so result may not have values()
     a.clear_values();
   } else {
@@ -109,6 +207,17 @@ Statistic& operator+=(Statistic& a, const Statistic& b) {
     }
   }
 
+  // Chan's merge of the squared deviations
+  if (b.has_count() && 0 < b.count()) {
+    double m2 = SquaredDeviations(b);
+    if (a.has_count() && 0 < a.count()) {
+      double delta = b.sum() / b.count() - a.sum() / a.count();
+      m2 += SquaredDeviations(a)
+          + delta * delta * a.count() * b.count() / (a.count() + b.count());
+    }
+    a.set_m2(m2);
+  }
+
 #define PB_OPERATOR_PLUS(param) \
   if (a.has_##param() && b.has_##param()) { \
     a.set_##param(a.param() + b.param()); \
@@ -122,18 +231,15 @@ Statistic& operator+=(Statistic& a, const Statistic& b) {
   return a;
 }
 
-void AddSample(int32 bucket, double v, Histogram* hist) {
-  // Add empty buckets, if necessary
-  for (int32 i = hist->values_size(); i <= bucket; ++i) {
-    hist->add_values();
-  }
-  AddSample(v, hist->mutable_values(bucket));
-}
-
 void SetHistogram(const vector<int32>& data, Histogram* result) {
-  for (int32 i = data.size() - 1; 0 <= i; --i) {
-    AddSample(i, static_cast<double>(data[i]), result);
+  int32 size = data.size();
+  result->Reserve(size);
+  for (int32 i = 0; i < size; ++i) {
+    double v = static_cast<double>(data[i]);
+    *result->mutable_sum(i) += v;
+    *result->mutable_ssum(i) += v * v;
   }
+  result->set_count(result->count() + 1);
 }
 
 Histogram operator+(const Histogram& a, const Histogram& b) {
@@ -143,26 +249,20 @@ Histogram operator+(const Histogram& a, const Histogram& b) {
 }
 
 Histogram& operator+=(Histogram& a, const Histogram& b) {
-  int32 i;
-  int32 a_count = (a.values_size() > 0 ? a.values(0).count() : 0);
-  int32 b_count = (b.values_size() > 0 ? b.values(0).count() : 0);
-
-  for (i = 0; i < b.values_size(); ++i) {
-    if (i < a.values_size()) {
-      *a.mutable_values(i) += b.values(i);
-    } else {
-      Statistic* s = a.add_values();
-      for (int32 j = 0; j < a_count; ++j) {
-        AddSample(0.0, s);
-      }
-      *a.mutable_values(i) += b.values(i);
-    }
-  }
-  for (; i < a.values_size(); ++i) {
-    for (int32 j = 0; j < b_count; ++j) {
-      AddSample(0.0, a.mutable_values(i));
+  // Buckets missing from either side are zeros, so just add the arrays
+  int32 size = b.values_size();
+  a.Reserve(size);
+  if (0 < size) {
+    double* a_sum = a.mutable_sum(0);
+    double* a_ssum = a.mutable_ssum(0);
+    const double* b_sum = &b.sum(0);
+    const double* b_ssum = &b.ssum(0);
+    for (int32 i = 0; i < size; ++i) {
+      a_sum[i] += b_sum[i];
+      a_ssum[i] += b_ssum[i];
     }
   }
+  a.set_count(a.count() + b.count());
   return a;
 }
 
@@ -184,6 +284,11 @@ NeuronStatistics& operator+=(NeuronStatistics& a,
   PB_OPERATOR_PLUS(false_false);
   PB_OPERATOR_PLUS(false_true);
   PB_OPERATOR_PLUS(false_count);
+  PB_OPERATOR_PLUS(false_effective_count);
+  PB_OPERATOR_PLUS(false_true_lower);
+  PB_OPERATOR_PLUS(false_true_upper);
+  PB_OPERATOR_PLUS(false_true_sampled);
+  PB_OPERATOR_PLUS(false_rejected);
   PB_OPERATOR_PLUS(true_false);
   PB_OPERATOR_PLUS(true_true);
   PB_OPERATOR_PLUS(true_count);
@@ -210,15 +315,18 @@ void StatisticStripValues(Statistic* stat) {
 }
 
 void HistogramStripValues(Histogram* hist) {
-  for (int32 i = 0; i < hist->values_size(); ++i) {
-    StatisticStripValues(hist->mutable_values(i));
-  }
+  // Histograms only keep the per-bucket sums
 }
 
 void NeuronStatisticsStripValues(NeuronStatistics* stats) {
   StatisticStripValues(stats->mutable_false_false());
   StatisticStripValues(stats->mutable_false_true());
   StatisticStripValues(stats->mutable_false_count());
+  StatisticStripValues(stats->mutable_false_effective_count());
+  StatisticStripValues(stats->mutable_false_true_lower());
+  StatisticStripValues(stats->mutable_false_true_upper());
+  StatisticStripValues(stats->mutable_false_true_sampled());
+  StatisticStripValues(stats->mutable_false_rejected());
   StatisticStripValues(stats->mutable_true_false());
   StatisticStripValues(stats->mutable_true_true());
   StatisticStripValues(stats->mutable_true_count());
@@ -237,6 +345,39 @@ void NeuronStatisticsStripValues(NeuronStatistics* stats) {
   HistogramStripValues(stats->mutable_synapse_after_delay_histogram());
 }
 
+void NeuronStatisticsSetMaxValues(int32 max_values, NeuronStatistics* stats) {
+#define SET_MAX_VALUES(param)                               \
+  if (max_values < 0) {                                     \
+    stats->mutable_##param()->clear_max_values();           \
+  } else {                                                  \
+    stats->mutable_##param()->set_max_values(max_values);   \
+  }
+  SET_MAX_VALUES(false_false);
+  SET_MAX_VALUES(false_true);
+  SET_MAX_VALUES(false_count);
+  SET_MAX_VALUES(false_effective_count);
+  SET_MAX_VALUES(false_true_lower);
+  SET_MAX_VALUES(false_true_upper);
+  SET_MAX_VALUES(false_true_sampled);
+  SET_MAX_VALUES(false_rejected);
+  SET_MAX_VALUES(true_false);
+  SET_MAX_VALUES(true_true);
+  SET_MAX_VALUES(true_count);
+  SET_MAX_VALUES(q_after);
+  SET_MAX_VALUES(synapses_per_neuron);
+  SET_MAX_VALUES(bits_per_neuron);
+  SET_MAX_VALUES(bits_per_neuron_per_refractory_period);
+  SET_MAX_VALUES(mutual_information);
+  SET_MAX_VALUES(d_effective);
+#undef SET_MAX_VALUES
+}
+
+static int32 statistic_max_values = 0;
+
+void SetStatisticMaxValues(int32 max_values) {
+  statistic_max_values = max_values;
+}
+
 // Return "true" if a is "less" than b.
 bool operator<(const TrainConfig&a, const TrainConfig& b) {
   const NeuronConfig& neuron_a = a.config();
@@ -262,6 +403,7 @@ bool operator<(const TrainConfig&a, const TrainConfig& b) {
   VALUE_COMPARE(a, b, w);
   VALUE_COMPARE(a, b, num_active);
   VALUE_COMPARE(a, b, num_test_words);
+  VALUE_COMPARE(a, b, false_positive_estimator);
 #undef VALUE_COMPARE
 
   return false;
@@ -285,43 +427,148 @@ static double HistogramEntropy(const vector<int32>& hist) {
   return pow(2.0, entropy);
 }
 
-void RunExperiment(const TrainConfig& config, NeuronStatistics* result) {
+// The objects that one thread reuses from one experiment to the next,
+// so that repetitions do not allocate and free them, or create their
+// random number generators, every time.
+//
+struct ExperimentContext {
   Wordset words;
   Neuron neuron;
+  Alice alice;
+  Bob bob;
+
+  // Scratch histograms
+  vector<int32> delay_histogram;
+  vector<int32> input_delay_histogram;
+  vector<int32> input_max_sum_delay_histogram;
+  vector<int32> H_histogram;
+  vector<int32> word_delay_histogram;
+  vector<int32> synapse_before_delay_histogram;
+  vector<int32> synapse_after_delay_histogram;
+
+  // Scratch result for RunThresholdExperiment()
+  NeuronStatistics trained;
+
+  // The seeded repetition being run (see SeedRepetition()), or -1
+  int32 repetition;
+
+  ExperimentContext() : repetition(-1) { }
+};
+
+static ExperimentContext** experiment_contexts = NULL;
+
+static int32 random_seed = -1;
+static bool common_random_numbers = false;
+
+void SetRandomSeed(int32 seed) {
+  random_seed = seed;
+}
+
+void SetCommonRandomNumbers(bool enabled) {
+  common_random_numbers = enabled;
+}
 
+// The independent streams of random numbers that each repetition draws
+// from with common random numbers
+//
+enum RandomPhase {
+  NEURON_PHASE = 0,    // Synapse delays and containers
+  TRAINING_PHASE = 1,  // Training words
+  TEST_PHASE = 2       // Test words
+};
+
+// With common random numbers, reseed the calling thread's random numbers
+// for phase of the context's repetition from the seed, the repetition's
+// number and phase alone, so that every configuration draws the same
+// numbers for it.
+//
+static void SeedPhase(const ExperimentContext& context, RandomPhase phase) {
+  if (!common_random_numbers || context.repetition < 0) return;
+  string key;
+  OutputArchive out(&key);
+  out & random_seed;
+  out & context.repetition;
+  int32 value = phase;
+  out & value;
+  RandomBase random;
+  random.Seed(Checksum(key.data(), key.size()));
+}
+
+// The calling thread's context for one lane of lockstep experiments
+// (see RunLockstepExperiments()), lane zero otherwise.  Each context is
+// created by the thread that uses it, so that its random number
+// generators are that thread's.
+//
+static ExperimentContext* ThreadExperimentContext(int32 lane) {
+  const int32 kLanes = NeuronLanes::kMaxLanes;
+  CHECK(0 <= lane && lane < kLanes);
+#pragma omp critical(experiment_contexts)
+  if (experiment_contexts == NULL) {
+    experiment_contexts = new ExperimentContext*[omp_get_max_threads()
+                                                 * kLanes];
+    for (int32 i = 0; i < omp_get_max_threads() * kLanes; ++i) {
+      experiment_contexts[i] = NULL;
+    }
+  }
+  ExperimentContext*& context =
+      experiment_contexts[omp_get_thread_num() * kLanes + lane];
+  if (context == NULL) context = new ExperimentContext;
+  return context;
+}
+
+// Train the context's neuron on a new wordset, collecting the training
+// statistics
+//
+static void TrainExperiment(const TrainConfig& config,
+                            ExperimentContext* context,
+                            NeuronStatistics* result) {
   // Must have either both or neither of g_m() and h_m()
   CHECK((config.config().has_g_m() && config.config().has_h_m())
         || (!config.config().has_g_m() && !config.config().has_h_m()));
 
+  Wordset* words = &context->words;
+  Neuron* neuron = &context->neuron;
+
   result->Clear();
   result->mutable_config()->CopyFrom(config);
 
-  neuron.Init(config.config());
+  SeedPhase(*context, NEURON_PHASE);
+  neuron->Init(config.config());
+  SeedPhase(*context, TRAINING_PHASE);
   if (config.has_num_active()) {
-    words.ConfigFixed(config.w(), neuron.length(),
-                      config.config().d1(), config.num_active());
+    words->ConfigFixed(config.w(), neuron->length(),
+                       config.config().d1(), config.num_active());
   } else {
-    words.Config(config.w(), neuron.length(),
-                 config.config().d1(), config.config().r());
+    words->Config(config.w(), neuron->length(),
+                  config.config().d1(), config.config().r());
   }
 
-  vector<int32> synapse_before_delay_histogram;
-  neuron.GetSynapseDelayHistogram(&synapse_before_delay_histogram);
+  vector<int32>& synapse_before_delay_histogram =
+      context->synapse_before_delay_histogram;
+  synapse_before_delay_histogram.clear();
+  neuron->GetSynapseDelayHistogram(&synapse_before_delay_histogram);
 
-  Alice alice;
-  vector<int32> delay_histogram;
-  vector<int32> input_delay_histogram;
-  vector<int32> input_max_sum_delay_histogram;
-  vector<int32> H_histogram;
-  alice.TrainHistogram(&words, &neuron,
-                       &delay_histogram, &input_delay_histogram,
-                       &input_max_sum_delay_histogram, &H_histogram);
+  vector<int32>& delay_histogram = context->delay_histogram;
+  vector<int32>& input_delay_histogram = context->input_delay_histogram;
+  vector<int32>& input_max_sum_delay_histogram =
+      context->input_max_sum_delay_histogram;
+  vector<int32>& H_histogram = context->H_histogram;
+  delay_histogram.clear();
+  input_delay_histogram.clear();
+  input_max_sum_delay_histogram.clear();
+  H_histogram.clear();
+  context->alice.TrainHistogram(words, neuron,
+                                &delay_histogram, &input_delay_histogram,
+                                &input_max_sum_delay_histogram, &H_histogram);
 
-  vector<int32> synapse_after_delay_histogram;
-  neuron.GetSynapseDelayHistogram(&synapse_after_delay_histogram);
+  vector<int32>& synapse_after_delay_histogram =
+      context->synapse_after_delay_histogram;
+  synapse_after_delay_histogram.clear();
+  neuron->GetSynapseDelayHistogram(&synapse_after_delay_histogram);
 
   // Collect various training-related statistics
-  vector<int32> word_delay_histogram;
+  vector<int32>& word_delay_histogram = context->word_delay_histogram;
+  word_delay_histogram.clear();
   SetHistogram(delay_histogram,
                result->mutable_delay_histogram());
   SetHistogram(input_delay_histogram,
@@ -345,11 +592,22 @@ void RunExperiment(const TrainConfig& config, NeuronStatistics* result) {
       break;
     }
   }
+}
+
+void RunExperiment(const TrainConfig& config, NeuronStatistics* result) {
+  ExperimentContext* context = ThreadExperimentContext(0);
+  const Neuron& neuron = context->neuron;
+
+  TrainExperiment(config, context, result);
+  SeedPhase(*context, TEST_PHASE);
 
   // Now start testing
-  Bob bob;
+  Bob& bob = context->bob;
+  bob.set_false_positive_estimator(config.has_false_positive_estimator()
+                                   ? config.false_positive_estimator()
+                                   : TrainConfig::UNIFORM_SAMPLING);
   bob.Test((config.has_num_test_words() ? config.num_test_words() : 100000),
-           words, neuron,
+           context->words, context->neuron,
            result);
 
   // Collect statistics
@@ -357,28 +615,209 @@ void RunExperiment(const TrainConfig& config, NeuronStatistics* result) {
   AddSample(neuron.length(), result->mutable_synapses_per_neuron());
 }
 
+void RunThresholdExperiment(const TrainConfig& config,
+                            const vector<double>& thresholds,
+                            vector<NeuronStatistics>* results) {
+  ExperimentContext* context = ThreadExperimentContext(0);
+  const Neuron& neuron = context->neuron;
+  NeuronStatistics& trained = context->trained;
+
+  // The thresholds replace the synapse-strength threshold H_m
+  CHECK(config.config().has_h_m());
+
+  TrainExperiment(config, context, &trained);
+  AddSample(neuron.Q_after(), trained.mutable_q_after());
+  AddSample(neuron.length(), trained.mutable_synapses_per_neuron());
+
+  results->resize(thresholds.size());
+  for (int32 t = 0; t < thresholds.size(); ++t) {
+    (*results)[t].CopyFrom(trained);
+    (*results)[t].mutable_config()->mutable_config()->set_h_m(thresholds[t]);
+  }
+
+  SeedPhase(*context, TEST_PHASE);
+  Bob& bob = context->bob;
+  bob.TestThresholds((config.has_num_test_words()
+                      ? config.num_test_words() : 100000),
+                     context->words, context->neuron, thresholds, results);
+}
+
+// When seeded, reseed the calling thread's random numbers for
+// repetition number repetition of config, run in context, so that each
+// repetition is repeatable whichever thread runs it and whatever ran
+// before.
+//
+static void SeedRepetition(const TrainConfig& config, int32 repetition,
+                           ExperimentContext* context) {
+  context->repetition = (random_seed < 0 ? -1 : repetition);
+  if (random_seed < 0) return;
+  string key;
+  OutputArchive out(&key);
+  out & random_seed;
+  out & config;
+  out & repetition;
+  RandomBase random;
+  random.Seed(Checksum(key.data(), key.size()));
+}
+
+static int32 lockstep_lanes = 1;
+static bool lockstep_every_thread = true;
+
+void SetLockstepLanes(int32 lanes, bool every_thread) {
+  CHECK(1 <= lanes && lanes <= NeuronLanes::kMaxLanes);
+  lockstep_lanes = lanes;
+  lockstep_every_thread = every_thread;
+}
+
+// Run each of repetitions of config as RunExperiment() would after
+// SeedRepetition(), setting results to their results.  With uniformly
+// sampled false positives, each repetition trains its own neuron and
+// then all of them are tested in lockstep.  Test words come from
+// corpus, unless it is NULL (see Bob::set_test_corpus()).
+//
+static void RunLockstepExperiments(const TrainConfig& config,
+                                   const vector<int32>& repetitions,
+                                   const TestCorpus* corpus,
+                                   vector<NeuronStatistics>* results) {
+  int32 L = repetitions.size();
+  results->resize(L);
+  int32 estimator = (config.has_false_positive_estimator()
+                     ? config.false_positive_estimator()
+                     : TrainConfig::UNIFORM_SAMPLING);
+  if (L == 1 || estimator != TrainConfig::UNIFORM_SAMPLING) {
+    ExperimentContext* context = ThreadExperimentContext(0);
+    context->bob.set_test_corpus(corpus);
+    for (int32 l = 0; l < L; ++l) {
+      SeedRepetition(config, repetitions[l], context);
+      RunExperiment(config, &(*results)[l]);
+    }
+    context->bob.set_test_corpus(NULL);
+    return;
+  }
+
+  RandomBase random;
+  vector<vector<MTRand::uint32> > random_states(L);
+  vector<Bob*> bobs(L);
+  vector<Wordset*> words(L);
+  vector<Neuron*> neurons(L);
+  vector<NeuronStatistics*> stats(L);
+  for (int32 l = 0; l < L; ++l) {
+    ExperimentContext* context = ThreadExperimentContext(l);
+    bobs[l] = &context->bob;
+    bobs[l]->set_test_corpus(corpus);
+    words[l] = &context->words;
+    neurons[l] = &context->neuron;
+    stats[l] = &(*results)[l];
+
+    // Each lane continues its own stream of random numbers from here
+    if (random_seed < 0) random.Seed(random.Rand32());
+    SeedRepetition(config, repetitions[l], context);
+    TrainExperiment(config, context, stats[l]);
+    SeedPhase(*context, TEST_PHASE);
+    random.SaveState(&random_states[l]);
+  }
+
+  Bob::TestLockstep((config.has_num_test_words()
+                     ? config.num_test_words() : 100000),
+                    bobs, words, neurons, &random_states, stats);
+
+  for (int32 l = 0; l < L; ++l) {
+    bobs[l]->set_test_corpus(NULL);
+    AddSample(neurons[l]->Q_after(), stats[l]->mutable_q_after());
+    AddSample(neurons[l]->length(), stats[l]->mutable_synapses_per_neuron());
+  }
+}
+
+static ResultCache* result_cache = NULL;
+
+void SetResultCache(ResultCache* cache) {
+  result_cache = cache;
+}
+
+// Runs a group of repetitions of one configuration in lockstep
 class JobRunConfiguration : public Job {
  public:
-  JobRunConfiguration(TrainConfig* config, NeuronStatistics* result)
-      : config_(config), result_(result), temp_() { }
+  JobRunConfiguration(TrainConfig* config, ResultCache* cache)
+      : config_(config), cache_(cache), corpus_(NULL), temp_() { }
   ~JobRunConfiguration() {
-      (*result_) += temp_;
+    for (int32 i = 0; i < results_.size(); ++i) {
+      (*results_[i]) += temp_[i];
+    }
   }
+
+  // Run repetition number repetition, adding its result to result
+  void AddRepetition(int32 repetition, NeuronStatistics* result) {
+    repetitions_.push_back(repetition);
+    results_.push_back(result);
+  }
+  const TrainConfig* config() const { return config_; }
+  int32 size() const { return repetitions_.size(); }
+
+  // Test on corpus (see Bob::set_test_corpus()), which must outlive Run()
+  void set_test_corpus(const TestCorpus* corpus) { corpus_ = corpus; }
+
   virtual void Run() {
-    RunExperiment(*config_, &temp_);
+    RunLockstepExperiments(*config_, repetitions_, corpus_, &temp_);
+    if (cache_ != NULL) {
+      // Checkpoint the repetitions as soon as they finish, and stop
+      // rather than run on without checkpoints
+      //
+      for (int32 i = 0; i < temp_.size(); ++i) {
+        NeuronStatisticsStripValues(&temp_[i]);
+        bool written;
+#pragma omp critical(result_cache)
+        written = cache_->AddRepetition(repetitions_[i], temp_[i]);
+        if (!written) {
+          fprintf(stderr, "Cannot write result cache\n");
+          exit(1);
+        }
+      }
+    }
   }
  private:
   TrainConfig* config_;
-  NeuronStatistics* result_;
-  NeuronStatistics temp_;
+  ResultCache* cache_;
+  const TestCorpus* corpus_;
+  vector<int32> repetitions_;
+  vector<NeuronStatistics*> results_;
+  vector<NeuronStatistics> temp_;
 };
 
-void RunConfiguration(int32 repetitions,
-                      const TrainConfig& config, NeuronStatistics* result) {
+// Add repetition number repetition of config to jobs, adding its result
+// to result.  It joins *job, the last job added for config, while that
+// has fewer than lanes repetitions.
+//
+static void AddRepetitionJob(TrainConfig* config, int32 repetition,
+                             int32 lanes, ResultCache* cache,
+                             NeuronStatistics* result, vector<Job*>* jobs,
+                             JobRunConfiguration** job) {
+  if (*job == NULL || (*job)->config() != config || lanes <= (*job)->size()) {
+    *job = new JobRunConfiguration(config, cache);
+    jobs->push_back(*job);
+  }
+  (*job)->AddRepetition(repetition, result);
+}
+
+// The lockstep lanes for N repetitions: at most lockstep_lanes, and
+// unless lockstep_every_thread is false, few enough to leave a job for
+// every thread.
+//
+static int32 LockstepLanes(int32 N) {
+  if (!lockstep_every_thread) return lockstep_lanes;
+  int32 lanes = N / omp_get_max_threads();
+  return max(1, min(lockstep_lanes, lanes));
+}
+
+// Set up result for repetitions of config, returning how many
+// neurons to actually train and test.
+//
+static int32 PrepareConfiguration(int32 repetitions, const TrainConfig& config,
+                                  NeuronStatistics* result) {
   int32 N = repetitions;
 
   result->Clear();
   result->mutable_config()->CopyFrom(config);
+  NeuronStatisticsSetMaxValues(statistic_max_values, result);
 
   // Ensure that we try to learn at least 10,000 words in aggregate
   if (N * result->config().w() < 10000) {
@@ -402,10 +841,307 @@ void RunConfiguration(int32 repetitions,
   // printf("N = %d, num_test_words = %d\n",
   //        N, result->config().num_test_words());
   // fflush(stdout);
-  vector<Job*> jobs(N);
-  for (int32 i = 0; i < N; ++i) {
-    jobs[i] = new JobRunConfiguration(result->mutable_config(), result);
+  return N;
+}
+
+// Add to jobs the repetitions of result's configuration still to be
+// run to make N.  Without a result cache each job adds its repetition
+// to result.  With one, repetitions[j] is set to repetition j, either
+// from the cache or by a job, for FinishRepetitions().
+//
+static void AddRepetitionJobs(int32 N, NeuronStatistics* result,
+                              vector<NeuronStatistics>* repetitions,
+                              vector<Job*>* jobs) {
+  TrainConfig* config = result->mutable_config();
+  int32 lanes = LockstepLanes(N);
+  JobRunConfiguration* job = NULL;
+  const ResultCache::Entry* cached =
+      (result_cache == NULL ? NULL : result_cache->Find(*config));
+  if (cached == NULL) {
+    repetitions->clear();
+    for (int32 j = 0; j < N; ++j) {
+      NeuronStatistics* destination = result;
+      if (result_cache != NULL) {
+        repetitions->resize(N);
+        destination = &(*repetitions)[j];
+      }
+      AddRepetitionJob(config, j, lanes, result_cache, destination, jobs,
+                       &job);
+    }
+    return;
+  }
+
+  // Only repetitions below N are used, cached or else run, so that the
+  // result is the same as without a cache.  The repetitions recorded
+  // without numbers come first, and are used together or not at all.
+  //
+  int32 first = 0;
+  if (cached->unnumbered_count <= N) {
+    first = cached->unnumbered_count;
+    *result += cached->unnumbered;
+  }
+  repetitions->clear();
+  repetitions->resize(N - first);
+  for (int32 j = first; j < N; ++j) {
+    NeuronStatistics* repetition = &(*repetitions)[j - first];
+    map<int32, NeuronStatistics>::const_iterator it = cached->numbered.find(j);
+    if (it != cached->numbered.end()) {
+      repetition->CopyFrom(it->second);
+    } else {
+      AddRepetitionJob(config, j, lanes, result_cache, repetition, jobs,
+                       &job);
+    }
+  }
+}
+
+static bool shared_test_corpus = false;
+
+void SetSharedTestCorpus(bool enabled) {
+  shared_test_corpus = enabled;
+}
+
+// With a shared test corpus, generate the test words for config's
+// uniformly sampled false positives, adding the corpus to corpora, to
+// be deleted once the jobs using it have run; otherwise return NULL.
+// The corpus takes its expected size from budget, the bytes left for
+// the corpora held at once; when it would not fit, the jobs draw their
+// own test words instead.
+//
+static TestCorpus* MakeTestCorpus(const TrainConfig& config,
+                                  vector<TestCorpus*>* corpora,
+                                  int64* budget) {
+  int32 estimator = (config.has_false_positive_estimator()
+                     ? config.false_positive_estimator()
+                     : TrainConfig::UNIFORM_SAMPLING);
+  if (!shared_test_corpus
+      || (estimator != TrainConfig::UNIFORM_SAMPLING
+          && estimator != TrainConfig::EXACT_CROSS_CHECK)) {
+    return NULL;
+  }
+
+  // The words are configured as TrainExperiment() configures the
+  // training words
+  //
+  Neuron neuron;
+  neuron.Init(config.config());
+  Wordset words;
+  if (config.has_num_active()) {
+    words.ConfigFixed(0, neuron.length(),
+                      config.config().d1(), config.num_active());
+  } else {
+    words.Config(0, neuron.length(),
+                 config.config().d1(), config.config().r());
+  }
+  double active = neuron.length() / static_cast<double>(config.config().r());
+  if (config.has_num_active()) active = config.num_active();
+  int64 bytes = static_cast<int64>(
+      config.num_test_words()
+      * (active * sizeof(Word::value_type) + sizeof(int32)));
+  if (*budget < bytes) return NULL;
+  *budget -= bytes;
+
+  // When seeded, the corpus is repeatable as the repetitions are
+  // (see SeedRepetition()), and common to every configuration with
+  // common random numbers
+  //
+  uint32 seed;
+  if (random_seed < 0) {
+    RandomBase random;
+    seed = random.Rand32();
+  } else {
+    string key;
+    OutputArchive out(&key);
+    out & random_seed;
+    if (!common_random_numbers) out & config;
+    int32 phase = TEST_PHASE;
+    out & phase;
+    seed = Checksum(key.data(), key.size());
+  }
+
+  TestCorpus* corpus = new TestCorpus;
+  corpus->Init(config.num_test_words(), words, seed);
+  corpora->push_back(corpus);
+  return corpus;
+}
+
+// Give the repetition jobs from first on config's shared test corpus,
+// if any (see MakeTestCorpus())
+//
+static void ShareTestCorpus(const TrainConfig& config, int32 first,
+                            vector<Job*>* jobs,
+                            vector<TestCorpus*>* corpora, int64* budget) {
+  if (jobs->size() == first) return;
+  const TestCorpus* corpus = MakeTestCorpus(config, corpora, budget);
+  for (int32 i = first; i < jobs->size(); ++i) {
+    static_cast<JobRunConfiguration*>((*jobs)[i])->set_test_corpus(corpus);
+  }
+}
+
+// Add the repetitions from AddRepetitionJobs() to result in order, so
+// that the result is the same however many of them were cached.
+//
+static void FinishRepetitions(const vector<NeuronStatistics>& repetitions,
+                              NeuronStatistics* result) {
+  for (int32 j = 0; j < repetitions.size(); ++j) {
+    (*result) += repetitions[j];
+  }
+}
+
+void RunConfiguration(int32 repetitions,
+                      const TrainConfig& config, NeuronStatistics* result) {
+  int32 N = PrepareConfiguration(repetitions, config, result);
+  vector<NeuronStatistics> cached;
+  vector<Job*> jobs;
+  vector<TestCorpus*> corpora;
+  AddRepetitionJobs(N, result, &cached, &jobs);
+  int64 budget = kMaxTestCorpusBytes;
+  ShareTestCorpus(result->config(), 0, &jobs, &corpora, &budget);
+  RunParallel(&jobs);
+  for (int32 i = 0; i < corpora.size(); ++i) delete corpora[i];
+  FinishRepetitions(cached, result);
+}
+
+// The first of the N repetitions j of the configuration numbered row
+// with (row + j) % num_shards == shard; the others follow every
+// num_shards.
+//
+static int32 FirstShardRepetition(int32 row, int32 shard, int32 num_shards) {
+  CHECK(0 <= row && 0 <= shard && shard < num_shards);
+  return (shard - row % num_shards + num_shards) % num_shards;
+}
+
+void RunConfigurationShard(int32 repetitions, const TrainConfig& config,
+                           int32 row, int32 shard, int32 num_shards,
+                           NeuronStatistics* result) {
+  int32 N = PrepareConfiguration(repetitions, config, result);
+
+  int32 lanes = LockstepLanes((N + num_shards - 1) / num_shards);
+  JobRunConfiguration* job = NULL;
+  vector<Job*> jobs;
+  vector<TestCorpus*> corpora;
+  for (int32 j = FirstShardRepetition(row, shard, num_shards); j < N;
+       j += num_shards) {
+    AddRepetitionJob(result->mutable_config(), j, lanes, NULL, result,
+                     &jobs, &job);
+  }
+  int64 budget = kMaxTestCorpusBytes;
+  ShareTestCorpus(result->config(), 0, &jobs, &corpora, &budget);
+  RunParallel(&jobs);
+  for (int32 i = 0; i < corpora.size(); ++i) delete corpora[i];
+}
+
+void RunConfigurations(int32 repetitions, double fidelity,
+                       const vector<TrainConfig>& configs,
+                       vector<NeuronStatistics>* results) {
+  vector<double> fidelities(configs.size(), fidelity);
+  RunConfigurations(repetitions, fidelities, configs, results);
+}
+
+void RunConfigurations(int32 repetitions, const vector<double>& fidelities,
+                       const vector<TrainConfig>& configs,
+                       vector<NeuronStatistics>* results) {
+  const int32 kMinTestWords = 100;
+
+  CHECK(fidelities.size() == configs.size());
+  results->resize(configs.size());
+  vector<vector<NeuronStatistics> > cached(configs.size());
+  vector<Job*> jobs;
+  vector<TestCorpus*> corpora;
+  int64 budget = kMaxTestCorpusBytes;
+  for (int32 c = 0; c < configs.size(); ++c) {
+    double fidelity = fidelities[c];
+    CHECK(0.0 < fidelity && fidelity <= 1.0);
+    NeuronStatistics* result = &(*results)[c];
+    int32 N = PrepareConfiguration(repetitions, configs[c], result);
+    if (fidelity < 1.0) {
+      N = static_cast<int32>(ceil(N * fidelity));
+      int32 num_test_words = static_cast<int32>(
+          ceil(result->config().num_test_words() * fidelity));
+      if (num_test_words < kMinTestWords) num_test_words = kMinTestWords;
+      result->mutable_config()->set_num_test_words(num_test_words);
+    }
+    int32 first = jobs.size();
+    AddRepetitionJobs(N, result, &cached[c], &jobs);
+    ShareTestCorpus(result->config(), first, &jobs, &corpora, &budget);
+  }
+  RunParallel(&jobs);
+  for (int32 i = 0; i < corpora.size(); ++i) delete corpora[i];
+
+  for (int32 c = 0; c < configs.size(); ++c) {
+    FinishRepetitions(cached[c], &(*results)[c]);
+  }
+}
+
+class JobRunThresholdConfiguration : public Job {
+ public:
+  JobRunThresholdConfiguration(TrainConfig* config, int32 repetition,
+                               const vector<double>* thresholds,
+                               vector<NeuronStatistics>* results)
+      : config_(config), repetition_(repetition), thresholds_(thresholds),
+        results_(results), corpus_(NULL), temp_() { }
+  ~JobRunThresholdConfiguration() {
+    for (int32 t = 0; t < temp_.size(); ++t) {
+      (*results_)[t] += temp_[t];
+    }
+  }
+
+  // Test on corpus (see Bob::set_test_corpus()), which must outlive Run()
+  void set_test_corpus(const TestCorpus* corpus) { corpus_ = corpus; }
+
+  virtual void Run() {
+    ExperimentContext* context = ThreadExperimentContext(0);
+    SeedRepetition(*config_, repetition_, context);
+    context->bob.set_test_corpus(corpus_);
+    RunThresholdExperiment(*config_, *thresholds_, &temp_);
+    context->bob.set_test_corpus(NULL);
+  }
+ private:
+  TrainConfig* config_;
+  int32 repetition_;
+  const vector<double>* thresholds_;
+  vector<NeuronStatistics>* results_;
+  const TestCorpus* corpus_;
+  vector<NeuronStatistics> temp_;
+};
+
+void RunThresholdConfiguration(int32 repetitions, const TrainConfig& config,
+                               const vector<double>& thresholds,
+                               vector<NeuronStatistics>* results) {
+  RunThresholdConfigurationShard(repetitions, config, thresholds, 0, 0, 1,
+                                 results);
+}
+
+void RunThresholdConfigurationShard(int32 repetitions,
+                                    const TrainConfig& config,
+                                    const vector<double>& thresholds,
+                                    int32 row, int32 shard, int32 num_shards,
+                                    vector<NeuronStatistics>* results) {
+  NeuronStatistics prepared;
+  int32 N = PrepareConfiguration(repetitions, config, &prepared);
+
+  results->resize(thresholds.size());
+  for (int32 t = 0; t < thresholds.size(); ++t) {
+    (*results)[t].CopyFrom(prepared);
+    (*results)[t].mutable_config()->mutable_config()->set_h_m(thresholds[t]);
+  }
+
+  vector<Job*> jobs;
+  vector<TestCorpus*> corpora;
+  int64 budget = kMaxTestCorpusBytes;
+  for (int32 j = FirstShardRepetition(row, shard, num_shards); j < N;
+       j += num_shards) {
+    jobs.push_back(new JobRunThresholdConfiguration(prepared.mutable_config(),
+                                                    j, &thresholds, results));
+  }
+  const TestCorpus* corpus = NULL;
+  if (!jobs.empty()) {
+    corpus = MakeTestCorpus(prepared.config(), &corpora, &budget);
+  }
+  for (int32 i = 0; i < jobs.size(); ++i) {
+    static_cast<JobRunThresholdConfiguration*>(jobs[i])
+        ->set_test_corpus(corpus);
   }
   RunParallel(&jobs);
+  for (int32 i = 0; i < corpora.size(); ++i) delete corpora[i];
 }
 }  // namespace cognon
@@ -116,22 +116,19 @@ double Stddev(const Statistic& stat);
 
 // Summation creates the union of the two statistical sample sets.
 // The internal values are summed, e.g. result.count = a.count + b.count,
-// and the sample values are concatenated.
+// and the sample values are concatenated, or resampled when either
+// keeps at most max_values.
 //
 Statistic operator+(const Statistic& a, const Statistic& b);
 Statistic& operator+=(Statistic& a, const Statistic& b);
 
-// Add a new sample value to the statistic sample set in the bucket.
-void AddSample(int32 bucket, double v, Histogram* stat);
-
-// Given a vector of values, add each value to the statistic sample
-// set in the appropriate bucket in the histogram.
+// Add a histogram of values to the histogram, in one pass over the
+// data.  Buckets beyond the end of either count as zeros.
 //
 void SetHistogram(const vector<int32>& data, Histogram* result);
 
 // Summation of histograms operates on a per-bucket basis.
-// It creates the Statistic summation (see above) for the
-// samples in each bucket.
+// It adds the per-bucket sums, treating missing buckets as zeros.
 //
 Histogram operator+(const Histogram& a, const Histogram& b);
 Histogram& operator+=(Histogram& a, const Histogram& b);
@@ -152,16 +149,131 @@ void StatisticStripValues(Statistic* stats);
 void HistogramStripValues(Histogram* stats);
 void NeuronStatisticsStripValues(NeuronStatistics* stats);
 
+// Make each Statistic (but not the histograms) in stats keep a sample
+// of at most max_values of its values, or all of them if max_values is
+// negative (see Statistic::max_values()).
+//
+void NeuronStatisticsSetMaxValues(int32 max_values, NeuronStatistics* stats);
+
+// Set the max_values of the results of RunConfiguration() and the
+// functions like it.  The default, zero, keeps only the moments, so
+// that results take the same memory and merge in the same time however
+// many repetitions they hold.
+//
+void SetStatisticMaxValues(int32 max_values);
+
 // Needed to create a set<> of TrainConfig configurations
 bool operator<(const TrainConfig&a, const TrainConfig& b);
 
-// Train and test a single neuron using the given configuration
+// Train and test a single neuron using the given configuration.  Each
+// thread reuses one neuron, wordset and set of scratch buffers for all
+// of its experiments, rather than allocating them for each one.
+//
 void RunExperiment(const TrainConfig& config, NeuronStatistics* result);
 
 // Train and test repetitions neurons using the given configuration
 void RunConfiguration(int32 repetitions,
                       const TrainConfig& config, NeuronStatistics* result);
 
+// As RunConfiguration(), but run only one shard of the repetitions, so
+// that num_shards processes can split a sweep between them and add up
+// their results afterwards.  Repetition j of the configuration numbered
+// row runs in shard (row + j) % num_shards, which spreads the
+// repetitions of consecutive rows evenly over the shards.  Shards do
+// not use the result cache.
+//
+void RunConfigurationShard(int32 repetitions, const TrainConfig& config,
+                           int32 row, int32 shard, int32 num_shards,
+                           NeuronStatistics* result);
+
+class ResultCache;
+
+// Make RunConfiguration() and RunConfigurations() start from the
+// repetitions cached for each configuration, run only the ones still
+// missing, and add each of those to the cache as soon as it finishes,
+// so that an interrupted run can be resumed from the cache.  Cached
+// repetitions beyond the ones asked for are left out.  NULL (the
+// default) disables caching.  The caller retains ownership of cache.
+//
+void SetResultCache(ResultCache* cache);
+
+// Seed the random numbers of each repetition from seed, the
+// configuration, and the repetition's number, so that a run gives the
+// same results however its repetitions are scheduled or resumed from
+// the result cache.  A negative seed (the default) leaves the random
+// numbers unseeded.
+//
+void SetRandomSeed(int32 seed);
+
+// Drive every configuration from common random numbers: when seeded,
+// each repetition draws its synapse delays and containers, its training
+// words and its test words from three streams that depend only on the
+// seed and the repetition's number.  Configurations of the same shape
+// then get the same neurons, and those differing only in w share their
+// first training words, so the points of a sweep differ by less Monte
+// Carlo noise than independent repetitions would give.
+//
+void SetCommonRandomNumbers(bool enabled);
+
+// Generate the uniformly sampled test words of each configuration once,
+// in parallel, and share them read-only among all its repetitions (see
+// TestCorpus), each skipping the words in its own training set, rather
+// than have every repetition generate its own.  When seeded, the words
+// are repeatable, and with common random numbers the same for every
+// configuration of the same shape.  Every configuration run together
+// by RunConfigurations() holds its corpus in memory until they finish,
+// so the corpora are limited to kMaxTestCorpusBytes in all: once that
+// is reached, or for a neuron too big for it, the repetitions draw
+// their own test words.
+//
+const int64 kMaxTestCorpusBytes = 1LL << 30;
+void SetSharedTestCorpus(bool enabled);
+
+// Run up to lanes repetitions of a configuration at a time in lockstep
+// (see NeuronLanes), each training its own neuron and then all being
+// tested together.  Lockstep only applies to uniformly sampled false
+// positives.  Unless every_thread is false, fewer lanes are used where
+// that leaves each thread a group of repetitions to run; a row of 10
+// repetitions then runs one at a time on more than 5 threads.  One
+// lane (the default) runs the repetitions one at a time.
+//
+const int32 kMaxLockstepLanes = 16;
+void SetLockstepLanes(int32 lanes, bool every_thread = true);
+
+// Run RunConfiguration() on each of configs, with all of their neurons
+// trained and tested in parallel together.  A fidelity below one runs
+// that fraction of the repetitions (at least one) and of the test words
+// per neuron, for cheaper but noisier results.
+//
+void RunConfigurations(int32 repetitions, double fidelity,
+                       const vector<TrainConfig>& configs,
+                       vector<NeuronStatistics>* results);
+
+// As above, but configs[i] runs at fidelities[i]
+void RunConfigurations(int32 repetitions, const vector<double>& fidelities,
+                       const vector<TrainConfig>& configs,
+                       vector<NeuronStatistics>* results);
+
+// As RunExperiment() and RunConfiguration(), but test each trained
+// neuron at every synapse-strength threshold (H_m) in thresholds from
+// a single pass over its words, giving one result per threshold.
+//
+void RunThresholdExperiment(const TrainConfig& config,
+                            const vector<double>& thresholds,
+                            vector<NeuronStatistics>* results);
+void RunThresholdConfiguration(int32 repetitions, const TrainConfig& config,
+                               const vector<double>& thresholds,
+                               vector<NeuronStatistics>* results);
+
+// As RunThresholdConfiguration(), but run only one shard of the
+// repetitions (see RunConfigurationShard())
+//
+void RunThresholdConfigurationShard(int32 repetitions,
+                                    const TrainConfig& config,
+                                    const vector<double>& thresholds,
+                                    int32 row, int32 shard, int32 num_shards,
+                                    vector<NeuronStatistics>* results);
+
 }  // namespace cognon
 
 #endif  // COGNON_COGNON_H_
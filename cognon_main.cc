@@ -26,6 +26,51 @@
 //
 //    "H","S","C","D1","D2","G_max","G_step"
 //
+// Options:
+//
+//    -c      Optimize the configurations (see above).
+//    -s      Optimize by successive halving instead of the grid walk.
+//    -p      Screen each C=D1=D2=1 candidate of an optimization with
+//            the analytic model (see cognon_stats.h), skipping the
+//            simulation of those it predicts to be hopeless.
+//    -r FILE Cache results in FILE, reusing any repetitions already
+//            there for the same configuration.  Each repetition is
+//            added as soon as it finishes, so rerunning an interrupted
+//            sweep with the same options resumes it.
+//    -R SEED Seed every repetition's random numbers from SEED, so that
+//            a sweep's results are repeatable, and use the cached
+//            results recorded with SEED (default unseeded).
+//    -C      Draw each repetition's neuron, training words and test
+//            words from the same random numbers in every configuration
+//            (see SetCommonRandomNumbers()), so that the points of a
+//            sweep are compared with less noise.  Needs -R, and cannot
+//            be used with -r.
+//    -t      Test all the H_m values of a row on the same trained
+//            neurons, in one pass (see PrintTableRows()), instead of
+//            training separate neurons for each.  The rows are then
+//            correlated rather than independent.
+//    -T      Generate each configuration's test words once and share
+//            them among its repetitions (see SetSharedTestCorpus()),
+//            which is faster for small neurons.  Past 1 GB of shared
+//            words at once, repetitions draw their own.  Cannot be used
+//            with -r.
+//    -L N    Run up to N (at most 16) repetitions of a configuration in
+//            lockstep on each thread, which is faster for small neurons.
+//    -S I/N  Run shard I of N of every row's repetitions, writing the
+//            partial rows to the file given by -o instead of printing
+//            them.  Run shards 0 through N-1 as separate processes.
+//    -o FILE The shard output file for -S.
+//    -m      Merge: the arguments are the -o files of every shard of a
+//            sweep, whose rows are added up and printed as the
+//            unsharded sweep would have printed them.
+//    -e N    Estimate the false positive probability with estimator N:
+//            0 = uniform sampling (default), 1 = importance sampling,
+//            2 = computed from the trained synapses, 3 = computed and
+//            cross-checked against uniform sampling.
+//    -f      Follow each row with the fraction of its uniformly sampled
+//            test words rejected without summing any slot (see
+//            SetPrintFastRejections()).
+//
 // A value of -1 means "unspecified".
 // A numeric value means that single value.
 // A string value with a list of values, e.g. "10,20,30", means
@@ -33,6 +78,7 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <fstream>      // fstream
 #include <iostream>     // cout, endl
@@ -46,8 +92,10 @@ using namespace std;
 #include <boost/tokenizer.hpp>
 using namespace boost;
 
+#include "archive.h"
 #include "cognon.h"
 #include "monograph.h"
+#include "result_cache.h"
 using namespace cognon;
 
 typedef tokenizer< escaped_list_separator<char> > Tokenizer;
@@ -89,6 +137,9 @@ void ParseDouble(string s, vector<double>* values) {
   }
 }
 
+// Whether ParseFile() tests a row's H_m values on shared neurons
+static bool share_thresholds = false;
+
 void ParseFile(const char* fname) {
   ifstream in(fname);
   if (!in.is_open()) return;
@@ -143,26 +194,36 @@ void ParseFile(const char* fname) {
 		for (int32 q = 0; q < Q.size(); ++q) {
 		  for (int32 r = 0; r < R.size(); ++r) {
 		    for (int32 g_m = 0; g_m < 1 || g_m < G_m.size(); ++g_m) {
+                      // The Q of each S, or Q itself
+                      vector<double> q_list;
+                      for (int32 s = 0; s < S.size(); s++) {
+                        if (Q[q] <= 0.0 && 0 < S[s]) {
+                          double q_ = (S[s] + kEpsilon);
+                          q_ /= (C[c] * H[h] * R[r]);
+                          q_list.push_back(q_);
+                        } else if (0.0 < Q[q] && S[s] <= 0) {
+                          q_list.push_back(Q[q]);
+                        } else {
+                          printf("Specify either Q or S, and the other as -1\n");
+                          exit(1);
+                        }
+                      }
+                      if (share_thresholds) {
+                        vector<double> thresholds(H_m);
+                        if (thresholds.size() == 0) thresholds.push_back(-1.0);
+                        PrintTableRows(W[w], num_active[a], C[c],
+                                       D1[d1], D2[d2], H[h], q_list, R[r],
+                                       (G_m.size() == 0 ? -1.0 : G_m[g_m]),
+                                       thresholds);
+                        continue;
+                      }
 		      for (int32 h_m = 0; h_m < 1 || h_m < H_m.size(); ++h_m) {
-                        for (int32 s = 0; s < S.size(); s++) {
-                          if (Q[q] <= 0.0 && 0 < S[s]) {
-                            double q_ = (S[s] + kEpsilon);
-                            q_ /= (C[c] * H[h] * R[r]);
-                            PrintTableRow(W[w], num_active[a], C[c],
-                                          D1[d1], D2[d2],
-                                          H[h], q_, R[r],
-                                          (G_m.size() == 0 ? -1.0 : G_m[g_m]),
-                                          (H_m.size() == 0 ? -1.0 : H_m[h_m]));
-                          } else if (0.0 < Q[q] && S[s] <= 0) {
-                            PrintTableRow(W[w], num_active[a], C[c],
-                                          D1[d1], D2[d2],
-                                          H[h], Q[q], R[r],
-                                          (G_m.size() == 0 ? -1.0 : G_m[g_m]),
-                                          (H_m.size() == 0 ? -1.0 : H_m[h_m]));
-                          } else {
-                            printf("Specify either Q or S, and the other as -1\n");
-                            exit(1);
-                          }
+                        for (int32 s = 0; s < q_list.size(); s++) {
+                          PrintTableRow(W[w], num_active[a], C[c],
+                                        D1[d1], D2[d2],
+                                        H[h], q_list[s], R[r],
+                                        (G_m.size() == 0 ? -1.0 : G_m[g_m]),
+                                        (H_m.size() == 0 ? -1.0 : H_m[h_m]));
                         }
 		      }
 		    }
@@ -240,13 +301,84 @@ void ParseOptimal(const char* fname) {
 int main(int argc, char* argv[]) {
   bool optimize = false;
   ::scoped_ptr<RandomBase> r(cognon::CreateRandom());
+  const char* cache_filename = NULL;
+  int32 cache_seed = 0;
+  int32 lanes = 1;
+  int32 shard = -1;
+  int32 num_shards = 0;
+  const char* shard_filename = NULL;
+  bool merge = false;
+  bool common = false;
+  bool shared = false;
+  bool seeded = false;
 
   int c;
-  while((c = getopt(argc, argv, "c")) != EOF) {
+  while((c = getopt(argc, argv, "cCe:fL:mo:pr:R:sS:tT")) != EOF) {
     switch (c) {
     case 'c':
       optimize = true;
       break;
+    case 'C':
+      common = true;
+      break;
+    case 'f':
+      SetPrintFastRejections(true);
+      break;
+    case 'L':
+      lanes = atoi(optarg);
+      if (lanes < 1 || kMaxLockstepLanes < lanes) {
+        fprintf(stderr, "Bad lanes %s, expected 1 to %d\n",
+                optarg, kMaxLockstepLanes);
+        exit(1);
+      }
+      SetLockstepLanes(lanes);
+      break;
+    case 'm':
+      merge = true;
+      break;
+    case 'o':
+      shard_filename = optarg;
+      break;
+    case 'p':
+      SetSurrogate(true);
+      break;
+    case 'S':
+      if (sscanf(optarg, "%d/%d", &shard, &num_shards) != 2
+          || shard < 0 || num_shards <= shard) {
+        fprintf(stderr, "Bad shard %s, expected I/N with 0 <= I < N\n",
+                optarg);
+        exit(1);
+      }
+      break;
+    case 'e': {
+      int32 estimator = atoi(optarg);
+      if (optarg[0] == '\0' || estimator < TrainConfig::UNIFORM_SAMPLING
+          || TrainConfig::EXACT_CROSS_CHECK < estimator
+          || optarg[strspn(optarg, "0123456789")] != '\0') {
+        fprintf(stderr, "Bad estimator %s, expected %d to %d\n", optarg,
+                TrainConfig::UNIFORM_SAMPLING, TrainConfig::EXACT_CROSS_CHECK);
+        exit(1);
+      }
+      SetFalsePositiveEstimator(estimator);
+      break;
+    }
+    case 'r':
+      cache_filename = optarg;
+      break;
+    case 'R':
+      cache_seed = atoi(optarg);
+      SetRandomSeed(cache_seed);
+      seeded = true;
+      break;
+    case 's':
+      SetSearchAlgorithm(SUCCESSIVE_HALVING);
+      break;
+    case 't':
+      share_thresholds = true;
+      break;
+    case 'T':
+      shared = true;
+      break;
     default:
       fprintf(stderr, "Unknown option %c\n", c);
       exit(1);
@@ -254,6 +386,48 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  if (merge) {
+    vector<string> filenames(argv + optind, argv + argc);
+    return (MergeTableShards(filenames) ? 0 : 1);
+  }
+
+  if (common) {
+    if (!seeded || cache_seed < 0 || cache_filename != NULL) {
+      fprintf(stderr, "-C needs -R, and cannot be used with -r\n");
+      exit(1);
+    }
+    SetCommonRandomNumbers(true);
+  }
+  if (shared) {
+    if (cache_filename != NULL) {
+      fprintf(stderr, "-T cannot be used with -r\n");
+      exit(1);
+    }
+    SetSharedTestCorpus(true);
+  }
+
+  RecordWriter shard_output;
+  if (0 <= shard) {
+    if (shard_filename == NULL || optimize || cache_filename != NULL) {
+      fprintf(stderr, "-S needs -o, and cannot be used with -c or -r\n");
+      exit(1);
+    }
+    if (!shard_output.Open(shard_filename, 0)) {
+      fprintf(stderr, "Cannot write shard %s\n", shard_filename);
+      exit(1);
+    }
+    SetTableShard(shard, num_shards, &shard_output);
+  }
+
+  ResultCache cache;
+  if (cache_filename != NULL) {
+    if (!cache.Open(cache_filename, cache_seed)) {
+      fprintf(stderr, "Cannot open result cache %s\n", cache_filename);
+      exit(1);
+    }
+    SetResultCache(&cache);
+  }
+
   // Any remaining arguments are the input filenames (or patterns);
   // Parse them to generate the various configurations that will be run.
   for (int i = optind; i < argc; i++) {
@@ -15,53 +15,61 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-// Numerical analysis of various aspects of Cognon performance.  It outputs
-// data in the form of Mathematica input.
-//
+
+#include "cognon_stats.h"
 
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
+#include <omp.h>
 
-const double kEpsilon = 1.0e-6;
-const double kFraction = 1.0;
+#include <map>
 
-double lchoose(double n, double k);
-double lbinomial(double n, double k, double p);
-double L(double prob_learn, double prob_false_positive, int w);
-double prob_fire(int nSynapses, int nStrongSynapses, double rate,
-                 double G, double H);
-double prob_false_positive(int nSynapses, int nStrongSynapses, double rate,
-                           double G, double H, int w);
-double** prob_strengthen_synapses(int nSynapses,
-                                  double rate, double G, double H, int w);
-double* expected_strengthen_synapses(int nSynapses,
-                                     double rate, double G, double H, int w);
-void generate_strengthen_synapses(int nSynapses,
-                                  double rate, double G, double H, int W);
-void generate_false_positive(int nSynapses,
-                             double rate, double G, double H, int W);
-double mean(int n, double* v);
-double** malloc2D(int n, int m);
-void free2D(int n, int m, double** ptr);
-
-double lchoose(double n, double k) {
+namespace cognon {
+
+// Binomial terms below this are dropped, so that each word step only
+// spans the bulk of the distributions.  At most nSynapses + 1 terms are
+// dropped from any one distribution, which bounds the mass lost per
+// word by (nSynapses + 1) * kTail before each step is renormalized.
+//
+static const double kTail = 1.0e-16;
+
+// Binomial(n, rate) for every n up to nSynapses, each truncated to its
+// terms of at least kTail (see binomial_band()): pmf[n][k - first[n]]
+// for first[n] <= k < first[n] + count[n], and the prefix sums
+// cdf[n][i] of the first i of those terms.
+//
+struct BinomialTable {
+  int nSynapses;
+  double rate;
+  int* first;
+  int* count;
+  double** pmf;
+  double** cdf;
+  BinomialTable* next;
+};
+
+static int binomial_band(int n, double p, double* pmf, int* pmf_count);
+static const BinomialTable* binomial_table(int nSynapses, double rate);
+static void free_binomial_table(BinomialTable* table);
+static double binomial_at_least(const BinomialTable* table, int n, int x);
+static double mean(int n, double* v);
+
+static double lchoose(double n, double k) {
   assert(0.0 <= k && k <= n && !isnan(n) && !isnan(k));
 
   return lgamma(n + 1) - lgamma(n - k + 1) - lgamma(k + 1);
 }
 
-double lbinomial(double n, double k, double p) {
+static double lbinomial(double n, double k, double p) {
   assert(!isnan(p) && !isnan(n) && !isnan(k));
   assert(0.0 <= k && k <= n && 0.0 <= p && p <= 1.0);
 
   return (lchoose(n, k) + k * log(p) + (n - k) * log(1.0 - p));
 }
 
-double L(double prob_learn, double prob_false_positive, int w) {
+static double L(double prob_learn, double prob_false_positive, int w) {
   assert(!isnan(prob_learn) && !isnan(prob_false_positive));
   assert(0.0 <= prob_learn && prob_learn <= 1.0);
   assert(0.0 <= prob_false_positive && prob_false_positive <= 1.0);
@@ -78,38 +86,27 @@ double L(double prob_learn, double prob_false_positive, int w) {
                                             - log(prob_false_positive))));
 }
 
+// Sums over the active strengthened synapses i the probability that
+// enough of the original synapses are active to reach H with them, a
+// lookup in the binomial table's CDF.
+//
 double prob_fire(int nSynapses, int nStrongSynapses, double rate,
                  double G, double H) {
+  const BinomialTable* table = binomial_table(nSynapses, rate);
+  int nWeak = nSynapses - nStrongSynapses;
+  int first = table->first[nStrongSynapses];
+  const double* pmf = table->pmf[nStrongSynapses];
   double result = 0.0;
-  double synapse_rate = nStrongSynapses / (double)nSynapses;
-  double* probs = (double*)malloc((nSynapses - nStrongSynapses + 1) * sizeof(double));
-
-  {
-    double sum = 0.0;
-    for (int i = 0; i <= nSynapses - nStrongSynapses; ++i) {
-      probs[i] = exp(lbinomial(nSynapses - nStrongSynapses, i, rate));
-      sum += probs[i];
-      assert(!isnan(probs[i]) && 0.0 <= probs[i] && probs[i] <= 1.0);
-    }
-    assert(!isnan(sum) && 0.0 <= sum && sum <= 1.0 + kEpsilon);
-  }
 
   // Iterate over input/active strengthened synapses
-  for (int i = 0; i <= nStrongSynapses; ++i) {
-    double sum = 0.0;
-    // Iterate over input/active original synapses
-    for (int j = 0; j <= nSynapses - nStrongSynapses; ++j) {
-      if (G * i + j + kEpsilon >= H) {
-        sum += probs[j];
-        assert(!isnan(sum) && 0.0 <= sum && sum <= 1.0 + kEpsilon);
-      }
-    }
+  for (int i = 0; i < table->count[nStrongSynapses]; ++i) {
+    double sum = binomial_at_least(table, nWeak,
+                                   (int)ceil(H - G * (first + i) - kEpsilon));
+    assert(!isnan(sum) && 0.0 <= sum && sum <= 1.0 + kEpsilon);
     if (1.0 < sum) sum = 1.0;
-    result += exp(lbinomial(nStrongSynapses, i, rate)) * sum;
+    result += pmf[i] * sum;
     assert(!isnan(result) && 0.0 <= result && result <= 1.0 + kEpsilon);
   }
-  assert(!isnan(result) && 0.0 <= result && result <= 1.0 + kEpsilon);
-  free(probs);
   if (1.0 < result) result = 1.0;
   return result;
 }
@@ -121,115 +118,266 @@ double prob_false_positive(int nSynapses, int nStrongSynapses, double rate,
   return (result < 0.0 ? 0.0 : result);
 }
 
-double** prob_strengthen_synapses(int nSynapses,
-                                  double rate, double G, double H, int w) {
-  double** result = malloc2D(w + 1, nSynapses + 1);
-  result[0][0] = 1.0;
-
-  double** prob = malloc2D(nSynapses + 1, nSynapses + 1);
-  for (int i = 0; i <= nSynapses; ++i) {
-    double sum = 0.0;
-    for (int j = 0; j <= i; ++j) {
-      prob[i][j] = exp(lbinomial(i, j, rate));
-      sum += prob[i][j];
-      assert(!isnan(prob[i][j]) && 0.0 <= prob[i][j] && prob[i][j] <= 1.0);
-    }
-    assert(1.0 - kEpsilon < sum && sum < 1.0 + kEpsilon);
+double* false_positives(int nSynapses, double rate, double G, double H,
+                        int w) {
+  double* result = (double*)malloc((nSynapses + 1) * sizeof(double));
+  binomial_table(nSynapses, rate);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int j = 0; j <= nSynapses; ++j) {
+    result[j] = prob_false_positive(nSynapses, j, rate, G, H, w);
   }
+  return result;
+}
 
-  // Iterate over words.
-  for (int i = 1; i <= w; ++i) {
-    // Iterate over number of previously strengthened synapses.
-    for (int j = 0; j <= nSynapses; ++j) {
-      // Iterate over input/active strengthened synapses.
-      for (int k = 0; k <= j; ++k) {
-        double weight = result[i - 1][j] * prob[j][k];
-        double* p = prob[nSynapses - j];
-        double sum_not_fired = 0.0;
-        double sum_fired = 0.0;
-
-        assert(!isnan(weight));
-
-        // Iterate over input/active original synapses.
-        // These synapses will be strengthened if the neuron fires.
-        //
-        for (int l = 0; l <= nSynapses - j; ++l) {
-          if (G * k + l + kEpsilon < H) {
-            sum_not_fired += p[l];
-          } else {
-            result[i][j + l] += weight * p[l];
-            sum_fired += p[l];
-          }
-        }
-        result[i][j] += weight * sum_not_fired;
-        assert(1.0 - kEpsilon <= sum_not_fired + sum_fired
-               && sum_not_fired + sum_fired <= 1.0 + kEpsilon);
+// Set pmf[k - first] to the terms of Binomial(n, p) that are at least
+// kTail, which lie in one range around the mode, and return first.
+// The number of terms is returned in pmf_count.
+//
+static int binomial_band(int n, double p, double* pmf, int* pmf_count) {
+  int mode = (int)floor((n + 1) * p);
+  if (n < mode) mode = n;
+  int first = mode;
+  int last = mode;
+  while (0 < first && kTail <= exp(lbinomial(n, first - 1, p))) --first;
+  while (last < n && kTail <= exp(lbinomial(n, last + 1, p))) ++last;
+  for (int k = first; k <= last; ++k) {
+    pmf[k - first] = exp(lbinomial(n, k, p));
+    assert(!isnan(pmf[k - first]) && 0.0 <= pmf[k - first]
+           && pmf[k - first] <= 1.0);
+  }
+  *pmf_count = last - first + 1;
+  return first;
+}
+
+// The tables built so far.  They are never freed, since callers keep
+// pointers into them, so the list holds one table for each (nSynapses,
+// rate) predicted during the run, about nSynapses times the width of
+// the binomial band in doubles apiece.
+//
+static BinomialTable* binomial_tables = NULL;
+
+// The table for nSynapses and rate, which is built on first use and
+// then shared by every later call
+//
+static const BinomialTable* binomial_table(int nSynapses, double rate) {
+  BinomialTable* table = NULL;
+#pragma omp critical(binomial_tables)
+  for (table = binomial_tables; table != NULL; table = table->next) {
+    if (table->nSynapses == nSynapses && table->rate == rate) break;
+  }
+  if (table != NULL) return table;
+
+  table = (BinomialTable*)malloc(sizeof(BinomialTable));
+  table->nSynapses = nSynapses;
+  table->rate = rate;
+  table->first = (int*)malloc((nSynapses + 1) * sizeof(int));
+  table->count = (int*)malloc((nSynapses + 1) * sizeof(int));
+  table->pmf = (double**)malloc((nSynapses + 1) * sizeof(double*));
+  table->cdf = (double**)malloc((nSynapses + 1) * sizeof(double*));
+#pragma omp parallel
+  {
+    double* pmf = (double*)malloc((nSynapses + 1) * sizeof(double));
+#pragma omp for schedule(dynamic, 64)
+    for (int n = 0; n <= nSynapses; ++n) {
+      int count;
+      table->first[n] = binomial_band(n, rate, pmf, &count);
+      table->count[n] = count;
+      table->pmf[n] = (double*)malloc(count * sizeof(double));
+      table->cdf[n] = (double*)malloc((count + 1) * sizeof(double));
+      table->cdf[n][0] = 0.0;
+      for (int i = 0; i < count; ++i) {
+        table->pmf[n][i] = pmf[i];
+        table->cdf[n][i + 1] = table->cdf[n][i] + pmf[i];
       }
     }
+    free(pmf);
+  }
 
-    // Adjust for rounding errors; re-normalize so sum == 1
-    double sum = 0.0;
-    for (int j = 0; j <= nSynapses; ++j) {
-      sum += result[i][j];
+  // Another thread may have built the same table meanwhile, in which
+  // case its table is kept and this one freed
+  //
+  BinomialTable* built = table;
+#pragma omp critical(binomial_tables)
+  {
+    for (table = binomial_tables; table != NULL; table = table->next) {
+      if (table->nSynapses == nSynapses && table->rate == rate) break;
     }
-    assert(!isnan(sum) && 0.0 <= sum && sum <= 1.001);
-    for (int j = 0; j <= nSynapses; ++j) {
-      result[i][j] /= sum;
+    if (table == NULL) {
+      table = built;
+      table->next = binomial_tables;
+      binomial_tables = table;
     }
   }
-  free2D(w + 1, nSynapses + 1, prob);
-  return result;
+  if (table != built) free_binomial_table(built);
+  return table;
 }
 
-double* expected_strengthen_synapses(int nSynapses,
-                                     double rate, double G, double H, int w) {
-  double** probs = prob_strengthen_synapses(nSynapses, rate, G, H, w);
-  double* result = (double*)malloc((w + 1) * sizeof(double));
-
-  for (int i = 0; i <= w; ++i) {
-    result[i] = mean(nSynapses + 1, probs[i]);
+static void free_binomial_table(BinomialTable* table) {
+  for (int n = 0; n <= table->nSynapses; ++n) {
+    free(table->pmf[n]);
+    free(table->cdf[n]);
   }
-  free2D(w + 1, nSynapses + 1, probs);
-  return result;
+  free(table->first);
+  free(table->count);
+  free(table->pmf);
+  free(table->cdf);
+  free(table);
 }
 
-void generate_strengthen_synapses(int nSynapses,
-                                  double rate, double G, double H, int W) {
-  double* expected = expected_strengthen_synapses(nSynapses, rate, G, H, W);
+// Pr[X >= x] for X ~ Binomial(n, rate), from the table's CDF
+static double binomial_at_least(const BinomialTable* table, int n, int x) {
+  int i = x - table->first[n];
+  if (i < 0) i = 0;
+  if (table->count[n] < i) i = table->count[n];
+  return table->cdf[n][table->count[n]] - table->cdf[n][i];
+}
 
-  printf("{");
-  for (int i = 0; i <= W; ++i) {
-    if (0 < i) printf(", ");
-    printf("{%d,%lf}", i, expected[i]);
+// The word step for nSynapses synapses firing at rate, with
+// strengthened synapses weighing G and a firing threshold of H.
+//
+// With j strengthened, k of them and l of the others active, the neuron
+// fires when G * k + l reaches H, i.e. when l reaches t(k) =
+// ceil(H - G * k).  So it stays put with probability
+//
+//   sum over k of Pr[k] * Pr[l < t(k)]
+//
+// from the CDF of Pr[l], and it strengthens l more with probability
+// Pr[l] * Pr[t(k) <= l], where t(k) <= l for all k from some k_min(l)
+// up, from the CDF of Pr[k].  Each j is independent of the others.
+//
+Transition* new_transition(int nSynapses, double rate, double G, double H) {
+  assert(0.0 <= G);
+
+  const BinomialTable* table = binomial_table(nSynapses, rate);
+  Transition* transition = (Transition*)malloc(sizeof(Transition));
+  transition->nSynapses = nSynapses;
+  transition->stay = (double*)malloc((nSynapses + 1) * sizeof(double));
+  transition->first = (int*)malloc((nSynapses + 1) * sizeof(int));
+  transition->count = (int*)malloc((nSynapses + 1) * sizeof(int));
+  transition->move = (double**)malloc((nSynapses + 1) * sizeof(double*));
+
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int j = 0; j <= nSynapses; ++j) {
+    // Active strengthened synapses, k in [k0, k0 + nk)
+    int k0 = table->first[j];
+    int nk = table->count[j];
+    const double* pmf_k = table->pmf[j];
+    const double* cdf_k = table->cdf[j];
+
+    // Active original synapses, l in [l0, l0 + nl)
+    int l0 = table->first[nSynapses - j];
+    int nl = table->count[nSynapses - j];
+    const double* pmf_l = table->pmf[nSynapses - j];
+    const double* cdf_l = table->cdf[nSynapses - j];
+
+    // Pr[l < t] over the band
+    double stay = 0.0;
+    for (int k = 0; k < nk; ++k) {
+      int t = (int)ceil(H - G * (k0 + k) - kEpsilon);
+      int below = t - l0;
+      if (below < 0) below = 0;
+      if (nl < below) below = nl;
+      stay += pmf_k[k] * cdf_l[below];
+    }
+    transition->stay[j] = stay;
+
+    // k_min(l) only falls as l rises
+    transition->first[j] = l0;
+    transition->count[j] = nl;
+    transition->move[j] = (double*)malloc(nl * sizeof(double));
+    int k_min = nk;
+    for (int l = 0; l < nl; ++l) {
+      while (0 < k_min
+             && (int)ceil(H - G * (k0 + k_min - 1) - kEpsilon) <= l0 + l) {
+        --k_min;
+      }
+      transition->move[j][l] = pmf_l[l] * (cdf_k[nk] - cdf_k[k_min]);
+    }
   }
-  printf("}");
-  fflush(stdout);
+  return transition;
+}
 
-  free(expected);
+void free_transition(Transition* transition) {
+  for (int j = 0; j <= transition->nSynapses; ++j) {
+    free(transition->move[j]);
+  }
+  free(transition->stay);
+  free(transition->first);
+  free(transition->count);
+  free(transition->move);
+  free(transition);
 }
 
-void generate_false_positive(int nSynapses,
-                             double rate, double G, double H, int W) {
-  // False probability
-  printf("{");
-  double** probs = prob_strengthen_synapses(nSynapses, rate, G, H, W);
-  for (int i = 1; i <= W; ++i) {
-    double sum = 0.0;
-    for (int j = 0; j <= nSynapses; ++j) {
-      sum += probs[i][j] * prob_false_positive(nSynapses, j, rate, G, G * H, W);
-      assert(!isnan(sum) && 0.0 <= sum && sum <= 1.0 + kEpsilon);
+void strengthen_step(const Transition* transition,
+                     const double* prev, double* next) {
+  int nSynapses = transition->nSynapses;
+  for (int j = 0; j <= nSynapses; ++j) {
+    next[j] = 0.0;
+  }
+  for (int j = 0; j <= nSynapses; ++j) {
+    double weight = prev[j];
+    if (weight == 0.0) continue;
+    assert(!isnan(weight));
+    next[j] += weight * transition->stay[j];
+    const double* move = transition->move[j];
+    double* to = next + j + transition->first[j];
+    for (int l = 0; l < transition->count[j]; ++l) {
+      to[l] += weight * move[l];
     }
-    if (1 < i) printf(", ");
-    printf("{%d,%lf}", i, sum);
-    fflush(stdout);
   }
-  printf("}");
-  fflush(stdout);
 
-  free2D(W + 1, nSynapses + 1, probs);
+  // Adjust for rounding errors and truncation; re-normalize so sum == 1
+  double sum = 0.0;
+  for (int j = 0; j <= nSynapses; ++j) {
+    sum += next[j];
+  }
+  assert(!isnan(sum) && 0.0 <= sum && sum <= 1.001);
+  for (int j = 0; j <= nSynapses; ++j) {
+    next[j] /= sum;
+  }
+}
+
+double* prob_strengthen_synapses(int nSynapses,
+                                 double rate, double G, double H, int w) {
+  double* prev = (double*)calloc(nSynapses + 1, sizeof(double));
+  double* next = (double*)calloc(nSynapses + 1, sizeof(double));
+  prev[0] = 1.0;
+
+  Transition* transition = new_transition(nSynapses, rate, G, H);
+  for (int i = 1; i <= w; ++i) {
+    strengthen_step(transition, prev, next);
+    double* swap = prev;
+    prev = next;
+    next = swap;
+  }
+  free_transition(transition);
+  free(next);
+  return prev;
 }
 
-double mean(int n, double* prob) {
+double* expected_strengthen_synapses(int nSynapses,
+                                     double rate, double G, double H, int w) {
+  double* prev = (double*)calloc(nSynapses + 1, sizeof(double));
+  double* next = (double*)calloc(nSynapses + 1, sizeof(double));
+  double* result = (double*)malloc((w + 1) * sizeof(double));
+  prev[0] = 1.0;
+  result[0] = 0.0;
+
+  Transition* transition = new_transition(nSynapses, rate, G, H);
+  for (int i = 1; i <= w; ++i) {
+    strengthen_step(transition, prev, next);
+    result[i] = mean(nSynapses, next);
+    double* swap = prev;
+    prev = next;
+    next = swap;
+  }
+  free_transition(transition);
+  free(prev);
+  free(next);
+  return result;
+}
+
+static double mean(int n, double* prob) {
   double result = 0.0;
   double prob_sum = 0.0;
 
@@ -243,149 +391,165 @@ double mean(int n, double* prob) {
   return result;
 }
 
-double** malloc2D(int n, int m) {
-  double** result = (double**)malloc(n * sizeof(double*));
-  for (int i = 0; i < n; ++i) {
-    result[i] = (double*)malloc(m * sizeof(double));
-    for (int j = 0; j < m; ++j) {
-      result[i][j] = 0.0;
+
+// The model's predictions for one neuron configuration after each
+// number of training words w so far.  The synapses of a word that
+// fires in training all end up strengthened, so it is learned if they
+// reach H_m at G: with j strengthened, k of those and l of the others
+// active, it fires when G * k + l reaches H and is learned when also
+// k + l reaches H_m / G.  A word that does not fire has fewer than H
+// active synapses, so with H_m at least G * H it never fires later.
+//
+struct Trajectory {
+  int nSynapses;
+  Transition* transition;
+  vector<double> fire;      // Pr[a random word fires after training | j]
+  vector<double> learn;     // Pr[a training word fires and is learned | j]
+  vector<double> prev;      // The distribution of j after w words
+  vector<double> next;
+
+  // Indexed by w
+  vector<double> learned;   // Expected words learned
+  vector<double> false_true;
+  vector<double> strengthened;
+};
+
+static Trajectory* new_trajectory(int nSynapses, double rate,
+                                  double G, double H, double H_m) {
+  const BinomialTable* table = binomial_table(nSynapses, rate);
+  Trajectory* t = new Trajectory;
+  t->nSynapses = nSynapses;
+  t->transition = new_transition(nSynapses, rate, G, H);
+  t->fire.resize(nSynapses + 1);
+  t->learn.resize(nSynapses + 1);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int j = 0; j <= nSynapses; ++j) {
+    t->fire[j] = prob_fire(nSynapses, j, rate, G, H_m);
+
+    int k0 = table->first[j];
+    const double* pmf_k = table->pmf[j];
+    double learn = 0.0;
+    for (int k = 0; k < table->count[j]; ++k) {
+      int fires = (int)ceil(H - G * (k0 + k) - kEpsilon);
+      int learns = (int)ceil(H_m / G - (k0 + k) - kEpsilon);
+      learn += pmf_k[k] * binomial_at_least(table, nSynapses - j,
+                                            max(fires, learns));
     }
+    t->learn[j] = learn;
   }
-  return result;
+
+  t->prev.resize(nSynapses + 1, 0.0);
+  t->next.resize(nSynapses + 1, 0.0);
+  t->prev[0] = 1.0;
+  t->learned.push_back(0.0);
+  t->false_true.push_back(t->fire[0]);
+  t->strengthened.push_back(0.0);
+  return t;
 }
 
-void free2D(int n, int m, double** ptr) {
-  for (int i = 0; i < n; ++i) {
-    free(ptr[i]);
-  }
-  free(ptr);
+static void free_trajectory(Trajectory* t) {
+  free_transition(t->transition);
+  delete t;
 }
 
-int main(int argc, char* argv[]) {
-  bool bDoSynapseProbabilityDistribution = false;
-  bool bDoSynapseStrength = false;
-  int doMathematica = -1;
-  double G = -1.0;
-  double H = -1.0;
-  double rate;
-  int R = -1;
-  int W = -1;
-  int c;
-  int nSynapses = -1;
-
-  while ((c = getopt(argc, argv, "dsm:G:H:R:S:W:")) != -1) {
-    switch (c) {
-      case 'd':
-        bDoSynapseProbabilityDistribution = true;
-        break;
-      case 's':
-        bDoSynapseStrength = true;
-        break;
-      case 'm':
-        // Generate Mathematica data
-        doMathematica = atoi(optarg);
-        break;
-      case 'G':
-        G = atof(optarg);
-        break;
-      case 'H':
-        H = atof(optarg);
-        break;
-      case 'R':
-        R = atoi(optarg);
-        break;
-      case 'S':
-        nSynapses = atoi(optarg);
-        break;
-      case 'W':
-        W = atoi(optarg);
-        break;
-      default:
-        break;
+// Extend t to w words
+static void extend_trajectory(int w, Trajectory* t) {
+  while (t->learned.size() <= w) {
+    double learned = 0.0;
+    for (int j = 0; j <= t->nSynapses; ++j) {
+      learned += t->prev[j] * t->learn[j];
     }
-  }
-  if (nSynapses < 0) nSynapses = 1000;
-  if (R < 0) R = 10;
-  if (H < 0.0) H = nSynapses / (double)R;
-  if (G < 0.0) G = 1.9;
-  if (W < 0) W = 60;
-  rate = 1 / (double)R;
-
-  if (0 < doMathematica) {
-    switch (doMathematica) {
-      case 1:
-        // Create a mathematica-friendy dataset for expected strengthened
-        // synapses versus W.
-        //
-        printf("{");
-        generate_strengthen_synapses(nSynapses, 1.0 / 10.0, G,
-				     kFraction * (nSynapses / 10.0), W);
-        printf(",");
-        generate_strengthen_synapses(nSynapses, 1.0 / 20.0, G,
-				     kFraction * (nSynapses / 20.0), W);
-        printf(",");
-        generate_strengthen_synapses(nSynapses, 1.0 / 30.0, G,
-				     kFraction * (nSynapses / 30.0), W);
-        printf(",");
-        generate_strengthen_synapses(nSynapses, 1.0 / 40.0, G,
-				     kFraction * (nSynapses / 40.0), W);
-        printf("}\n");
-        break;
-      case 3:
-        // Create a Mathematica-friendly dataset for probability of
-        // false-positive versus W.
-        //
-        printf("{");
-        generate_false_positive(nSynapses, 1.0 / 10.0, G,
-				kFraction * (nSynapses / 10.0), W);
-        printf(",");
-        generate_false_positive(nSynapses, 1.0 / 20.0, G,
-				kFraction * (nSynapses / 20.0), W);
-        printf(",");
-        generate_false_positive(nSynapses, 1.0 / 30.0, G,
-				kFraction * (nSynapses / 30.0), W);
-        printf(",");
-        generate_false_positive(nSynapses, 1.0 / 40.0, G,
-				kFraction * (nSynapses / 40.0), W);
-        printf("}\n");
-        break;
-      default:
-        break;
-    }
-    return 0;
-  }
+    strengthen_step(t->transition, &t->prev[0], &t->next[0]);
+    t->prev.swap(t->next);
 
-  if (bDoSynapseStrength) {
-    double* expected = expected_strengthen_synapses(nSynapses, rate, G, H, W);
-    for (int i = 0; i <= W; ++i) {
-      printf("%d,%lf\n", i, expected[i]);
+    double false_true = 0.0;
+    for (int j = 0; j <= t->nSynapses; ++j) {
+      false_true += t->prev[j] * t->fire[j];
     }
-    free(expected);
-    return 0;
+    t->learned.push_back(t->learned.back() + learned);
+    t->false_true.push_back(false_true);
+    t->strengthened.push_back(mean(t->nSynapses, &t->prev[0]));
   }
+}
 
-  if (bDoSynapseProbabilityDistribution) {
-    double** probs = prob_strengthen_synapses(nSynapses, rate, G, H, W);
-    for (int i = 0; i <= nSynapses; ++i) {
-      printf("%d,%lf\n", i, probs[W][i]);
-    }
-    free2D(W + 1, nSynapses + 1, probs);
-    return 0;
+bool PredictConfiguration(const TrainConfig& config,
+                          NeuronStatistics* result) {
+  const NeuronConfig& neuron = config.config();
+  if (neuron.c() != 1 || neuron.d1() != 1 || neuron.d2() != 1
+      || !neuron.has_g_m() || !neuron.has_h_m() || config.has_num_active()) {
+    return false;
   }
 
-  // False probability
-  double** probs = prob_strengthen_synapses(nSynapses, rate, G, H, W);
-  for (int i = 1; i <= W; ++i) {
-    double sum = 0.0;
-    for (int j = 0; j <= nSynapses; ++j) {
-      sum += probs[i][j] * prob_false_positive(nSynapses, j, rate, G, G * H, W);
-      // if (i == W) {
-      //   printf("sum = %lf, probs[%d][%d] = %lf, prob_false_positive = %lf\n",
-      //          sum, i, j,
-      //          probs[i][j], prob_false_positive(nSynapses, j, rate, G, G * H, W));
-      // }
+  int nSynapses = (int)floor(neuron.h() * neuron.q() * neuron.r() + kEpsilon);
+  double rate = 1.0 / neuron.r();
+  int w = config.w();
+  CHECK(0 < nSynapses && 0 < w);
+
+  double prob_learn;
+  double prob_false;
+  double strengthened;
+#pragma omp critical(trajectories)
+  {
+    // The most recently used trajectories, each with when it was last
+    // used.  A sweep asks for the w of one neuron configuration after
+    // another, so only the last few are worth keeping.
+    //
+    const int kMaxTrajectories = 16;
+    static map<vector<double>, pair<Trajectory*, long> > trajectories;
+    static long uses = 0;
+    vector<double> key;
+    key.push_back(nSynapses);
+    key.push_back(rate);
+    key.push_back(neuron.g_m());
+    key.push_back(neuron.h());
+    key.push_back(neuron.h_m());
+    pair<Trajectory*, long>& entry = trajectories[key];
+    if (entry.first == NULL) {
+      entry.first = new_trajectory(nSynapses, rate, neuron.g_m(), neuron.h(),
+                                   neuron.h_m());
+    }
+    entry.second = ++uses;
+    Trajectory* t = entry.first;
+    if (kMaxTrajectories < trajectories.size()) {
+      map<vector<double>, pair<Trajectory*, long> >::iterator oldest =
+          trajectories.begin();
+      map<vector<double>, pair<Trajectory*, long> >::iterator it;
+      for (it = trajectories.begin(); it != trajectories.end(); ++it) {
+        if (it->second.second < oldest->second.second) oldest = it;
+      }
+      free_trajectory(oldest->second.first);
+      trajectories.erase(oldest);
     }
-    printf("%d,%lf\n", i, sum);
+    extend_trajectory(w, t);
+
+    prob_false = t->false_true[w];
+    prob_learn = t->learned[w] / w;
+    strengthened = t->strengthened[w];
+  }
+  if (1.0 < prob_learn) prob_learn = 1.0;
+
+  // Bits per neuron as Bob::BitsPerNeuron() counts them
+  double bits = 0.0;
+  double pL = prob_learn;
+  double pF = 1.0 / 360.0 + prob_false;
+  if (pF <= pL) {
+    bits = L(min(max(pL, 0.0000001), 0.999999),
+             min(max(pF, 0.0000001), 0.999999), w);
   }
-  free2D(W + 1, nSynapses + 1, probs);
+
+  result->Clear();
+  result->mutable_config()->CopyFrom(config);
+  AddSample(prob_learn, result->mutable_true_true());
+  AddSample(1.0 - prob_learn, result->mutable_true_false());
+  AddSample(prob_false, result->mutable_false_true());
+  AddSample(1.0 - prob_false, result->mutable_false_false());
+  AddSample(bits, result->mutable_bits_per_neuron());
+  AddSample(bits / neuron.r(),
+            result->mutable_bits_per_neuron_per_refractory_period());
+  AddSample(strengthened / nSynapses, result->mutable_q_after());
+  AddSample(nSynapses, result->mutable_synapses_per_neuron());
+  if (0.0 < prob_learn) AddSample(1.0, result->mutable_d_effective());
+  return true;
 }
+
+}  // namespace cognon
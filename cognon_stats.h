@@ -0,0 +1,96 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Numerical analysis of simple (C=D1=D2=1) Cognon neurons with
+// nSynapses synapses, each active in a word with probability rate.
+// During training a synapse strengthened to G adds G to the sum, and
+// the neuron fires when the sum reaches H.
+//
+#ifndef COGNON_COGNON_STATS_H_
+#define COGNON_COGNON_STATS_H_
+
+#include "cognon.h"
+
+namespace cognon {
+
+// The probability that a random word fires a neuron with
+// nStrongSynapses of its synapses strengthened, at threshold H
+//
+double prob_fire(int nSynapses, int nStrongSynapses, double rate,
+                 double G, double H);
+
+// prob_fire(), less the chance that the random word is one of the w
+// training words
+//
+double prob_false_positive(int nSynapses, int nStrongSynapses, double rate,
+                           double G, double H, int w);
+
+// prob_false_positive() for each number of strengthened synapses from 0
+// to nSynapses, in a malloc()ed array
+//
+double* false_positives(int nSynapses, double rate, double G, double H, int w);
+
+// The change in the number of strengthened synapses on one training
+// word.  With j synapses already strengthened, the neuron fails to fire
+// with probability stay[j], and otherwise fires and strengthens l more
+// with probability move[j][l - first[j]], for first[j] <= l <
+// first[j] + count[j].
+//
+struct Transition {
+  int nSynapses;
+  double* stay;
+  int* first;
+  int* count;
+  double** move;
+};
+
+Transition* new_transition(int nSynapses, double rate, double G, double H);
+void free_transition(Transition* transition);
+
+// Set next to the distribution of the number of strengthened synapses
+// after one more word, given prev after the words before it.
+//
+void strengthen_step(const Transition* transition,
+                     const double* prev, double* next);
+
+// The distribution of the number of strengthened synapses after w
+// words, and the expected number after each of 0 to w words, in
+// malloc()ed arrays
+//
+double* prob_strengthen_synapses(int nSynapses,
+                                 double rate, double G, double H, int w);
+double* expected_strengthen_synapses(int nSynapses,
+                                     double rate, double G, double H, int w);
+
+// Predict the result of RunConfiguration() on config from the model
+// above, setting result to a single sample of pL, pF, bits per neuron,
+// synapses per neuron, Q after and D_eff.  A word is learned if it
+// fired in training and its synapses alone, strengthened, reach H_m;
+// words that did not fire are taken never to fire.  The model is built
+// once for each neuron configuration and extended as larger w are
+// asked for, so a sweep over w costs about as much as its largest w.
+// The models of the 16 most recently used configurations are kept.
+//
+// Returns false, leaving result alone, if the model does not cover
+// config: C, D1 or D2 above one, no G_m and H_m, or a fixed number of
+// active synapses per word.
+//
+bool PredictConfiguration(const TrainConfig& config, NeuronStatistics* result);
+
+}  // namespace cognon
+
+#endif  // COGNON_COGNON_STATS_H_
@@ -0,0 +1,230 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Numerical analysis of various aspects of Cognon performance.  It outputs
+// data in the form of Mathematica input.
+//
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <omp.h>
+
+#include "cognon_stats.h"
+
+namespace cognon {
+
+const double kFraction = 1.0;
+
+void generate_strengthen_synapses(int nSynapses,
+                                  double rate, double G, double H, int W,
+                                  FILE* out) {
+  double* expected = expected_strengthen_synapses(nSynapses, rate, G, H, W);
+
+  fprintf(out, "{");
+  for (int i = 0; i <= W; ++i) {
+    if (0 < i) fprintf(out, ", ");
+    fprintf(out, "{%d,%lf}", i, expected[i]);
+  }
+  fprintf(out, "}");
+  fflush(out);
+
+  free(expected);
+}
+
+void generate_false_positive(int nSynapses,
+                             double rate, double G, double H, int W,
+                             FILE* out) {
+  // False probability
+  fprintf(out, "{");
+  double* prev = (double*)calloc(nSynapses + 1, sizeof(double));
+  double* next = (double*)calloc(nSynapses + 1, sizeof(double));
+  prev[0] = 1.0;
+  Transition* transition = new_transition(nSynapses, rate, G, H);
+  double* fp = false_positives(nSynapses, rate, G, G * H, W);
+  for (int i = 1; i <= W; ++i) {
+    strengthen_step(transition, prev, next);
+    double sum = 0.0;
+    for (int j = 0; j <= nSynapses; ++j) {
+      sum += next[j] * fp[j];
+      assert(!isnan(sum) && 0.0 <= sum && sum <= 1.0 + kEpsilon);
+    }
+    if (1 < i) fprintf(out, ", ");
+    fprintf(out, "{%d,%lf}", i, sum);
+    fflush(out);
+    double* swap = prev;
+    prev = next;
+    next = swap;
+  }
+  fprintf(out, "}");
+  fflush(out);
+
+  free_transition(transition);
+  free(fp);
+  free(prev);
+  free(next);
+}
+
+// Print the Mathematica dataset for -m series: one list per rate 1/10,
+// 1/20, 1/30 and 1/40.  The lists are computed concurrently, each into
+// its own buffer, and printed in order.
+//
+void generate_series(int series, int nSynapses, double G, int W) {
+  const int kRates = 4;
+  char* buffers[kRates];
+  size_t sizes[kRates];
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int r = 0; r < kRates; ++r) {
+    double R = 10.0 * (r + 1);
+    FILE* out = open_memstream(&buffers[r], &sizes[r]);
+    if (series == 1) {
+      generate_strengthen_synapses(nSynapses, 1.0 / R, G,
+                                   kFraction * (nSynapses / R), W, out);
+    } else {
+      generate_false_positive(nSynapses, 1.0 / R, G,
+                              kFraction * (nSynapses / R), W, out);
+    }
+    fclose(out);
+  }
+
+  printf("{");
+  for (int r = 0; r < kRates; ++r) {
+    if (0 < r) printf(",");
+    fwrite(buffers[r], 1, sizes[r], stdout);
+    free(buffers[r]);
+  }
+  printf("}\n");
+}
+
+}  // namespace cognon
+
+using namespace cognon;
+
+int main(int argc, char* argv[]) {
+  bool bDoSynapseProbabilityDistribution = false;
+  bool bDoSynapseStrength = false;
+  int doMathematica = -1;
+  double G = -1.0;
+  double H = -1.0;
+  double rate;
+  int R = -1;
+  int W = -1;
+  int c;
+  int nSynapses = -1;
+
+  while ((c = getopt(argc, argv, "dsm:G:H:R:S:W:")) != -1) {
+    switch (c) {
+      case 'd':
+        bDoSynapseProbabilityDistribution = true;
+        break;
+      case 's':
+        bDoSynapseStrength = true;
+        break;
+      case 'm':
+        // Generate Mathematica data
+        doMathematica = atoi(optarg);
+        break;
+      case 'G':
+        G = atof(optarg);
+        break;
+      case 'H':
+        H = atof(optarg);
+        break;
+      case 'R':
+        R = atoi(optarg);
+        break;
+      case 'S':
+        nSynapses = atoi(optarg);
+        break;
+      case 'W':
+        W = atoi(optarg);
+        break;
+      default:
+        break;
+    }
+  }
+  if (nSynapses < 0) nSynapses = 1000;
+  if (R < 0) R = 10;
+  if (H < 0.0) H = nSynapses / (double)R;
+  if (G < 0.0) G = 1.9;
+  if (W < 0) W = 60;
+  rate = 1 / (double)R;
+
+  if (0 < doMathematica) {
+    switch (doMathematica) {
+      case 1:
+        // Create a mathematica-friendy dataset for expected strengthened
+        // synapses versus W.
+        //
+        generate_series(1, nSynapses, G, W);
+        break;
+      case 3:
+        // Create a Mathematica-friendly dataset for probability of
+        // false-positive versus W.
+        //
+        generate_series(3, nSynapses, G, W);
+        break;
+      default:
+        break;
+    }
+    return 0;
+  }
+
+  if (bDoSynapseStrength) {
+    double* expected = expected_strengthen_synapses(nSynapses, rate, G, H, W);
+    for (int i = 0; i <= W; ++i) {
+      printf("%d,%lf\n", i, expected[i]);
+    }
+    free(expected);
+    return 0;
+  }
+
+  if (bDoSynapseProbabilityDistribution) {
+    double* probs = prob_strengthen_synapses(nSynapses, rate, G, H, W);
+    for (int i = 0; i <= nSynapses; ++i) {
+      printf("%d,%lf\n", i, probs[i]);
+    }
+    free(probs);
+    return 0;
+  }
+
+  // False probability
+  double* prev = (double*)calloc(nSynapses + 1, sizeof(double));
+  double* next = (double*)calloc(nSynapses + 1, sizeof(double));
+  prev[0] = 1.0;
+  Transition* transition = new_transition(nSynapses, rate, G, H);
+  double* fp = false_positives(nSynapses, rate, G, G * H, W);
+  for (int i = 1; i <= W; ++i) {
+    strengthen_step(transition, prev, next);
+    double sum = 0.0;
+    for (int j = 0; j <= nSynapses; ++j) {
+      sum += next[j] * fp[j];
+    }
+    printf("%d,%lf\n", i, sum);
+    double* swap = prev;
+    prev = next;
+    next = swap;
+  }
+  free_transition(transition);
+  free(fp);
+  free(prev);
+  free(next);
+}
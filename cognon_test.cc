@@ -15,13 +15,17 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-// Tests Statistic, Histogram, and RunExperiment.
+// Tests Statistic, Histogram, RunExperiment, and the result cache.
 //
 
 #include "cognon.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <sys/param.h>
+#include <unistd.h>
+
+#include "result_cache.h"
 
 #define ABS(a) ((a) < 0.0 ? -(a) : (a))
 #define FLOAT_EQ(a, b) \
@@ -299,6 +303,82 @@ TEST_F(CognonTest, CheckStatistic) {
       << "c = a + b: Expected c.values(6) 5.0: " << c.values(6);
 }
 
+TEST_F(CognonTest, CheckStreamingStatistic) {
+  // Large offsets cancel in count * ssum - sum * sum, but not in the
+  // Welford and Chan moments.
+  //
+  Statistic a;
+  Statistic b;
+  AddSample(1.0e9 + 3.0, &a);
+  AddSample(1.0e9 + 4.0, &a);
+  AddSample(1.0e9 + 5.0, &b);
+  a += b;
+  EXPECT_FEQ(1.0, Stddev(a))
+      << "Expected stddev of 1.0 with a large offset: " << Stddev(a);
+
+  // With max_values zero only the moments are kept
+  Statistic c;
+  c.set_max_values(0);
+  for (int32 i = 0; i < 1000; ++i) {
+    AddSample(i % 10, &c);
+  }
+  EXPECT_EQ(c.values_size(), 0);
+  EXPECT_EQ(c.count(), 1000);
+  EXPECT_FEQ(4.5, Mean(c));
+  c += a;
+  EXPECT_EQ(c.values_size(), 0);
+  EXPECT_EQ(c.count(), 1003);
+
+  // A reservoir keeps a uniform sample of at most max_values
+  Statistic d;
+  d.set_max_values(100);
+  for (int32 i = 0; i < 5000; ++i) {
+    AddSample(i < 2500 ? 0.0 : 1.0, &d);
+  }
+  Statistic e;
+  for (int32 i = 0; i < 5000; ++i) {
+    AddSample(2.0, &e);
+  }
+  d += e;
+  EXPECT_EQ(d.count(), 10000);
+  EXPECT_EQ(d.values_size(), 100);
+  EXPECT_EQ(d.max_values(), 100);
+  double sum = 0.0;
+  for (int32 i = 0; i < d.values_size(); ++i) {
+    sum += d.values(i);
+  }
+  EXPECT_TRUE(fabs(sum / d.values_size() - Mean(d)) < 0.3)
+      << "Expected the sample mean near " << Mean(d) << ": "
+      << sum / d.values_size() << "\n";
+
+  // The sample neither depends on nor uses up the thread's random
+  // numbers
+  //
+  RandomBase random;
+  random.Seed(1);
+  uint32 next = random.Rand32();
+  Statistic f;
+  Statistic g;
+  f.set_max_values(10);
+  g.set_max_values(10);
+  random.Seed(1);
+  for (int32 i = 0; i < 1000; ++i) AddSample(i, &f);
+  f += d;
+  EXPECT_EQ(random.Rand32(), next);
+  random.Seed(2);
+  for (int32 i = 0; i < 1000; ++i) AddSample(i, &g);
+  g += d;
+  EXPECT_EQ(f.values_size(), 10);
+  for (int32 i = 0; i < f.values_size(); ++i) {
+    EXPECT_EQ(f.values(i), g.values(i));
+  }
+
+  // A statistic without values can not contribute to a sample
+  c.set_max_values(100);
+  d += c;
+  EXPECT_EQ(d.values_size(), 0);
+}
+
 TEST_F(CognonTest, CheckHistogram) {
   Histogram a;
   Histogram b;
@@ -567,6 +647,39 @@ TEST_F(CognonTest, CheckHistogram) {
       << "c += b + b: Expected c.values(3).count() 3: " << c.values(3).count();
 }
 
+TEST_F(CognonTest, CheckSwap) {
+  NeuronStatistics a;
+  NeuronStatistics b;
+  vector<int32> v(3, 2);
+
+  a.mutable_config()->set_w(10);
+  AddSample(1.0, a.mutable_true_true());
+  AddSample(3.0, a.mutable_true_true());
+  SetHistogram(v, a.mutable_h_histogram());
+  b.mutable_config()->set_w(20);
+  AddSample(5.0, b.mutable_false_true());
+
+  a.Swap(&b);
+  EXPECT_EQ(a.config().w(), 20);
+  EXPECT_TRUE(!a.has_true_true() && a.has_false_true());
+  EXPECT_FEQ(Mean(a.false_true()), 5.0);
+  EXPECT_TRUE(!a.has_h_histogram());
+  EXPECT_EQ(b.config().w(), 10);
+  EXPECT_EQ(b.true_true().values_size(), 2);
+  EXPECT_FEQ(Mean(b.true_true()), 2.0);
+  EXPECT_EQ(b.h_histogram().values_size(), 3);
+
+  // Copies into cleared objects, and merges into them, are unchanged
+  a.clear();
+  a.CopyFrom(b);
+  a += b;
+  EXPECT_EQ(a.config().w(), 10);
+  EXPECT_EQ(a.true_true().count(), 4);
+  EXPECT_EQ(a.true_true().values_size(), 4);
+  EXPECT_EQ(a.h_histogram().values(2).count(), 2);
+  EXPECT_FEQ(Mean(a.h_histogram().values(2)), 2.0);
+}
+
 TEST_F(CognonTest, CheckRunExperiment) {
   TrainConfig config;
 
@@ -594,10 +707,349 @@ TEST_F(CognonTest, CheckRunExperiment) {
   EXPECT_EQ(round(Mean(result.false_count())), 100);
 }
 
+TEST_F(CognonTest, CheckRunConfigurations) {
+  vector<TrainConfig> configs(2);
+
+  for (int32 i = 0; i < configs.size(); ++i) {
+    configs[i].set_w(5 * (i + 1));
+    configs[i].set_num_test_words(1000);
+    configs[i].mutable_config()->set_c(1);
+    configs[i].mutable_config()->set_d1(1);
+    configs[i].mutable_config()->set_d2(1);
+    configs[i].mutable_config()->set_h(10);
+    configs[i].mutable_config()->set_q(0.362000);
+    configs[i].mutable_config()->set_r(30);
+  }
+
+  // At full fidelity each result matches RunConfiguration()'s shape
+  vector<NeuronStatistics> results;
+  RunConfigurations(10, 1.0, configs, &results);
+  EXPECT_EQ(results.size(), 2);
+  EXPECT_EQ(results[0].true_count().count(), 2000);
+  EXPECT_EQ(results[1].true_count().count(), 1000);
+  EXPECT_EQ(round(Mean(results[1].false_count())), 1000);
+
+  // At a quarter fidelity, a quarter of the neurons and test words
+  RunConfigurations(10, 0.25, configs, &results);
+  EXPECT_EQ(results[0].true_count().count(), 500);
+  EXPECT_EQ(results[1].true_count().count(), 250);
+  EXPECT_EQ(results[1].config().num_test_words(), 250);
+  EXPECT_EQ(round(Mean(results[1].false_count())), 250);
+}
+
+TEST_F(CognonTest, CheckRunConfigurationShard) {
+  TrainConfig config;
+  config.set_w(1000);
+  config.set_num_test_words(1000);
+  config.mutable_config()->set_c(1);
+  config.mutable_config()->set_d1(1);
+  config.mutable_config()->set_d2(1);
+  config.mutable_config()->set_h(10);
+  config.mutable_config()->set_q(0.362000);
+  config.mutable_config()->set_r(30);
+
+  // The 10 repetitions of row 2 split 3, 3, 4 between the shards,
+  // starting from shard 2, and add up to the whole row
+  NeuronStatistics merged;
+  int32 expected[3] = { 3, 3, 4 };
+  for (int32 shard = 0; shard < 3; ++shard) {
+    NeuronStatistics result;
+    RunConfigurationShard(10, config, 2, shard, 3, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), expected[shard]);
+    EXPECT_EQ(result.config().num_test_words(), 1000);
+    merged += result;
+  }
+  EXPECT_EQ(merged.synapses_per_neuron().count(), 10);
+  EXPECT_EQ(merged.true_count().count(), 10);
+}
+
+TEST_F(CognonTest, CheckResultCache) {
+  string filename = StringPrintf("/tmp/cognon_test.%d.cache", getpid());
+  unlink(filename.c_str());
+
+  TrainConfig config;
+  config.set_w(5000);
+  config.set_num_test_words(1000);
+  config.mutable_config()->set_c(1);
+  config.mutable_config()->set_d1(1);
+  config.mutable_config()->set_d2(1);
+  config.mutable_config()->set_h(10);
+  config.mutable_config()->set_q(0.362000);
+  config.mutable_config()->set_r(30);
+
+  {
+    ResultCache cache;
+    EXPECT_TRUE(cache.Open(filename, 0));
+    SetResultCache(&cache);
+
+    // Nothing cached, so both repetitions run
+    NeuronStatistics result;
+    RunConfiguration(2, config, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), 2);
+
+    // Only the third repetition runs
+    RunConfiguration(3, config, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), 3);
+    EXPECT_EQ(result.true_count().count(), 3);
+
+    // More than enough are cached, but only the two needed for 10,000
+    // words are used
+    //
+    RunConfiguration(1, config, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), 2);
+    SetResultCache(NULL);
+  }
+
+  // The repetitions persist, but only for the same seed and config
+  ResultCache cache;
+  NeuronStatistics cached;
+  EXPECT_TRUE(cache.Open(filename, 0));
+  EXPECT_EQ(cache.bad_records(), 0);
+  EXPECT_EQ(cache.Lookup(config, &cached), 3);
+  EXPECT_EQ(cached.true_count().count(), 3);
+  config.set_num_test_words(2000);
+  EXPECT_EQ(cache.Lookup(config, &cached), 0);
+  config.set_num_test_words(1000);
+  EXPECT_TRUE(cache.Open(filename, 1));
+  EXPECT_EQ(cache.Lookup(config, &cached), 0);
+
+  // A partial record left by a crash is dropped
+  FILE* file = fopen(filename.c_str(), "ab");
+  fwrite("\100\0\0\0abc", 1, 7, file);
+  fclose(file);
+  EXPECT_TRUE(cache.Open(filename, 0));
+  EXPECT_EQ(cache.bad_records(), 1);
+  EXPECT_EQ(cache.Lookup(config, &cached), 3);
+  NeuronStatistics result;
+  result.CopyFrom(cached);
+  cache.Add(result);
+  EXPECT_TRUE(cache.Open(filename, 0));
+  EXPECT_EQ(cache.bad_records(), 0);
+  EXPECT_EQ(cache.Lookup(config, &cached), 6);
+
+  // A record that cannot be written is not recorded
+  ResultCache full;
+  if (full.Open("/dev/full", 0)) {
+    EXPECT_FALSE(full.Add(result));
+    EXPECT_EQ(full.Lookup(config, &cached), 0);
+  }
+
+  unlink(filename.c_str());
+}
+
+// Seeded runs are repeatable, and give the same result when resumed
+// from a result cache holding any of their repetitions.
+//
+TEST_F(CognonTest, CheckSeededResume) {
+  string filename = StringPrintf("/tmp/cognon_test.%d.cache", getpid());
+  string partial = filename + ".partial";
+  unlink(filename.c_str());
+  unlink(partial.c_str());
+
+  TrainConfig config;
+  config.set_w(5000);
+  config.set_num_test_words(1000);
+  config.mutable_config()->set_c(1);
+  config.mutable_config()->set_d1(1);
+  config.mutable_config()->set_d2(1);
+  config.mutable_config()->set_h(10);
+  config.mutable_config()->set_q(0.362000);
+  config.mutable_config()->set_r(30);
+
+  SetRandomSeed(7);
+  NeuronStatistics expected;
+  NeuronStatistics result;
+  RunConfiguration(4, config, &expected);
+  RunConfiguration(4, config, &result);
+  EXPECT_EQ(Mean(result.true_true()), Mean(expected.true_true()));
+  EXPECT_EQ(Mean(result.false_true()), Mean(expected.false_true()));
+
+  // Interrupted after two repetitions, then resumed
+  {
+    ResultCache cache;
+    EXPECT_TRUE(cache.Open(filename, 7));
+    SetResultCache(&cache);
+    RunConfiguration(2, config, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), 2);
+    RunConfiguration(4, config, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), 4);
+    EXPECT_EQ(Mean(result.true_true()), Mean(expected.true_true()));
+    EXPECT_EQ(Mean(result.false_true()), Mean(expected.false_true()));
+    SetResultCache(NULL);
+  }
+
+  // Only the last repetition finished before the interruption
+  {
+    ResultCache cache;
+    EXPECT_TRUE(cache.Open(filename, 7));
+    const ResultCache::Entry* entry = cache.Find(config);
+    EXPECT_TRUE(entry != NULL);
+    EXPECT_EQ(entry->numbered.size(), 4);
+
+    ResultCache resumed;
+    EXPECT_TRUE(resumed.Open(partial, 7));
+    resumed.AddRepetition(3, entry->numbered.find(3)->second);
+    SetResultCache(&resumed);
+    RunConfiguration(4, config, &result);
+    EXPECT_EQ(result.synapses_per_neuron().count(), 4);
+    EXPECT_EQ(Mean(result.true_true()), Mean(expected.true_true()));
+    EXPECT_EQ(Mean(result.false_true()), Mean(expected.false_true()));
+    SetResultCache(NULL);
+  }
+  SetRandomSeed(-1);
+
+  unlink(filename.c_str());
+  unlink(partial.c_str());
+}
+
+// Repetitions run in lockstep give the same results as one at a time
+TEST_F(CognonTest, CheckLockstepLanes) {
+  TrainConfig config;
+  config.set_w(1000);
+  config.set_num_test_words(1000);
+  config.mutable_config()->set_c(4);
+  config.mutable_config()->set_d1(4);
+  config.mutable_config()->set_d2(7);
+  config.mutable_config()->set_h(10);
+  config.mutable_config()->set_q(1.0);
+  config.mutable_config()->set_r(30);
+
+  SetRandomSeed(11);
+  NeuronStatistics expected;
+  RunConfiguration(10, config, &expected);
+  SetLockstepLanes(4, false);
+  NeuronStatistics result;
+  RunConfiguration(10, config, &result);
+  SetLockstepLanes(1);
+  SetRandomSeed(-1);
+
+  EXPECT_EQ(result.synapses_per_neuron().count(), 10);
+  EXPECT_EQ(Mean(result.true_true()), Mean(expected.true_true()));
+  EXPECT_EQ(Mean(result.false_true()), Mean(expected.false_true()));
+  EXPECT_EQ(Mean(result.bits_per_neuron()), Mean(expected.bits_per_neuron()));
+  EXPECT_EQ(Mean(result.q_after()), Mean(expected.q_after()));
+}
+
+// Whether two results drew the same neurons before training
+static bool SameNeurons(const NeuronStatistics& a, const NeuronStatistics& b) {
+  const Histogram& x = a.synapse_before_delay_histogram();
+  const Histogram& y = b.synapse_before_delay_histogram();
+  if (x.count() != y.count() || x.sum_size() != y.sum_size()) return false;
+  for (int32 i = 0; i < x.sum_size(); ++i) {
+    if (x.sum(i) != y.sum(i) || x.ssum(i) != y.ssum(i)) return false;
+  }
+  return true;
+}
+
+// With common random numbers the points of a sweep over w and G_m
+// train the same neurons, in lockstep or not
+TEST_F(CognonTest, CheckCommonRandomNumbers) {
+  vector<TrainConfig> configs(2);
+  configs[0].set_w(1250);
+  configs[0].set_num_test_words(1000);
+  configs[0].mutable_config()->set_c(4);
+  configs[0].mutable_config()->set_d1(4);
+  configs[0].mutable_config()->set_d2(7);
+  configs[0].mutable_config()->set_h(10);
+  configs[0].mutable_config()->set_q(1.0);
+  configs[0].mutable_config()->set_r(30);
+  configs[0].mutable_config()->set_g_m(1.5);
+  configs[0].mutable_config()->set_h_m(15.0);
+  configs[1].CopyFrom(configs[0]);
+  configs[1].set_w(2500);
+  configs[1].mutable_config()->set_g_m(1.9);
+  configs[1].mutable_config()->set_h_m(19.0);
+
+  SetRandomSeed(13);
+  vector<NeuronStatistics> independent;
+  RunConfigurations(8, 1.0, configs, &independent);
+  EXPECT_FALSE(SameNeurons(independent[0], independent[1]));
+
+  SetCommonRandomNumbers(true);
+  vector<NeuronStatistics> common;
+  RunConfigurations(8, 1.0, configs, &common);
+  EXPECT_TRUE(SameNeurons(common[0], common[1]));
+
+  SetLockstepLanes(4, false);
+  vector<NeuronStatistics> lockstep;
+  RunConfigurations(8, 1.0, configs, &lockstep);
+  SetLockstepLanes(1);
+  SetCommonRandomNumbers(false);
+  SetRandomSeed(-1);
+
+  for (int32 c = 0; c < configs.size(); ++c) {
+    EXPECT_TRUE(SameNeurons(lockstep[c], common[c]));
+    EXPECT_EQ(Mean(lockstep[c].true_true()), Mean(common[c].true_true()));
+    EXPECT_EQ(Mean(lockstep[c].false_true()), Mean(common[c].false_true()));
+  }
+}
+
+// Repetitions sharing a test corpus test on at most its words, and
+// give the same results in lockstep as one at a time
+TEST_F(CognonTest, CheckSharedTestCorpus) {
+  TrainConfig config;
+  config.set_w(1000);
+  config.set_num_test_words(3000);
+  config.mutable_config()->set_c(4);
+  config.mutable_config()->set_d1(4);
+  config.mutable_config()->set_d2(7);
+  config.mutable_config()->set_h(10);
+  config.mutable_config()->set_q(1.0);
+  config.mutable_config()->set_r(30);
+
+  SetRandomSeed(17);
+  SetSharedTestCorpus(true);
+  NeuronStatistics expected;
+  RunConfiguration(10, config, &expected);
+  SetLockstepLanes(4, false);
+  NeuronStatistics result;
+  RunConfiguration(10, config, &result);
+  SetLockstepLanes(1);
+  SetSharedTestCorpus(false);
+  SetRandomSeed(-1);
+
+  EXPECT_EQ(result.synapses_per_neuron().count(), 10);
+  EXPECT_LE(Mean(result.false_count()), 3000.0);
+  EXPECT_LE(2990.0, Mean(result.false_count()));
+  EXPECT_EQ(Mean(result.true_true()), Mean(expected.true_true()));
+  EXPECT_EQ(Mean(result.false_true()), Mean(expected.false_true()));
+  EXPECT_EQ(Mean(result.false_count()), Mean(expected.false_count()));
+
+  // Testing at several thresholds draws on the same corpus
+  config.mutable_config()->set_h(5);
+  config.mutable_config()->set_g_m(1.0);
+  config.mutable_config()->set_h_m(config.config().h()
+                                   * config.config().g_m());
+  vector<double> thresholds(1, config.config().h_m());
+  vector<NeuronStatistics> threshold_results;
+  SetRandomSeed(17);
+  SetSharedTestCorpus(true);
+  RunConfiguration(10, config, &expected);
+  RunThresholdConfiguration(10, config, thresholds, &threshold_results);
+  SetSharedTestCorpus(false);
+  SetRandomSeed(-1);
+
+  EXPECT_EQ(threshold_results[0].synapses_per_neuron().count(), 10);
+  EXPECT_LE(0.001, Mean(expected.false_true()));
+  EXPECT_EQ(Mean(threshold_results[0].false_true()),
+            Mean(expected.false_true()));
+  EXPECT_EQ(Mean(threshold_results[0].false_count()),
+            Mean(expected.false_count()));
+}
+
 }  // namespace cognon
 
 int main(int argc, char **argv) {
   CALL_TEST(cognon::CheckStatistic);
+  CALL_TEST(cognon::CheckStreamingStatistic);
   CALL_TEST(cognon::CheckHistogram);
+  CALL_TEST(cognon::CheckSwap);
   CALL_TEST(cognon::CheckRunExperiment);
+  CALL_TEST(cognon::CheckRunConfigurations);
+  CALL_TEST(cognon::CheckRunConfigurationShard);
+  CALL_TEST(cognon::CheckResultCache);
+  CALL_TEST(cognon::CheckSeededResume);
+  CALL_TEST(cognon::CheckLockstepLanes);
+  CALL_TEST(cognon::CheckCommonRandomNumbers);
+  CALL_TEST(cognon::CheckSharedTestCorpus);
 }
@@ -32,6 +32,18 @@ RandomBase::RandomBase() : threadId(omp_get_thread_num()) {
 
 uint32 RandomBase::Rand32() { return random[threadId]->randInt(); }
 
+void RandomBase::Seed(uint32 seed) { random[threadId]->seed(seed); }
+
+void RandomBase::SaveState(vector<MTRand::uint32>* state) const {
+  state->resize(MTRand::SAVE);
+  random[threadId]->save(&(*state)[0]);
+}
+
+void RandomBase::LoadState(const vector<MTRand::uint32>& state) {
+  CHECK(state.size() == MTRand::SAVE);
+  random[threadId]->load(const_cast<MTRand::uint32*>(&state[0]));
+}
+
 uint64 RandomBase::Rand64() {
   return ((static_cast<uint64>(random[threadId]->randInt()) << 32)
           | static_cast<uint64>(random[threadId]->randInt()));
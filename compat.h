@@ -82,6 +82,17 @@ class RandomBase {
 
   uint32 Rand32();
   uint64 Rand64();
+
+  // Reseed this thread's generator, so that the numbers it generates
+  // from here on are repeatable
+  //
+  void Seed(uint32 seed);
+
+  // Save and restore this thread's generator, so that several streams
+  // of random numbers can take turns on the thread
+  //
+  void SaveState(vector<MTRand::uint32>* state) const;
+  void LoadState(const vector<MTRand::uint32>& state);
  private:
   int32 threadId;
   static MTRand** random;
@@ -137,8 +148,8 @@ namespace cognon {
   if (other.has_##name##_) name##_.CopyFrom(other.name##_);
 
 #define VALUE_SERIALIZE(type,name)                                      \
-  /* ar & has_##name##_ */;                                             \
-  /* ar & name##_ */;
+  ar & has_##name##_;                                                   \
+  if (has_##name##_) ar & name##_;
 
 #define VALUE_COMPARE_LESS_THAN(type,name)                              \
   if (!has_##name() && other.has_##name()) return true;                 \
@@ -166,20 +177,31 @@ namespace cognon {
  const type& name(int i) const { return name##_[i]; }                   \
  type* mutable_##name(int32 i) { return &name##_[i]; }
 
+// Copies reuse the storage already allocated by the destination, and
+// clear() keeps it, so that a cleared object can be refilled without
+// allocating.
+//
 #define VECTOR_COPY(type,name)                                          \
-  name##_.clear();                                                      \
-  name##_.resize(other.name##_.size());                                 \
-  for (int32 i = 0; i < other.name##_.size(); ++i) {                    \
-    name##_[i] = other.name##_[i];                                      \
-  }
+  name##_.assign(other.name##_.begin(), other.name##_.end());
 
 #define VECTOR_COPY_CLASS(type,name)                                    \
-  name##_.clear();                                                      \
   name##_.resize(other.name##_.size());                                 \
   for (int32 i = 0; i < other.name##_.size(); ++i) {                    \
     name##_[i].CopyFrom(other.name##_[i]);                              \
   }
 
+// Swap() exchanges the contents of two objects without copying them
+#define VALUE_SWAP(type,name)                                           \
+  swap(has_##name##_, other->has_##name##_);                            \
+  swap(name##_, other->name##_);
+
+#define VALUE_SWAP_CLASS(type,name)                                     \
+  swap(has_##name##_, other->has_##name##_);                            \
+  name##_.Swap(&other->name##_);
+
+#define VECTOR_SWAP(type,name)                                          \
+  name##_.swap(other->name##_);
+
 #define VECTOR_SERIALIZE(type,name)                                     \
   ar & name##_;
 
@@ -256,6 +278,17 @@ class NeuronConfig {
     VALUE_COPY(double,h_m);
   }
 
+  void Swap(NeuronConfig* other) {
+    VALUE_SWAP(int32,c);
+    VALUE_SWAP(int32,d1);
+    VALUE_SWAP(int32,d2);
+    VALUE_SWAP(double,h);
+    VALUE_SWAP(double,q);
+    VALUE_SWAP(int32,r);
+    VALUE_SWAP(double,g_m);
+    VALUE_SWAP(double,h_m);
+  }
+
   bool operator<(const NeuronConfig& other) const {
     VALUE_COMPARE_LESS_THAN(int32,c);
     VALUE_COMPARE_LESS_THAN(int32,d1);
@@ -299,7 +332,31 @@ class TrainConfig {
   // Number of random words to test neuron with.
   VALUE_PARAMETER(int32,num_test_words);
 
+  // How the false positive probability is estimated.  One of the
+  // FalsePositiveEstimator values below; unset means UNIFORM_SAMPLING.
+  //
+  VALUE_PARAMETER(int32,false_positive_estimator);
+
  public:
+  enum FalsePositiveEstimator {
+    // Count the firings on uniformly random test words.
+    UNIFORM_SAMPLING = 0,
+
+    // Bias the test words towards the strengthened (frozen) synapses
+    // and reweight each firing by its likelihood ratio.
+    //
+    IMPORTANCE_SAMPLING = 1,
+
+    // Compute the probability from the trained synapses directly; exact
+    // when D1 = 1, otherwise the independence approximation within its
+    // bounds.  Falls back to uniform sampling where it does not apply.
+    //
+    EXACT = 2,
+
+    // As EXACT, but also estimate by uniform sampling for comparison.
+    EXACT_CROSS_CHECK = 3
+  };
+
   TrainConfig() { clear(); }
 
   void Clear() { clear(); }
@@ -309,6 +366,7 @@ class TrainConfig {
     clear_w();
     clear_num_active();
     clear_num_test_words();
+    clear_false_positive_estimator();
   }
 
   void CopyFrom(const TrainConfig& other) {
@@ -317,6 +375,15 @@ class TrainConfig {
     VALUE_COPY(int32,w);
     VALUE_COPY(int32,num_active);
     VALUE_COPY(int32,num_test_words);
+    VALUE_COPY(int32,false_positive_estimator);
+  }
+
+  void Swap(TrainConfig* other) {
+    VALUE_SWAP_CLASS(NeuronConfig,config);
+    VALUE_SWAP(int32,w);
+    VALUE_SWAP(int32,num_active);
+    VALUE_SWAP(int32,num_test_words);
+    VALUE_SWAP(int32,false_positive_estimator);
   }
 
   bool operator<(const TrainConfig& other) const {
@@ -324,6 +391,8 @@ class TrainConfig {
     VALUE_COMPARE_LESS_THAN(int32,w);
     VALUE_COMPARE_LESS_THAN(int32,num_active);
     VALUE_COMPARE_LESS_THAN(int32,num_test_words);
+    VALUE_COMPARE_LESS_THAN(int32,false_positive_estimator);
+    return false;
   }
 
   friend class boost::serialization::access;
@@ -334,6 +403,7 @@ class TrainConfig {
     VALUE_SERIALIZE(int32,w);
     VALUE_SERIALIZE(int32,num_active);
     VALUE_SERIALIZE(int32,num_test_words);
+    VALUE_SERIALIZE(int32,false_positive_estimator);
   }
 };
 
@@ -357,6 +427,19 @@ class Statistic {
   // Array of the actual values. (Optional)
   VECTOR_PARAMETER(double,values);
 
+  // Summation of squared differences from the mean, updated by
+  // Welford's method and merged by Chan's, for a standard deviation
+  // that does not suffer from cancellation.  Missing from statistics
+  // archived before it was added.
+  //
+  VALUE_PARAMETER(double,m2);
+
+  // When set, values holds a uniform random sample (a reservoir) of at
+  // most max_values of the values, rather than all of them, so that
+  // memory does not grow with count.  Zero keeps no values.
+  //
+  VALUE_PARAMETER(int32,max_values);
+
  public:
   Statistic() { clear(); }
 
@@ -365,6 +448,8 @@ class Statistic {
     clear_sum();
     clear_ssum();
     clear_values();
+    clear_m2();
+    clear_max_values();
   }
 
   void CopyFrom(const Statistic& other) {
@@ -373,6 +458,17 @@ class Statistic {
     VALUE_COPY(double,sum);
     VALUE_COPY(double,ssum);
     VECTOR_COPY(double,values);
+    VALUE_COPY(double,m2);
+    VALUE_COPY(int32,max_values);
+  }
+
+  void Swap(Statistic* other) {
+    VALUE_SWAP(int32,count);
+    VALUE_SWAP(double,sum);
+    VALUE_SWAP(double,ssum);
+    VECTOR_SWAP(double,values);
+    VALUE_SWAP(double,m2);
+    VALUE_SWAP(int32,max_values);
   }
 
   friend class boost::serialization::access;
@@ -383,17 +479,31 @@ class Statistic {
     VALUE_SERIALIZE(double,sum);
     VALUE_SERIALIZE(double,ssum);
     VECTOR_SERIALIZE(double,values);
+    if (2 <= version) {
+      VALUE_SERIALIZE(double,m2);
+      VALUE_SERIALIZE(int32,max_values);
+    }
   }
 };
 
 // Histogram holds a histogram.  Note that it stores the statistics
 // for the values in each bin when multiple Histogram results are
-// combined.  So mean(histogram[i]) would report the mean value
+// combined.  So mean(histogram.values(i)) would report the mean value
 // for all the histogram values in bucket i.
 //
+// The statistics are stored densely, as one array per moment, and
+// every bucket has count values: a histogram with fewer buckets than
+// another counts as zero in the buckets it lacks.
+//
 class Histogram {
-  // Array of the statistics for each bucket.
-  VECTOR_PARAMETER(Statistic,values);
+  // Number of histograms summed.
+  VALUE_PARAMETER(int32,count);
+
+  // Summation of the values in each bucket.
+  VECTOR_PARAMETER(double,sum);
+
+  // Summation of the squared values in each bucket.
+  VECTOR_PARAMETER(double,ssum);
 
  public:
   Histogram() { clear(); }
@@ -401,18 +511,63 @@ class Histogram {
   void Clear() { clear(); }
 
   void clear() {
-    clear_values();
+    clear_count();
+    clear_sum();
+    clear_ssum();
   }
 
   void CopyFrom(const Histogram& other) {
     clear();
-    VECTOR_COPY_CLASS(Statistic,values);
+    VALUE_COPY(int32,count);
+    VECTOR_COPY(double,sum);
+    VECTOR_COPY(double,ssum);
+  }
+
+  void Swap(Histogram* other) {
+    VALUE_SWAP(int32,count);
+    VECTOR_SWAP(double,sum);
+    VECTOR_SWAP(double,ssum);
+  }
+
+  // Add zero buckets, if necessary, so there are at least size buckets
+  void Reserve(int32 size) {
+    if (sum_.size() < size) {
+      sum_.resize(size, 0.0);
+      ssum_.resize(size, 0.0);
+    }
+  }
+
+  // The number of buckets
+  int32 values_size() const { return sum_.size(); }
+
+  // The statistics of the values in bucket i, without the values
+  Statistic values(int32 i) const {
+    Statistic stat;
+    stat.set_count(count_);
+    stat.set_sum(sum_[i]);
+    stat.set_ssum(ssum_[i]);
+    return stat;
   }
+
   friend class boost::serialization::access;
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version)
   {
-    VECTOR_SERIALIZE(Statistic,values);
+    if (version < 3) {
+      // A Statistic per bucket
+      vector<Statistic> values;
+      ar & values;
+      clear();
+      for (int32 i = 0; i < values.size(); ++i) {
+        set_count(values[i].count());
+        add_sum(values[i].sum());
+        add_ssum(values[i].ssum());
+      }
+      return;
+    }
+    VALUE_SERIALIZE(int32,count);
+    VECTOR_SERIALIZE(double,sum);
+    VECTOR_SERIALIZE(double,ssum);
   }
 };
 
@@ -440,6 +595,28 @@ class NeuronStatistics {
   //
   VALUE_PARAMETER_CLASS(Statistic,false_count);
 
+  // Statistics of the effective number of test words behind false_true.
+  // This equals false_count for uniform sampling, and is the Kish
+  // effective sample size for importance sampling.
+  //
+  VALUE_PARAMETER_CLASS(Statistic,false_effective_count);
+
+  // Statistics of the lower and upper bounds on false_true computed by
+  // the EXACT estimators.
+  //
+  VALUE_PARAMETER_CLASS(Statistic,false_true_lower);
+  VALUE_PARAMETER_CLASS(Statistic,false_true_upper);
+
+  // Statistics of the uniformly sampled false_true, when cross-checking
+  // the EXACT estimator.
+  //
+  VALUE_PARAMETER_CLASS(Statistic,false_true_sampled);
+
+  // Statistics of the fraction of uniformly sampled test words that
+  // Neuron::Expose() rejected by their total strength alone.
+  //
+  VALUE_PARAMETER_CLASS(Statistic,false_rejected);
+
   // Statistics of the probability that the neuron will not fire,
   // given that the word was supposed to have been learned by the neuron.
   //
@@ -508,6 +685,11 @@ class NeuronStatistics {
     clear_false_false();
     clear_false_true();
     clear_false_count();
+    clear_false_effective_count();
+    clear_false_true_lower();
+    clear_false_true_upper();
+    clear_false_true_sampled();
+    clear_false_rejected();
     clear_true_false();
     clear_true_true();
     clear_true_count();
@@ -532,6 +714,11 @@ class NeuronStatistics {
     VALUE_COPY_CLASS(Statistic,false_false);
     VALUE_COPY_CLASS(Statistic,false_true);
     VALUE_COPY_CLASS(Statistic,false_count);
+    VALUE_COPY_CLASS(Statistic,false_effective_count);
+    VALUE_COPY_CLASS(Statistic,false_true_lower);
+    VALUE_COPY_CLASS(Statistic,false_true_upper);
+    VALUE_COPY_CLASS(Statistic,false_true_sampled);
+    VALUE_COPY_CLASS(Statistic,false_rejected);
     VALUE_COPY_CLASS(Statistic,true_false);
     VALUE_COPY_CLASS(Statistic,true_true);
     VALUE_COPY_CLASS(Statistic,true_count);
@@ -549,6 +736,35 @@ class NeuronStatistics {
     VALUE_COPY_CLASS(Histogram,synapse_before_delay_histogram);
     VALUE_COPY_CLASS(Histogram,synapse_after_delay_histogram);
   }
+
+  void Swap(NeuronStatistics* other) {
+    VALUE_SWAP_CLASS(TrainConfig,config);
+    VALUE_SWAP_CLASS(Statistic,false_false);
+    VALUE_SWAP_CLASS(Statistic,false_true);
+    VALUE_SWAP_CLASS(Statistic,false_count);
+    VALUE_SWAP_CLASS(Statistic,false_effective_count);
+    VALUE_SWAP_CLASS(Statistic,false_true_lower);
+    VALUE_SWAP_CLASS(Statistic,false_true_upper);
+    VALUE_SWAP_CLASS(Statistic,false_true_sampled);
+    VALUE_SWAP_CLASS(Statistic,false_rejected);
+    VALUE_SWAP_CLASS(Statistic,true_false);
+    VALUE_SWAP_CLASS(Statistic,true_true);
+    VALUE_SWAP_CLASS(Statistic,true_count);
+    VALUE_SWAP_CLASS(Statistic,q_after);
+    VALUE_SWAP_CLASS(Statistic,synapses_per_neuron);
+    VALUE_SWAP_CLASS(Statistic,bits_per_neuron);
+    VALUE_SWAP_CLASS(Statistic,bits_per_neuron_per_refractory_period);
+    VALUE_SWAP_CLASS(Statistic,mutual_information);
+    VALUE_SWAP_CLASS(Statistic,d_effective);
+    VALUE_SWAP_CLASS(Histogram,delay_histogram);
+    VALUE_SWAP_CLASS(Histogram,input_delay_histogram);
+    VALUE_SWAP_CLASS(Histogram,input_max_sum_delay_histogram);
+    VALUE_SWAP_CLASS(Histogram,h_histogram);
+    VALUE_SWAP_CLASS(Histogram,word_delay_histogram);
+    VALUE_SWAP_CLASS(Histogram,synapse_before_delay_histogram);
+    VALUE_SWAP_CLASS(Histogram,synapse_after_delay_histogram);
+  }
+
   friend class boost::serialization::access;
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version)
@@ -557,6 +773,10 @@ class NeuronStatistics {
     VALUE_SERIALIZE(Statistic,false_false);
     VALUE_SERIALIZE(Statistic,false_true);
     VALUE_SERIALIZE(Statistic,false_count);
+    VALUE_SERIALIZE(Statistic,false_effective_count);
+    VALUE_SERIALIZE(Statistic,false_true_lower);
+    VALUE_SERIALIZE(Statistic,false_true_upper);
+    VALUE_SERIALIZE(Statistic,false_true_sampled);
     VALUE_SERIALIZE(Statistic,true_false);
     VALUE_SERIALIZE(Statistic,true_true);
     VALUE_SERIALIZE(Statistic,true_count);
@@ -573,6 +793,9 @@ class NeuronStatistics {
     VALUE_SERIALIZE(Histogram,word_delay_histogram);
     VALUE_SERIALIZE(Histogram,synapse_before_delay_histogram);
     VALUE_SERIALIZE(Histogram,synapse_after_delay_histogram);
+    if (5 <= version) {
+      VALUE_SERIALIZE(Statistic,false_rejected);
+    }
   }
 };
 
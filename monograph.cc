@@ -18,8 +18,14 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <map>
+
+#include "archive.h"
 #include "cognon.h"
+#include "cognon_stats.h"
 #include "monograph.h"
+#include "optimize.h"
 
 #include "alice.h"
 #include "bob.h"
@@ -27,7 +33,69 @@
 
 namespace cognon {
 
+static int32 false_positive_estimator = TrainConfig::UNIFORM_SAMPLING;
+static int32 search_algorithm = GRID_SEARCH;
+static bool surrogate = false;
+static bool print_fast_rejections = false;
+
+// The optimum found by the last OptimizeRow(), and the S it was found
+// for, which warm-start a successive halving OptimizeRow().
+//
+static TrainConfig previous_optimum;
+static int32 previous_S = -1;
+
+// The shard of the table rows' repetitions to run, where to write the
+// rows, and the number of rows (including headers) so far.
+//
+static int32 table_shard = 0;
+static int32 table_num_shards = 1;
+static RecordWriter* table_shard_output = NULL;
+static int32 table_row = 0;
+
+void SetTableShard(int32 shard, int32 num_shards, RecordWriter* output) {
+  CHECK(0 <= shard && shard < num_shards);
+  table_shard = shard;
+  table_num_shards = num_shards;
+  table_shard_output = output;
+  table_row = 0;
+}
+
+// Each shard record is the row number, the shard, the number of shards,
+// whether the row is a header, and the row's partial result.
+//
+static void WriteTableShard(bool header, const NeuronStatistics& result) {
+  string record;
+  OutputArchive out(&record);
+  out & table_row;
+  out & table_shard;
+  out & table_num_shards;
+  out & header;
+  out & result;
+  CHECK(table_shard_output->Write(record));
+  ++table_row;
+}
+
+void SetFalsePositiveEstimator(int32 estimator) {
+  false_positive_estimator = estimator;
+}
+
+void SetPrintFastRejections(bool enabled) {
+  print_fast_rejections = enabled;
+}
+
+void SetSearchAlgorithm(int32 algorithm) {
+  search_algorithm = algorithm;
+}
+
+void SetSurrogate(bool enabled) {
+  surrogate = enabled;
+}
+
 void PrintTableHeader() {
+  if (table_shard_output != NULL) {
+    WriteTableShard(true, NeuronStatistics());
+    return;
+  }
   printf("\"W\",\"num active\","
          "\"C\",\"D1\",\"D2\",\"H\",\"Q\",\"R\",\"G_m\",\"H_m\",\"spn\","
          "\"pL\",\"pL stddev\",\"pF\",\"pF stddev\","
@@ -43,15 +111,20 @@ void PrintTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
   TrainConfig config;
   NeuronStatistics result;
 
+  if (table_shard_output != NULL) {
+    SetTableConfig(W, active, C, D1, D2, H, Q, R, G_m, H_m, &config);
+    RunConfigurationShard(kTableRepetitions, config,
+                          table_row, table_shard, table_num_shards, &result);
+    WriteTableShard(false, result);
+    return;
+  }
   RunTableRow(W, active, C, D1, D2, H, Q, R, G_m, H_m, &config, &result);
   PrintTableResults(result);
 }
 
-void RunTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
-                 double H, double Q, int32 R, double G_m, double H_m,
-                 TrainConfig* config, NeuronStatistics* result) {
-  const int32 repetitions = 10;
-
+void SetTableConfig(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                    double H, double Q, int32 R, double G_m, double H_m,
+                    TrainConfig* config) {
   // Training parameters
   config->set_w(W);
   if (0 < active) config->set_num_active(active);
@@ -70,86 +143,546 @@ void RunTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
     config->mutable_config()->set_h_m(H_m);
   }
 
-  RunConfiguration(repetitions, *config, result);
+  if (false_positive_estimator != TrainConfig::UNIFORM_SAMPLING)
+    config->set_false_positive_estimator(false_positive_estimator);
+}
+
+void RunTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                 double H, double Q, int32 R, double G_m, double H_m,
+                 TrainConfig* config, NeuronStatistics* result) {
+  SetTableConfig(W, active, C, D1, D2, H, Q, R, G_m, H_m, config);
+  RunConfiguration(kTableRepetitions, *config, result);
+}
+
+void PrintTableRows(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                    double H, const vector<double>& Q, int32 R, double G_m,
+                    const vector<double>& H_m) {
+  if (G_m <= 0.0 || H_m.size() <= 1
+      || false_positive_estimator != TrainConfig::UNIFORM_SAMPLING) {
+    for (int32 i = 0; i < H_m.size(); ++i) {
+      for (int32 q = 0; q < Q.size(); ++q) {
+        PrintTableRow(W, active, C, D1, D2, H, Q[q], R, G_m, H_m[i]);
+      }
+    }
+    return;
+  }
+
+  // Run every Q before printing any row, to print them by H_m first
+  TrainConfig config;
+  vector<vector<NeuronStatistics> > results(Q.size());
+  for (int32 q = 0; q < Q.size(); ++q) {
+    RunTableRows(W, active, C, D1, D2, H, Q[q], R, G_m, H_m, &config,
+                 &results[q]);
+  }
+  for (int32 i = 0; i < H_m.size(); ++i) {
+    for (int32 q = 0; q < Q.size(); ++q) {
+      if (table_shard_output != NULL) {
+        WriteTableShard(false, results[q][i]);
+      } else {
+        PrintTableResults(results[q][i]);
+      }
+    }
+  }
+}
+
+void RunTableRows(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                  double H, double Q, int32 R, double G_m,
+                  const vector<double>& H_m,
+                  TrainConfig* config, vector<NeuronStatistics>* results) {
+  CHECK(0.0 < G_m && 0 < H_m.size());
+  vector<double> thresholds(H_m);
+  for (int32 i = 0; i < thresholds.size(); ++i) {
+    if (thresholds[i] < 0.0) thresholds[i] = H * G_m;
+  }
+  SetTableConfig(W, active, C, D1, D2, H, Q, R, G_m, thresholds[0], config);
+  if (table_shard_output != NULL) {
+    // The rows share their neurons, and so the first row's shard
+    RunThresholdConfigurationShard(kTableRepetitions, *config, thresholds,
+                                   table_row, table_shard, table_num_shards,
+                                   results);
+    return;
+  }
+  RunThresholdConfiguration(kTableRepetitions, *config, thresholds,
+                            results);
+}
+
+// A table row being merged from its shards
+struct MergedRow {
+  bool header;
+  NeuronStatistics result;
+  vector<bool> shards;
+};
+
+bool MergeTableShards(const vector<string>& filenames) {
+  map<int32, MergedRow> rows;
+  int32 num_shards = -1;
+  for (int32 f = 0; f < filenames.size(); ++f) {
+    RecordReader reader;
+    if (!reader.Open(filenames[f])) {
+      fprintf(stderr, "Cannot read shard %s\n", filenames[f].c_str());
+      return false;
+    }
+    const char* data;
+    size_t size;
+    while (reader.Next(&data, &size)) {
+      int32 row, shard, shards;
+      bool header;
+      NeuronStatistics result;
+      InputArchive in(data, size, reader.version());
+      in & row;
+      in & shard;
+      in & shards;
+      in & header;
+      in & result;
+      if (!in.ok() || in.position() != size || row < 0
+          || shard < 0 || shards <= shard
+          || (0 <= num_shards && shards != num_shards)) {
+        fprintf(stderr, "Bad record in shard %s\n", filenames[f].c_str());
+        return false;
+      }
+      num_shards = shards;
+
+      MergedRow& merged = rows[row];
+      if (merged.shards.size() == 0) {
+        merged.header = header;
+        merged.shards.resize(num_shards, false);
+        merged.result.mutable_config()->CopyFrom(result.config());
+      }
+      if (merged.shards[shard]) {
+        fprintf(stderr, "Row %d of shard %d is repeated in %s\n",
+                row, shard, filenames[f].c_str());
+        return false;
+      }
+      merged.shards[shard] = true;
+      merged.result += result;
+    }
+    if (reader.bad_tail()) {
+      fprintf(stderr, "Shard %s is incomplete\n", filenames[f].c_str());
+      return false;
+    }
+  }
+
+  // Every row must have every shard, with no rows missing
+  int32 next = 0;
+  for (map<int32, MergedRow>::const_iterator it = rows.begin();
+       it != rows.end(); ++it, ++next) {
+    if (it->first != next
+        || count(it->second.shards.begin(), it->second.shards.end(), true)
+        != num_shards) {
+      fprintf(stderr, "Row %d is missing from some shards\n", next);
+      return false;
+    }
+  }
+
+  RecordWriter* output = table_shard_output;
+  table_shard_output = NULL;
+  for (map<int32, MergedRow>::const_iterator it = rows.begin();
+       it != rows.end(); ++it) {
+    if (it->second.header) {
+      PrintTableHeader();
+    } else {
+      PrintTableResults(it->second.result);
+    }
+  }
+  table_shard_output = output;
+  return true;
 }
 
 void PrintTableResults(const NeuronStatistics& result) {
-  printf("%d,", result.config().w());
+  string output;
+  FormatTableResults(result, &output);
+  fputs(output.c_str(), stdout);
+  fflush(stdout);
+}
+
+void FormatTableResults(const NeuronStatistics& result, string* output) {
+  string& out = *output;
+  out += StringPrintf("%d,", result.config().w());
 
   if (result.config().has_num_active()) {
-    printf("%d,", result.config().num_active());
+    out += StringPrintf("%d,", result.config().num_active());
   } else {
-    printf("-1,");
+    out += "-1,";
   }
 
-  printf("%d,", result.config().config().c());
-  printf("%d,", result.config().config().d1());
-  printf("%d,", result.config().config().d2());
-  printf("%f,", result.config().config().h());
-  printf("%f,", result.config().config().q());
-  printf("%d,", result.config().config().r());
+  out += StringPrintf("%d,", result.config().config().c());
+  out += StringPrintf("%d,", result.config().config().d1());
+  out += StringPrintf("%d,", result.config().config().d2());
+  out += StringPrintf("%f,", result.config().config().h());
+  out += StringPrintf("%f,", result.config().config().q());
+  out += StringPrintf("%d,", result.config().config().r());
 
   if (result.config().config().has_g_m()) {
-    printf("%f,", result.config().config().g_m());
+    out += StringPrintf("%f,", result.config().config().g_m());
   } else {
-    printf("-1.0,");
+    out += "-1.0,";
   }
 
   if (result.config().config().has_h_m()) {
-    printf("%f,", result.config().config().h_m());
+    out += StringPrintf("%f,", result.config().config().h_m());
   } else {
-    printf("-1.0,");
+    out += "-1.0,";
   }
 
-  printf("%f,", Mean(result.synapses_per_neuron()));
+  out += StringPrintf("%f,", Mean(result.synapses_per_neuron()));
 
-  printf("%f,", Mean(result.true_true()));
-  printf("%f,", Stddev(result.true_true()));
+  out += StringPrintf("%f,", Mean(result.true_true()));
+  out += StringPrintf("%f,", Stddev(result.true_true()));
 
-  printf("%f,", Mean(result.false_true()));
-  printf("%f,", Stddev(result.false_true()));
+  out += StringPrintf("%f,", Mean(result.false_true()));
+  out += StringPrintf("%f,", Stddev(result.false_true()));
 
-  printf("%f,", Mean(result.bits_per_neuron()));
-  printf("%f,", Stddev(result.bits_per_neuron()));
+  out += StringPrintf("%f,", Mean(result.bits_per_neuron()));
+  out += StringPrintf("%f,", Stddev(result.bits_per_neuron()));
 
   double spn = Mean(result.synapses_per_neuron());
-  printf("%f,", Mean(result.bits_per_neuron()) / spn);
-  printf("%f,", Stddev(result.bits_per_neuron()) / spn);
+  out += StringPrintf("%f,", Mean(result.bits_per_neuron()) / spn);
+  out += StringPrintf("%f,", Stddev(result.bits_per_neuron()) / spn);
+
+  out += StringPrintf("%f,", Mean(result.q_after()) * spn);
+  out += StringPrintf("%f,", Stddev(result.q_after()) * spn);
+
+  out += StringPrintf("%f,",
+                      result.config().config().r() * Mean(result.true_true()));
+  out += StringPrintf("%f,", result.config().config().r()
+                      * Stddev(result.true_true()));
+
+  out += StringPrintf("%f,", Mean(result.d_effective()));
+  out += StringPrintf("%f", Stddev(result.d_effective()));
+
+  out += "\n";
+
+  // Estimators other than uniform sampling also report how much their
+  // false positive estimate can be trusted.
+  //
+  int32 estimator = result.config().false_positive_estimator();
+  if (estimator == TrainConfig::IMPORTANCE_SAMPLING) {
+    out += StringPrintf("# pF effective sample size %f, stddev %f\n",
+                        Mean(result.false_effective_count()),
+                        Stddev(result.false_effective_count()));
+  }
+  if (estimator == TrainConfig::EXACT
+      || estimator == TrainConfig::EXACT_CROSS_CHECK) {
+    out += StringPrintf("# pF lower bound %g, upper bound %g\n",
+                        Mean(result.false_true_lower()),
+                        Mean(result.false_true_upper()));
+  }
+  if (estimator == TrainConfig::EXACT_CROSS_CHECK) {
+    out += StringPrintf("# pF sampled %f, stddev %f\n",
+                        Mean(result.false_true_sampled()),
+                        Stddev(result.false_true_sampled()));
+  }
+  // Uniform sampling can report how many test words were rejected
+  // without summing any slot
+  //
+  if (print_fast_rejections && 0 < result.false_rejected().count()) {
+    out += StringPrintf("# pF fast rejected %f\n",
+                        Mean(result.false_rejected()));
+  }
+}
+
+// Append text to output, or print it if output is NULL
+static void Emit(const string& text, string* output) {
+  if (output != NULL) {
+    *output += text;
+  } else {
+    fputs(text.c_str(), stdout);
+    fflush(stdout);
+  }
+}
+
+// The grid walk over G_m, Q and w, stopping early along each axis.
+// Each w depends on the results before it, so every batch is a single
+// configuration; the walk's loops are unrolled into a state machine
+// that Advance() runs until the next configuration is chosen.  With
+// the surrogate, a configuration predicted to be hopeless is walked
+// past on its prediction without being simulated.
+//
+class GridRowSearch : public RowSearch {
+ public:
+  GridRowSearch(double H, int32 S, int32 C, int32 D1, int32 D2,
+                double G_max, double G_step, string* output);
+  virtual ~GridRowSearch() { }
+
+  virtual bool Step(vector<TrainConfig>* configs, double* fidelity);
+  virtual void Resume(const vector<NeuronStatistics>& results);
+
+  virtual double bpn() const { return optimal_bpn_; }
+  virtual const NeuronStatistics& optimal() const { return optimal_; }
+
+ private:
+  enum State {
+    START_G,  // Begin the Q loop for G_m_
+    START_Q,  // Begin the w loop for Q_, if it gives a new R
+    RUN_W,    // Evaluate w_
+    END_Q,    // Finished the w loop for Q_
+    END_G,    // Finished the Q loop for G_m_
+    DONE
+  };
+
+  void Advance();
+
+  // Record result for w_ and move on to the next w, or end the w loop
+  void Record(const NeuronStatistics& result, bool predicted);
+
+  // Whether the surrogate lets the walk skip simulating config_
+  bool Prune();
+
+  double H_;
+  int32 S_, C_, D1_, D2_;
+  double G_step_;
+  string* output_;
+  State state_;
+
+  double optimal_bpn_;
+  NeuronStatistics optimal_;
+  double optimal_Q_;
+
+  // The G_m loop
+  double G_m_;
+  double H_m_;
+  double best_bpn_G_;
+  double best_pL_G_;
+  double best_pF_G_;
+  int32 last_R_;
+  bool G_had_optimal_result_;
+
+  // The Q loop
+  double Q_;
+  bool Q_had_optimal_result_;
+  double max_bpn_;
+  double max_pL_;
+  double min_pF_;
+  int32 R_;
+  double Q_actual_;
+
+  // The w loop
+  int32 w_;
+  TrainConfig config_;
+
+  RowConstraint constraint_;
+  bool has_prediction_;
+  NeuronStatistics prediction_;
+  PredictionError error_;
+};
+
+GridRowSearch::GridRowSearch(double H, int32 S, int32 C, int32 D1, int32 D2,
+                             double G_max, double G_step, string* output)
+    : H_(H), S_(S), C_(C), D1_(D1), D2_(D2), G_step_(G_step),
+      output_(output), state_(START_G), optimal_bpn_(-1.0),
+      optimal_Q_(2.0 * D1), G_m_(G_max), has_prediction_(false) {
+  Advance();
+}
 
-  printf("%f,", Mean(result.q_after()) * spn);
-  printf("%f,", Stddev(result.q_after()) * spn);
+bool GridRowSearch::Step(vector<TrainConfig>* configs, double* fidelity) {
+  if (state_ == DONE) return false;
+  configs->resize(1);
+  (*configs)[0].CopyFrom(config_);
+  *fidelity = 1.0;
+  return true;
+}
 
-  printf("%f,", result.config().config().r() * Mean(result.true_true()));
-  printf("%f,", result.config().config().r() * Stddev(result.true_true()));
+void GridRowSearch::Resume(const vector<NeuronStatistics>& results) {
+  CHECK(state_ == RUN_W && results.size() == 1);
+  if (has_prediction_) error_.Add(prediction_, results[0]);
+  Record(results[0], false);
+  Advance();
+}
 
-  printf("%f,", Mean(result.d_effective()));
-  printf("%f", Stddev(result.d_effective()));
+bool GridRowSearch::Prune() {
+  has_prediction_ = (surrogate
+                     && PredictConfiguration(config_, &prediction_));
+  if (!has_prediction_ || !constraint_.Hopeless(prediction_)) return false;
 
-  printf("\n");
-  fflush(stdout);
+  error_.AddPruned();
+  Record(prediction_, true);
+  return true;
 }
 
-double OptimizeRow(double H, int32 S, int32 C, int32 D1, int32 D2,
-                   double G_max, double G_step) {
-  double optimal_bpn = -1.0;
-  NeuronStatistics optimal;
-  NeuronStatistics result;
-  TrainConfig config;
-  double optimal_Q = 2.0 * D1;
+void GridRowSearch::Record(const NeuronStatistics& result, bool predicted) {
+  double bpn = Mean(result.bits_per_neuron());
+  double d_eff = Mean(result.d_effective());
+  double pL = Mean(result.true_true());
+  double pF = Mean(result.false_true());
+
+  if (max_pL_ < pL) max_pL_ = pL;
+  if (pF < min_pF_) min_pF_ = pF;
+
+  string line;
+  FormatTableResults(result, &line);
+  if (predicted) {
+    Emit("# predicted " + line, output_);
+  } else if (0.4 < d_eff && pF < pL && pF < 0.03 && optimal_bpn_ < bpn) {
+    optimal_.CopyFrom(result);
+    optimal_bpn_ = Mean(optimal_.bits_per_neuron());
+    Emit("# optimal " + line, output_);
+    Q_had_optimal_result_ = true;
+    G_had_optimal_result_ = true;
+    optimal_Q_ = Q_;
+  } else {
+    Emit("# " + line, output_);
+  }
+
+  state_ = END_Q;
+  if (0.0 < max_bpn_
+      && ((bpn < 0.9 * max_bpn_ && bpn < optimal_bpn_)
+          || (bpn < 0.1 * max_bpn_ && optimal_bpn_ < 0.0))) {
+    // Early stop due to declining bpn
+  } else if (pL < kEpsilon) {
+    // Early stop due to not learning
+  } else if (0.1 < pF || pL < pF) {
+    // Early stop due to too many false positives
+  } else if (bpn <= 0.0) {
+    // Early stop due to no learned information
+  } else {
+    if (max_bpn_ < bpn) max_bpn_ = bpn;
+    w_ += (w_ < 100 ? 10 : (w_ < 1000 ? 100 : 1000));
+    state_ = RUN_W;
+  }
+}
+
+void GridRowSearch::Advance() {
+  for (;;) {
+    switch (state_) {
+      case START_G:
+        if (G_m_ < 1.0) {
+          state_ = DONE;
+          break;
+        }
+        H_m_ = (double)H_ * G_m_;
+        best_bpn_G_ = -1.0;
+        best_pL_G_ = -1.0;
+        best_pF_G_ = 100.0;
+        last_R_ = -1;
+        G_had_optimal_result_ = false;
+        Q_ = min(2.0 * D1_, optimal_Q_ + (2.0 * D1_) / 10.0);
+        state_ = START_Q;
+        break;
+
+      case START_Q:
+        if (Q_ <= 0.5) {
+          state_ = END_G;
+          break;
+        }
+        Q_had_optimal_result_ = false;
+        max_bpn_ = -1.0;
+        max_pL_ = -1.0;
+        min_pF_ = 100.0;
+        R_ = static_cast<int32>(floor(S_ / (C_ * H_ * Q_) + kEpsilon));
+        if (R_ <= 1 || 400 < R_ || R_ == last_R_) {
+          Q_ -= static_cast<double>(D1_) / 10.0;
+          break;
+        }
+        last_R_ = R_;
+        Q_actual_ = S_ / static_cast<double>(C_ * H_ * R_);
+        w_ = 10;
+        state_ = RUN_W;
+        break;
+
+      case RUN_W:
+        if (10000 < w_) {
+          state_ = END_Q;
+          break;
+        }
+        config_.clear();
+        SetTableConfig(w_, -1, C_, D1_, D2_, H_, Q_actual_, R_, G_m_, H_m_,
+                       &config_);
+        if (Prune()) break;
+        return;
+
+      case END_Q:
+        if (best_pL_G_ < max_pL_) best_pL_G_ = max_pL_;
+        if (best_bpn_G_ < max_bpn_) best_bpn_G_ = max_bpn_;
+        if (min_pF_ < best_pF_G_) best_pF_G_ = min_pF_;
+
+        state_ = END_G;
+        if (max_pL_ < kEpsilon) break;  // Early stop on Q due to not learning
+        if (0.0 < optimal_bpn_
+            && max_pL_ < min_pF_) break;  // Early stop on Q due to bad
+                                          // learning
+        if (0.0 < optimal_bpn_
+            && Q_ < optimal_Q_
+            && !Q_had_optimal_result_) break;  // Early stop on Q due to
+                                               // declining learning
+                                               // performance
+        Q_ -= static_cast<double>(D1_) / 10.0;
+        state_ = START_Q;
+        break;
+
+      case END_G:
+        state_ = DONE;
+        if (best_bpn_G_ < 0.7 * optimal_bpn_) break;  // Early stop on G
+        if (best_pL_G_ < kEpsilon) break;  // Early stop on G due to not
+                                           // learning
+        if (0.0 < optimal_bpn_
+            && !G_had_optimal_result_) break;  // Early stop for G since
+                                               // performance is
+                                               // decreasing, not improving
+        G_m_ -= G_step_;
+        state_ = START_G;
+        break;
+
+      case DONE:
+        if (surrogate) Emit(error_.ToString(), output_);
+        if (0.0 < optimal_bpn_) {
+          string line;
+          FormatTableResults(optimal_, &line);
+          Emit(line, output_);
+        }
+        return;
+    }
+  }
+}
+
+// OptimizeRow() by successive halving over the same grid that the grid
+// walk explores, starting from the warm start when it is for the same
+// C, D1 and D2.
+//
+class HalvingRowSearch : public RowSearch {
+ public:
+  HalvingRowSearch(double H, int32 S, int32 C, int32 D1, int32 D2,
+                   double G_max, double G_step,
+                   const TrainConfig* warm_start, string* output);
+  virtual ~HalvingRowSearch() { }
+
+  virtual bool Step(vector<TrainConfig>* configs, double* fidelity);
+  virtual void Resume(const vector<NeuronStatistics>& results) {
+    search_.Resume(results);
+  }
+
+  virtual double bpn() const { return optimal_bpn_; }
+  virtual const NeuronStatistics& optimal() const { return optimal_; }
+
+ private:
+  RowConstraint constraint_;
+  SuccessiveHalving search_;
+  int32 num_candidates_;
+  string* output_;
+  bool done_;
+
+  double optimal_bpn_;
+  NeuronStatistics optimal_;
+};
+
+HalvingRowSearch::HalvingRowSearch(double H, int32 S, int32 C,
+                                   int32 D1, int32 D2,
+                                   double G_max, double G_step,
+                                   const TrainConfig* warm_start,
+                                   string* output)
+    : constraint_(), search_(kTableRepetitions, &constraint_),
+      output_(output), done_(false), optimal_bpn_(-1.0) {
+  vector<TrainConfig> candidates;
+  int32 warm_index = -1;
+  double warm_distance = 0.0;
+  bool warm = (warm_start != NULL
+               && warm_start->config().c() == C
+               && warm_start->config().d1() == D1
+               && warm_start->config().d2() == D2);
 
   for (double G_m = G_max; 1.0 <= G_m; G_m -= G_step) {
     double H_m = (double)H * G_m;
-    double best_bpn_G = -1.0;
-    double best_pL_G = -1.0;
-    double best_pF_G = 100.0;
     int32 last_R = -1;
-    bool G_had_optimal_result = false;
-    double Q = min(2.0 * D1, optimal_Q + (2.0 * D1) / 10.0);
-    for (; 0.5 < Q; Q -= static_cast<double>(D1) / 10.0) {
-      bool Q_had_optimal_result = false;
-      double max_bpn = -1.0;
-      double max_pL = -1.0;
-      double min_pF = 100.0;
+    for (double Q = 2.0 * D1; 0.5 < Q; Q -= static_cast<double>(D1) / 10.0) {
       int32 R = static_cast<int32>(floor(S / (C * H * Q) + kEpsilon));
 
       if (R <= 1 || 400 < R || R == last_R)
@@ -159,67 +692,78 @@ double OptimizeRow(double H, int32 S, int32 C, int32 D1, int32 D2,
       double Q_actual = S / static_cast<double>(C * H * R);
       for (int32 w = 10; w <= 10000;
            w += (w < 100 ? 10 : (w < 1000 ? 100 : 1000))) {
-        config.clear();
-        result.clear();
-
-        RunTableRow(w, -1, C, D1, D2, H, Q_actual, R, G_m, H_m,
-                    &config, &result);
-
-        double rpl = result.config().config().r() * Mean(result.true_true());
-        double bpn = Mean(result.bits_per_neuron());
-        double d_eff = Mean(result.d_effective());
-        double pL = Mean(result.true_true());
-        double pF = Mean(result.false_true());
-
-        if (max_pL < pL) max_pL = pL;
-        if (pF < min_pF) min_pF = pF;
-
-        if (0.4 < d_eff && pF < pL && pF < 0.03 && optimal_bpn < bpn) {
-          optimal.CopyFrom(result);
-          optimal_bpn = Mean(optimal.bits_per_neuron());
-          printf("# optimal "); PrintTableResults(result);
-          Q_had_optimal_result = true;
-          G_had_optimal_result = true;
-          optimal_Q = Q;
-        } else {
-          printf("# "); PrintTableResults(result);
+        candidates.resize(candidates.size() + 1);
+        SetTableConfig(w, -1, C, D1, D2, H, Q_actual, R, G_m, H_m,
+                       &candidates.back());
+        if (!warm) continue;
+
+        // Distance in grid steps from the previous optimum
+        double distance =
+            fabs(G_m - warm_start->config().g_m()) / G_step
+            + fabs(Q_actual - warm_start->config().q()) * 10.0 / D1
+            + fabs(log(w / static_cast<double>(warm_start->w())))
+            / log(2.0);
+        if (warm_index < 0 || distance < warm_distance) {
+          warm_index = candidates.size() - 1;
+          warm_distance = distance;
         }
-
-        if (0.0 < max_bpn
-            && ((bpn < 0.9 * max_bpn && bpn < optimal_bpn)
-                || (bpn < 0.1 * max_bpn && optimal_bpn < 0.0)))
-          break;  // Early stop due to declining bpn
-        if (pL < kEpsilon)
-          break;  // Early stop due to not learning
-        if (0.1 < pF || pL < pF)
-          break;  // Early stop due to too many false positives
-        if (bpn <= 0.0)
-          break;  // Early stop due to no learned information
-
-        if (max_bpn < bpn) max_bpn = bpn;
       }
-
-      if (best_pL_G < max_pL) best_pL_G = max_pL;
-      if (best_bpn_G < max_bpn) best_bpn_G = max_bpn;
-      if (min_pF < best_pF_G) best_pF_G = min_pF;
-
-      if (max_pL < kEpsilon) break;  // Early stop on Q due to not learning
-      if (0.0 < optimal_bpn
-          && max_pL < min_pF) break;  // Early stop on Q due to bad learning
-      if (0.0 < optimal_bpn
-          && Q < optimal_Q
-          && !Q_had_optimal_result) break;  // Early stop on Q due to declining
-                                            // learning performance
     }
-    if (best_bpn_G < 0.7 * optimal_bpn) break;  // Early stop on G
-    if (best_pL_G < kEpsilon) break;  // Early stop on G due to not learning
-    if (0.0 < optimal_bpn
-        && !G_had_optimal_result) break;  // Early stop for G since performance
-                                          // is decreasing, not improving
   }
-  if (0.0 < optimal_bpn)
-    PrintTableResults(optimal);
-  return optimal_bpn;
+
+  num_candidates_ = candidates.size();
+  search_.set_surrogate(surrogate);
+  search_.Start(candidates, warm_index);
+}
+
+bool HalvingRowSearch::Step(vector<TrainConfig>* configs, double* fidelity) {
+  if (done_) return false;
+  if (search_.Step(configs, fidelity)) return true;
+
+  done_ = true;
+  const vector<NeuronStatistics>& finalists = search_.finalists();
+  string text;
+  for (int32 i = 0; i < finalists.size(); ++i) {
+    text += "# ";
+    FormatTableResults(finalists[i], &text);
+  }
+  text += StringPrintf("# successive halving: %d candidates, "
+                       "%f full evaluations\n",
+                       num_candidates_, search_.cost());
+  if (surrogate) text += search_.prediction_error().ToString();
+  if (0 <= search_.best()) {
+    optimal_.CopyFrom(search_.optimal());
+    optimal_bpn_ = Mean(optimal_.bits_per_neuron());
+    FormatTableResults(optimal_, &text);
+  }
+  Emit(text, output_);
+  return false;
+}
+
+RowSearch* NewRowSearch(double H, int32 S, int32 C, int32 D1, int32 D2,
+                        double G_max, double G_step,
+                        const TrainConfig* warm_start, string* output) {
+  if (search_algorithm == SUCCESSIVE_HALVING) {
+    return new HalvingRowSearch(H, S, C, D1, D2, G_max, G_step,
+                                warm_start, output);
+  }
+  return new GridRowSearch(H, S, C, D1, D2, G_max, G_step, output);
+}
+
+double OptimizeRow(double H, int32 S, int32 C, int32 D1, int32 D2,
+                   double G_max, double G_step) {
+  scoped_ptr<RowSearch> search(
+      NewRowSearch(H, S, C, D1, D2, G_max, G_step,
+                   (previous_S == S ? &previous_optimum : NULL), NULL));
+  SearchScheduler scheduler(kTableRepetitions);
+  scheduler.AddTask(search.get());
+  scheduler.Run();
+
+  if (0.0 < search->bpn()) {
+    previous_S = S;
+    previous_optimum.CopyFrom(search->optimal().config());
+  }
+  return search->bpn();
 }
 
 void dump_sum(Neuron& neuron, const Word& word) {
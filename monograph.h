@@ -19,9 +19,69 @@
 #define COGNON_MONOGRAPH_H_
 
 #include "cognon.h"
+#include "optimize.h"
 
 namespace cognon {
 
+// The number of neurons trained for each table row
+const int32 kTableRepetitions = 10;
+
+// Select the false positive estimator (TrainConfig::FalsePositiveEstimator)
+// that SetTableConfig() writes into every table row's config, and so the
+// one used by RunTableRow() and everything built on it, including rows
+// built outside this file such as table-2.4's.
+//
+void SetFalsePositiveEstimator(int32 estimator);
+
+// Make PrintTableResults() follow each row whose false positives were
+// uniformly sampled with a "# pF fast rejected" line, giving the
+// fraction of test words that Neuron::Expose() rejected without
+// summing any slot.  Off by default.
+//
+void SetPrintFastRejections(bool enabled);
+
+// The search algorithms OptimizeRow() can use
+enum SearchAlgorithm {
+  // Walk the G_m, Q, and w grid, stopping early along each axis
+  GRID_SEARCH = 0,
+
+  // Screen the whole grid by successive halving (see optimize.h),
+  // warm-started from the previous row's optimum
+  //
+  SUCCESSIVE_HALVING = 1
+};
+
+// Select the search algorithm used by OptimizeRow()
+void SetSearchAlgorithm(int32 algorithm);
+
+// Make OptimizeRow() consult the analytic model (see cognon_stats.h)
+// before simulating each C=D1=D2=1 candidate.  The grid walk stands the
+// prediction in for the simulation of a candidate that RowConstraint
+// finds hopeless, and successive halving drops such candidates before
+// its first rung.  The model's error against the candidates that were
+// simulated is printed with each row.
+//
+void SetSurrogate(bool enabled);
+
+class RecordWriter;
+
+// Make PrintTableHeader(), PrintTableRow() and PrintTableRows() run
+// only shard of num_shards of each row's repetitions (see
+// RunConfigurationShard(); rows are numbered from zero, counting
+// headers) and write each row's partial result to output instead of
+// printing it.  MergeTableShards() adds up the rows of all the shards
+// and prints them.  A NULL output turns sharding off.  The caller
+// retains ownership of output.
+//
+void SetTableShard(int32 shard, int32 num_shards, RecordWriter* output);
+
+// Print the rows written by every shard of a sweep to filenames, as
+// the unsharded sweep would have.  Returns false, having printed
+// nothing, if a shard file is unreadable or any shard of a row is
+// missing or repeated.
+//
+bool MergeTableShards(const vector<string>& filenames);
+
 void PrintTableHeader();
 
 void PrintTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
@@ -32,11 +92,67 @@ void RunTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
                  double H, double Q, int32 R, double G_m, double H_m,
                  TrainConfig* config, NeuronStatistics* result);
 
+// As PrintTableRow() and RunTableRow(), but for a list of
+// synapse-strength thresholds H_m (-1 meaning H * G_m).  Each neuron is
+// trained once and tested at every threshold in a single pass, which
+// requires G_m and uniform false positive sampling; otherwise
+// PrintTableRows() runs each threshold separately.  The rows of one
+// neuron's thresholds are correlated, where separate rows would be
+// independent.
+//
+// PrintTableRows() runs the thresholds for each of a list of Q, and
+// prints the rows ordered by H_m and then Q, as PrintTableRow() would
+// for each H_m and Q in turn.
+//
+void PrintTableRows(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                    double H, const vector<double>& Q, int32 R, double G_m,
+                    const vector<double>& H_m);
+
+void RunTableRows(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                  double H, double Q, int32 R, double G_m,
+                  const vector<double>& H_m,
+                  TrainConfig* config, vector<NeuronStatistics>* results);
+
 void PrintTableResults(const NeuronStatistics& result);
 
+// Append what PrintTableResults() prints to output
+void FormatTableResults(const NeuronStatistics& result, string* output);
+
+// Fill in config for one table row, as RunTableRow() does, including
+// the estimator selected by SetFalsePositiveEstimator()
+//
+void SetTableConfig(int32 W, int32 active, int32 C, int32 D1, int32 D2,
+                    double H, double Q, int32 R, double G_m, double H_m,
+                    TrainConfig* config);
+
 double OptimizeRow(double H, int32 S, int32 C, int32 D1, int32 D2,
                    double G_max, double G_step);
 
+// OptimizeRow() as a resumable search task (see optimize.h), so that
+// many rows can be optimized together on one SearchScheduler with
+// kTableRepetitions.  Progress and the optimal row are appended to
+// output, or printed if output is NULL.
+//
+class RowSearch : public SearchTask {
+ public:
+  virtual ~RowSearch() { }
+
+  // The bits per neuron of the optimal row, or -1.0 if none was found
+  virtual double bpn() const = 0;
+
+  // The optimal row, when bpn() is positive
+  virtual const NeuronStatistics& optimal() const = 0;
+};
+
+// Create a RowSearch using the algorithm selected by
+// SetSearchAlgorithm().  A successive halving search is warm-started
+// from warm_start, the optimal config for another H with the same S,
+// if it is not NULL and has the same C, D1 and D2.
+//
+RowSearch* NewRowSearch(double H, int32 S, int32 C, int32 D1, int32 D2,
+                        double G_max, double G_step,
+                        const TrainConfig* warm_start, string* output);
+
 void DebugTableRow(int32 W, int32 active, int32 C, int32 D1, int32 D2,
                  double H, double Q, int32 R, double G_m, double H_m,
                  TrainConfig* config, NeuronStatistics* result);
@@ -0,0 +1,232 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "network.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "cognon.h"
+#include "neuron.h"
+#include "wordset.h"
+
+namespace cognon {
+
+Network::Network() : inputs_(0), layers_(), random_(NULL) {
+  random_.reset(CreateRandom());
+}
+
+Network::~Network() {
+  for (int32 k = 0; k < layers_.size(); ++k) {
+    for (int32 n = 0; n < layers_[k]->neurons.size(); ++n) {
+      delete layers_[k]->neurons[n];
+    }
+    delete layers_[k];
+  }
+}
+
+void Network::Init(int32 inputs, const vector<NeuronConfig>& configs,
+                   const vector<int32>& sizes) {
+  CHECK(0 < inputs);
+  CHECK(0 < configs.size() && configs.size() == sizes.size());
+  CHECK(layers_.empty());
+
+  inputs_ = inputs;
+  int32 below = inputs;  // The number of sources of the layer
+  for (int32 k = 0; k < configs.size(); ++k) {
+    CHECK(0 < sizes[k]);
+    if (0 < k) {
+      // Every slot of the layer below must be a valid input delay
+      CHECK(configs[k - 1].d1() + configs[k - 1].d2() <= configs[k].d1());
+    }
+    Layer* layer = new Layer;
+    layers_.push_back(layer);
+    layer->neurons.resize(sizes[k]);
+    for (int32 n = 0; n < sizes[k]; ++n) {
+      layer->neurons[n] = new Neuron;
+      layer->neurons[n]->Init(configs[k]);
+    }
+    layer->length = layer->neurons[0]->length();
+
+    // Wire each synapse to a random source, and then list the synapses
+    // each source feeds, in neuron and synapse order
+    //
+    int32 length = layer->length;
+    layer->sources.resize(sizes[k] * length);
+    layer->fanout_start.assign(below + 1, 0);
+    for (int32 i = 0; i < layer->sources.size(); ++i) {
+      layer->sources[i] = random_->Rand32() % below;
+      layer->fanout_start[layer->sources[i] + 1]++;
+    }
+    for (int32 s = 0; s < below; ++s) {
+      layer->fanout_start[s + 1] += layer->fanout_start[s];
+    }
+    vector<int32> next(layer->fanout_start.begin(),
+                       layer->fanout_start.end() - 1);
+    layer->fanout.resize(layer->sources.size());
+    for (int32 i = 0; i < layer->sources.size(); ++i) {
+      layer->fanout[next[layer->sources[i]]++] =
+          make_pair(i / length, i % length);
+    }
+
+    layer->inbox.resize(sizes[k]);
+    layer->slots.assign(sizes[k], kDisabled);
+    below = sizes[k];
+  }
+}
+
+int32 Network::source(int32 layer, int32 n, int32 i) const {
+  const Layer* l = layers_[layer];
+  CHECK(0 <= i && i < l->length);
+  return l->sources[n * l->length + i];
+}
+
+void Network::StartTraining() {
+  for (int32 k = 0; k < layers_.size(); ++k) {
+    for (int32 n = 0; n < layers_[k]->neurons.size(); ++n) {
+      layers_[k]->neurons[n]->StartTraining();
+    }
+  }
+}
+
+void Network::FinishTraining() {
+  for (int32 k = 0; k < layers_.size(); ++k) {
+    for (int32 n = 0; n < layers_[k]->neurons.size(); ++n) {
+      layers_[k]->neurons[n]->FinishTraining();
+    }
+  }
+}
+
+void Network::Expose(const Word& word, vector<Word>* firings) {
+  Propagate(false, word, firings);
+}
+
+void Network::Train(const Word& word, vector<Word>* firings) {
+  Propagate(true, word, firings);
+}
+
+void Network::ExposeStream(const vector<Word>& words,
+                           vector<vector<Word> >* firings) {
+  Stream(false, words, firings);
+}
+
+void Network::TrainStream(const vector<Word>& words,
+                          vector<vector<Word> >* firings) {
+  Stream(true, words, firings);
+}
+
+void Network::Deliver(int32 k, const Word& below) {
+  Layer* layer = layers_[k];
+  for (Word::const_iterator it = below.begin(); it != below.end(); ++it) {
+    int32 s = it->first;
+    CHECK(0 <= s && s + 1 < layer->fanout_start.size());
+    for (int32 f = layer->fanout_start[s]; f < layer->fanout_start[s + 1];
+         ++f) {
+      int32 n = layer->fanout[f].first;
+      if (layer->inbox[n].empty()) layer->touched.push_back(n);
+      layer->inbox[n].push_back(make_pair(layer->fanout[f].second,
+                                          it->second));
+    }
+  }
+}
+
+void Network::Run(bool train, const vector<int32>& active,
+                  vector<Word>* firings) {
+  // The neurons of all of the active layers that received signals, run
+  // together so that small layers share the threads with large ones
+  //
+  vector<pair<int32, int32> > tasks;
+  for (int32 a = 0; a < active.size(); ++a) {
+    const Layer* layer = layers_[active[a]];
+    for (int32 t = 0; t < layer->touched.size(); ++t) {
+      tasks.push_back(make_pair(active[a], layer->touched[t]));
+    }
+  }
+
+  int32 num_tasks = tasks.size();
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int32 t = 0; t < num_tasks; ++t) {
+    Layer* layer = layers_[tasks[t].first];
+    int32 n = tasks[t].second;
+    Neuron* neuron = layer->neurons[n];
+    layer->slots[n] = (train ? neuron->Train(layer->inbox[n])
+                       : neuron->Expose(layer->inbox[n]));
+  }
+
+  for (int32 a = 0; a < active.size(); ++a) {
+    int32 k = active[a];
+    Layer* layer = layers_[k];
+    Word& fired = (*firings)[k];
+    fired.clear();
+    sort(layer->touched.begin(), layer->touched.end());
+    for (int32 t = 0; t < layer->touched.size(); ++t) {
+      int32 n = layer->touched[t];
+      if (layer->slots[n] != kDisabled) {
+        fired.push_back(make_pair(n, layer->slots[n]));
+      }
+      layer->slots[n] = kDisabled;
+      layer->inbox[n].clear();
+    }
+    layer->touched.clear();
+  }
+}
+
+void Network::Propagate(bool train, const Word& word,
+                        vector<Word>* firings) {
+  CHECK_NOTNULL(firings);
+  firings->resize(layers_.size());
+
+  vector<int32> active(1);
+  for (int32 k = 0; k < layers_.size(); ++k) {
+    Deliver(k, (k == 0 ? word : (*firings)[k - 1]));
+    active[0] = k;
+    Run(train, active, firings);
+  }
+}
+
+void Network::Stream(bool train, const vector<Word>& words,
+                     vector<vector<Word> >* firings) {
+  CHECK_NOTNULL(firings);
+  int32 L = layers_.size();
+  int32 T = words.size();
+  firings->resize(T);
+  for (int32 t = 0; t < T; ++t) {
+    (*firings)[t].resize(L);
+  }
+
+  // At step t, layer k handles words[t - k], taking its input from what
+  // layer k - 1 fired at step t - 1
+  //
+  vector<Word> current(L);
+  vector<int32> active;
+  for (int32 step = 0; step < T + L - 1; ++step) {
+    active.clear();
+    for (int32 k = 0; k < L; ++k) {
+      int32 t = step - k;
+      if (t < 0 || T <= t) continue;
+      Deliver(k, (k == 0 ? words[t] : (*firings)[t][k - 1]));
+      active.push_back(k);
+    }
+    Run(train, active, &current);
+    for (int32 a = 0; a < active.size(); ++a) {
+      int32 k = active[a];
+      (*firings)[step - k][k].swap(current[k]);
+    }
+  }
+}
+
+}  // namespace cognon
@@ -0,0 +1,137 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A feed-forward network of Cognon neurons in layers.  Each synapse of
+// a neuron is wired to the axon of a random neuron of the layer below,
+// or to a line of the network's input word for the first layer.  A
+// neuron that fires in slot d sends its signal up its axon with delay
+// d, so each layer's firings are the next layer's input Word, with
+// (neuron, slot) signals, and each layer's D1 must cover the D1 + D2
+// slots of the layer below.
+//
+// Propagation is event driven: each firing is delivered along its
+// axon's fan-out list to the synapses it reaches, and only the neurons
+// that received a signal are exposed, so that a layer costs in
+// proportion to the firings below it rather than to its synapse count.
+// The neurons of a layer run in parallel, and ExposeStream() and
+// TrainStream() pipeline a stream of words through the layers, layer k
+// handling word t while layer k + 1 handles word t - 1.
+//
+// Example:
+//
+// Network network;
+// network.Init(inputs, configs, sizes);
+// network.StartTraining();
+// for (int32 i = 0; i < wordset.size(); ++i) {
+//   network.Train(wordset.get_word(i), &firings);
+// }
+// network.FinishTraining();
+//
+#ifndef COGNON_NETWORK_H_
+#define COGNON_NETWORK_H_
+
+#include <utility>
+#include <vector>
+
+#include "cognon.h"
+#include "neuron.h"
+#include "wordset.h"
+
+namespace cognon {
+
+class Network {
+ public:
+  Network();
+  ~Network();
+
+  // Build one layer of sizes[k] neurons of configs[k] for each k, the
+  // first wired to an input word of inputs lines
+  //
+  void Init(int32 inputs, const vector<NeuronConfig>& configs,
+            const vector<int32>& sizes);
+
+  int32 inputs() const { return inputs_; }
+  int32 layers() const { return layers_.size(); }
+  int32 size(int32 layer) const { return layers_[layer]->neurons.size(); }
+  Neuron* neuron(int32 layer, int32 n) { return layers_[layer]->neurons[n]; }
+
+  // The neuron of the layer below (or the input line) that synapse i of
+  // neuron n of layer feeds from
+  //
+  int32 source(int32 layer, int32 n, int32 i) const;
+
+  void StartTraining();
+  void FinishTraining();
+
+  // Propagate word through the layers, setting (*firings)[k] to the
+  // firings of layer k as a Word of (neuron, slot) in neuron order
+  //
+  void Expose(const Word& word, vector<Word>* firings);
+
+  // As Expose(), training each neuron on the signals it receives
+  void Train(const Word& word, vector<Word>* firings);
+
+  // Expose() or Train() each of words in turn, with the layers
+  // pipelined, setting (*firings)[t] to the firings for words[t]
+  //
+  void ExposeStream(const vector<Word>& words,
+                    vector<vector<Word> >* firings);
+  void TrainStream(const vector<Word>& words,
+                   vector<vector<Word> >* firings);
+
+ private:
+  struct Layer {
+    vector<Neuron*> neurons;
+    int32 length;
+
+    // The source of each neuron's synapses, at [neuron * length + i]
+    vector<int32> sources;
+
+    // The (neuron, synapse) pairs fed by each source s, at
+    // fanout[fanout_start[s]] to fanout[fanout_start[s + 1] - 1]
+    //
+    vector<int32> fanout_start;
+    vector<pair<int32, int32> > fanout;
+
+    // The signals delivered to each neuron, the neurons that received
+    // any, and the slots at which they fired
+    //
+    vector<Word> inbox;
+    vector<int32> touched;
+    vector<int32> slots;
+  };
+
+  // Deliver the firings below layer k to its neurons' inboxes
+  void Deliver(int32 k, const Word& below);
+
+  // Expose or train the neurons of the active layers that received any
+  // signals, setting (*firings)[k] to each active layer's firings
+  //
+  void Run(bool train, const vector<int32>& active, vector<Word>* firings);
+
+  void Propagate(bool train, const Word& word, vector<Word>* firings);
+  void Stream(bool train, const vector<Word>& words,
+              vector<vector<Word> >* firings);
+
+  int32 inputs_;
+  vector<Layer*> layers_;
+  scoped_ptr<RandomBase> random_;
+};
+
+}  // namespace cognon
+
+#endif  // COGNON_NETWORK_H_
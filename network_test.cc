@@ -0,0 +1,165 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "network.h"
+
+#include <vector>
+
+#include "cognon.h"
+#include "neuron.h"
+#include "wordset.h"
+
+namespace cognon {
+
+class NetworkTest : public testing::Test {
+};
+
+// Propagate word through network the slow way, building each neuron's
+// whole input word from its synapses' sources
+//
+static void DensePropagate(bool train, const Word& word, Network* network,
+                           vector<Word>* firings) {
+  firings->resize(network->layers());
+  for (int32 k = 0; k < network->layers(); ++k) {
+    int32 below = (k == 0 ? network->inputs() : network->size(k - 1));
+    vector<int32> slot(below, kDisabled);
+    const Word& input = (k == 0 ? word : (*firings)[k - 1]);
+    for (int32 i = 0; i < input.size(); ++i) {
+      slot[input[i].first] = input[i].second;
+    }
+    (*firings)[k].clear();
+    for (int32 n = 0; n < network->size(k); ++n) {
+      Neuron* neuron = network->neuron(k, n);
+      Word signals;
+      for (int32 i = 0; i < neuron->length(); ++i) {
+        int32 s = network->source(k, n, i);
+        if (slot[s] != kDisabled) signals.push_back(make_pair(i, slot[s]));
+      }
+      int32 d = (train ? neuron->Train(signals) : neuron->Expose(signals));
+      if (d != kDisabled) (*firings)[k].push_back(make_pair(n, d));
+    }
+  }
+}
+
+static void ExpectSameFirings(const char* what, int32 t,
+                              const vector<Word>& firings,
+                              const vector<Word>& expected) {
+  EXPECT_EQ(firings.size(), expected.size());
+  for (int32 k = 0; k < expected.size(); ++k) {
+    EXPECT_TRUE(firings[k] == expected[k])
+        << what << " word " << t << " layer " << k << ": "
+        << firings[k].size() << " firings, expected "
+        << expected[k].size() << "\n";
+  }
+}
+
+// Event-driven propagation, one word at a time and pipelined, fires the
+// same neurons at the same slots as exposing every neuron to every
+// synapse's source, before and after training
+//
+TEST_F(NetworkTest, CheckNetwork) {
+  const int32 kInputs = 400;
+  vector<NeuronConfig> configs(3);
+  vector<int32> sizes;
+
+  configs[0].set_c(1);
+  configs[0].set_d1(1);
+  configs[0].set_d2(2);
+  configs[0].set_h(4);
+  configs[0].set_q(2.0);
+  configs[0].set_r(10);
+  sizes.push_back(300);
+
+  configs[1].set_c(2);
+  configs[1].set_d1(3);
+  configs[1].set_d2(3);
+  configs[1].set_h(3);
+  configs[1].set_q(2.0);
+  configs[1].set_r(5);
+  configs[1].set_g_m(1.5);
+  configs[1].set_h_m(4.5);
+  sizes.push_back(200);
+
+  configs[2].set_c(1);
+  configs[2].set_d1(6);
+  configs[2].set_d2(6);
+  configs[2].set_h(3);
+  configs[2].set_q(2.0);
+  configs[2].set_r(5);
+  sizes.push_back(50);
+
+  RandomBase random;
+  vector<MTRand::uint32> state;
+  random.SaveState(&state);
+  Network network;
+  network.Init(kInputs, configs, sizes);
+  random.LoadState(state);
+  Network dense;
+  dense.Init(kInputs, configs, sizes);
+  EXPECT_EQ(network.layers(), 3);
+
+  Wordset train;
+  Wordset test;
+  train.Config(40, kInputs, configs[0].d1(), configs[0].r());
+  test.Config(100, kInputs, configs[0].d1(), configs[0].r());
+  vector<Word> train_words;
+  vector<Word> test_words;
+  for (int32 t = 0; t < train.size(); ++t) {
+    train_words.push_back(train.get_word(t));
+  }
+  for (int32 t = 0; t < test.size(); ++t) {
+    test_words.push_back(test.get_word(t));
+  }
+
+  vector<vector<Word> > firings;
+  vector<Word> expected;
+  network.StartTraining();
+  dense.StartTraining();
+  network.TrainStream(train_words, &firings);
+  for (int32 t = 0; t < train.size(); ++t) {
+    DensePropagate(true, train_words[t], &dense, &expected);
+    ExpectSameFirings("Training", t, firings[t], expected);
+  }
+  network.FinishTraining();
+  dense.FinishTraining();
+
+  vector<int32> fired(configs.size(), 0);
+  vector<Word> one;
+  network.ExposeStream(test_words, &firings);
+  for (int32 t = 0; t < test.size(); ++t) {
+    DensePropagate(false, test_words[t], &dense, &expected);
+    ExpectSameFirings("Streamed", t, firings[t], expected);
+    network.Expose(test_words[t], &one);
+    ExpectSameFirings("Test", t, one, expected);
+    for (int32 k = 0; k < expected.size(); ++k) {
+      fired[k] += expected[k].size();
+    }
+  }
+  for (int32 k = 0; k < fired.size(); ++k) {
+    EXPECT_TRUE(0 < fired[k] && fired[k] < test.size() * sizes[k])
+        << "Expected some neurons of layer " << k << " to fire and others"
+        << " not: " << fired[k] << "\n";
+  }
+}
+
+}  // namespace cognon
+
+int main(int argc, char **argv) {
+  CALL_TEST(cognon::CheckNetwork);
+  return 0;
+}
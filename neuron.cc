@@ -21,6 +21,7 @@
 #include "neuron.h"
 
 #include <math.h>
+#include <algorithm>
 #include <utility>
 
 #include "cognon.h"
@@ -74,7 +75,9 @@ void LearnSynapseStrength::FinishTraining() {
 Neuron::Neuron()
     : C_(1), D1_(1), D2_(1), H_(1.0), Q_(1.0), Q_after_(-1.0), R_(1),
       G_m_(-1.0), H_m_(-1.0), random_(NULL), length_(-1),
-      delays_(), containers_(), frozen_(), sum_(), learn_(NULL) {
+      delays_(), containers_(), frozen_(), sum_(), touched_(),
+      touched_list_(), mass_(), slot_bound_(), has_bounds_(false),
+      exposures_(0), rejections_(0), learn_(NULL) {
   random_.reset(CreateRandom());
 }
 
@@ -117,8 +120,13 @@ void Neuron::Init(const NeuronConfig& config) {
     containers_.resize(length_);
     frozen_.resize(length_);
     strength_.resize(length_);
-    sum_.resize(C_);
   }
+  sum_.assign(C_, 0.0);
+  touched_.assign(C_, false);
+  touched_list_.clear();
+  mass_.assign(slots(), 0.0);
+  slot_bound_.clear();
+  has_bounds_ = false;
 
   // Randomly assign delays and containers to each synapse
   for (int32 i = 0; i < length_; ++i) {
@@ -149,12 +157,40 @@ int32 Neuron::Expose(const Word& word) {
   CHECK(strength_.size() == length_);
   CHECK(containers_.size() == length_);
 
-  // Iterate over delays until neuron fires occurs
-  int s = slots();
-  for (int32 d = 0; d < s; ++d) {
-    for (int32 i = 0; i < C_; ++i) {
-      sum_[i] = 0.0;
+  ++exposures_;
+
+  // Bound every container's sum in each slot by the strength landing in
+  // that slot, and reject the word outright if all of it together
+  // cannot reach H.  The bounds have kEpsilon to spare over the firing
+  // test, so rounding cannot reject a word that fires.
+  //
+  const int32 s = slots();
+  double total = 0.0;
+  for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
+    CHECK(0 <= it->first && it->first < length_);
+    uint32 slot = delays_[it->first] + it->second;
+    if (slot < static_cast<uint32>(s)) {
+      mass_[slot] += strength_[it->first];
+      total += strength_[it->first];
     }
+  }
+  if (total + 2.0 * kEpsilon < H_) {
+    ++rejections_;
+    fill(mass_.begin(), mass_.end(), 0.0);
+    return kDisabled;
+  }
+
+  // Iterate over delays until neuron fires occurs, skipping the slots
+  // that cannot reach H and stopping when none of the rest can
+  //
+  int32 result = kDisabled;
+  double remaining = total;
+  for (int32 d = 0; d < s && H_ <= remaining + 2.0 * kEpsilon; ++d) {
+    remaining -= mass_[d];
+    if (mass_[d] + 2.0 * kEpsilon < H_) continue;
+    if (has_bounds_ && slot_bound_[d] + 2.0 * kEpsilon < H_) continue;
+
+    ClearSums();
     // Iterate over sparse signals in word
     for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
       int32 synapse = it->first;
@@ -166,17 +202,54 @@ int32 Neuron::Expose(const Word& word) {
       // increment the container's sum by that synapse's strength
       if (delays_[synapse] + delay == d) {
         CHECK(0 <= containers_[synapse] && containers_[synapse] < C_);
+        Touch(containers_[synapse]);
         sum_[containers_[synapse]] += strength_[synapse];
       }
     }
 
-    // Iterate through containers to see if any fired
-    for (int32 i = 0; i < C_; ++i) {
+    // Iterate through the containers reached to see if any fired
+    for (int32 k = 0; k < touched_list_.size(); ++k) {
       // If at least H firings, then denote that container as fired
-      if (H_ <= sum_[i] + kEpsilon) return d;
+      if (H_ <= sum_[touched_list_[k]] + kEpsilon) result = d;
     }
+    if (result != kDisabled) break;
+  }
+  fill(mass_.begin(), mass_.end(), 0.0);
+  return result;
+}
+
+void Neuron::ClearSums() {
+  for (int32 k = 0; k < touched_list_.size(); ++k) {
+    sum_[touched_list_[k]] = 0.0;
+    touched_[touched_list_[k]] = false;
+  }
+  touched_list_.clear();
+}
+
+void Neuron::ExposeMaxima(const Word& word, vector<double>* maxima) {
+  CHECK(sum_.size() == C_);
+  CHECK_NOTNULL(maxima);
+
+  int s = slots();
+  maxima->resize(s);
+  for (int32 d = 0; d < s; ++d) {
+    ClearSums();
+    // Iterate over sparse signals in word
+    for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
+      int32 synapse = it->first;
+      if (delays_[synapse] + it->second == d) {
+        Touch(containers_[synapse]);
+        sum_[containers_[synapse]] += strength_[synapse];
+      }
+    }
+
+    // The containers not reached sum to zero
+    double maximum = (touched_list_.size() < C_ ? 0.0 : -HUGE_VAL);
+    for (int32 k = 0; k < touched_list_.size(); ++k) {
+      maximum = max(maximum, sum_[touched_list_[k]]);
+    }
+    (*maxima)[d] = maximum;
   }
-  return kDisabled;
 }
 
 int32 Neuron::Train(const Word& word) {
@@ -189,8 +262,11 @@ int32 Neuron::Train(const Word& word) {
 
   if (d == kDisabled) return d;
 
-  // Iterate through containers, updating synapses in those that fired
-  for (int32 i = 0; i < C_; ++i) {
+  // Iterate through the containers reached, updating synapses in those
+  // that fired
+  //
+  for (int32 k = 0; k < touched_list_.size(); ++k) {
+    int32 i = touched_list_[k];
     if (sum_[i] + kEpsilon < H_) continue;
     // Update those synapses that contributed to the neuron firing
     for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
@@ -208,6 +284,7 @@ int32 Neuron::Train(const Word& word) {
 void Neuron::StartTraining() {
   CHECK_NOTNULL(learn_.get());
 
+  has_bounds_ = false;
   learn_->StartTraining();
 }
 
@@ -222,6 +299,24 @@ void Neuron::FinishTraining() {
     if (frozen_[i]) count++;
   }
   Q_after_ = count / static_cast<double>(length_);
+
+  // The most strength any word can land in each container and slot, and
+  // the largest of those in each slot
+  //
+  vector<double> bound(slots() * C_, 0.0);
+  for (int32 i = 0; i < length_; ++i) {
+    if (delays_[i] < 0 || D2_ <= delays_[i]) continue;
+    for (int32 delay = 0; delay < D1_; ++delay) {
+      bound[(delays_[i] + delay) * C_ + containers_[i]] += strength_[i];
+    }
+  }
+  slot_bound_.assign(slots(), 0.0);
+  for (int32 d = 0; d < slots(); ++d) {
+    for (int32 i = 0; i < C_; ++i) {
+      slot_bound_[d] = max(slot_bound_[d], bound[d * C_ + i]);
+    }
+  }
+  has_bounds_ = true;
 }
 
 void Neuron::GetInputDelayHistogram(const Word& word,
@@ -236,9 +331,7 @@ void Neuron::GetInputDelayHistogram(const Word& word,
   if (max_histogram->size() < s + 1) max_histogram->resize(s + 1);
 
   for (int32 d = 0; d < s; ++d) {
-    for (int32 i = 0; i < C_; ++i) {
-      sum_[i] = 0.0;
-    }
+    ClearSums();
     // Iterate over sparse signals in word
     for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
       int32 synapse = it->first;
@@ -247,6 +340,7 @@ void Neuron::GetInputDelayHistogram(const Word& word,
       // If delay and word delay adds up to current delay then
       // increment the container's sum by that synapse's strength
       if (delays_[synapse] + delay == d) {
+        Touch(containers_[synapse]);
         sum_[containers_[synapse]] += strength_[synapse];
       }
     }
@@ -286,4 +380,440 @@ void Neuron::GetSynapseDelayHistogram(vector<int32>* histogram) {
   }
 }
 
+NeuronLanes::NeuronLanes()
+    : lanes_(0), length_(0), C_(1), D1_(1), slots_(0), H_(1.0) {
+}
+
+void NeuronLanes::Load(const vector<const Neuron*>& neurons) {
+  CHECK(0 < neurons.size() && neurons.size() <= kMaxLanes);
+  const Neuron* first = neurons[0];
+  lanes_ = neurons.size();
+  length_ = first->length();
+  C_ = first->C();
+  D1_ = first->D1();
+  slots_ = first->slots();
+  H_ = first->H();
+
+  delays_.resize(length_ * lanes_);
+  containers_.resize(length_ * lanes_);
+  strength_.resize(length_ * lanes_);
+  for (int32 l = 0; l < lanes_; ++l) {
+    const Neuron* neuron = neurons[l];
+    CHECK(neuron->length() == length_ && neuron->C() == C_
+          && neuron->D1() == D1_ && neuron->slots() == slots_
+          && neuron->H() == H_);
+    for (int32 i = 0; i < length_; ++i) {
+      delays_[i * lanes_ + l] = neuron->delays(i);
+      containers_[i * lanes_ + l] = neuron->containers(i);
+      strength_[i * lanes_ + l] = neuron->strength(i);
+    }
+  }
+  sum_.assign((slots_ * C_ + 1) * lanes_, 0.0);
+}
+
+void NeuronLanes::Expose(const Word* const* words, int32* slots) {
+  const int32 L = lanes_;
+
+  // Lay the words out signal by signal, padding the shorter ones with
+  // signals that land in no slot
+  //
+  int32 longest = 0;
+  for (int32 l = 0; l < L; ++l) {
+    if (words[l] == NULL) continue;
+    longest = max(longest, static_cast<int32>(words[l]->size()));
+  }
+  synapse_.resize(longest * L);
+  delay_.resize(longest * L);
+  for (int32 l = 0; l < L; ++l) {
+    int32 n = (words[l] != NULL ? words[l]->size() : 0);
+    for (int32 k = 0; k < n; ++k) {
+      const pair<int32, int32>& signal = (*words[l])[k];
+      CHECK(0 <= signal.first && signal.first < length_);
+      synapse_[k * L + l] = signal.first;
+      delay_[k * L + l] = signal.second;
+    }
+    for (int32 k = n; k < longest; ++k) {
+      synapse_[k * L + l] = 0;
+      delay_[k * L + l] = kDisabled;
+    }
+  }
+
+  // Add each signal's strength to the container and slot it lands in,
+  // in word order as Neuron::Expose() does
+  //
+  const uint32 slots_end = slots_;
+  const int32 nowhere = slots_ * C_;
+  double* sum = &sum_[0];
+  for (int32 k = 0; k < longest; ++k) {
+    const int32* synapse = &synapse_[k * L];
+    const int32* delay = &delay_[k * L];
+#pragma omp simd
+    for (int32 l = 0; l < L; ++l) {
+      int32 s = synapse[l] * L + l;
+      uint32 slot = delays_[s] + delay[l];
+      int32 cell = (slot < slots_end ? slot * C_ + containers_[s] : nowhere);
+      sum[cell * L + l] += strength_[s];
+    }
+  }
+
+  // The first slot in which any container reaches the threshold
+  for (int32 l = 0; l < L; ++l) {
+    slots[l] = kDisabled;
+  }
+  for (int32 d = 0; d < slots_; ++d) {
+    for (int32 i = 0; i < C_; ++i) {
+      const double* row = &sum[(d * C_ + i) * L];
+#pragma omp simd
+      for (int32 l = 0; l < L; ++l) {
+        if (slots[l] == kDisabled && H_ <= row[l] + kEpsilon) slots[l] = d;
+      }
+    }
+  }
+  fill(sum_.begin(), sum_.end(), 0.0);
+}
+
+NeuronBitSlice::NeuronBitSlice()
+    : length_(0), C_(1), D1_(1), slots_(0), planes_(1), threshold_(1) {
+}
+
+static int32 gcd(int32 a, int32 b) {
+  while (b != 0) {
+    int32 t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+bool NeuronBitSlice::Load(const Neuron& neuron) {
+  length_ = neuron.length();
+  C_ = neuron.C();
+  D1_ = neuron.D1();
+  slots_ = neuron.slots();
+
+  // The smallest scale that makes every strength a whole number
+  int32 scale = 1;
+  for (; scale <= kMaxScale; ++scale) {
+    int32 i = 0;
+    for (; i < length_; ++i) {
+      double weight = neuron.strength(i) * scale;
+      if (kEpsilon < fabs(weight - floor(weight + 0.5))) break;
+    }
+    if (i == length_) break;
+  }
+  if (kMaxScale < scale) return false;
+
+  // Fire when the scaled sum reaches (H - kEpsilon) * scale, as
+  // Neuron::Expose() does, with the weights reduced by their common
+  // divisor
+  //
+  cell_.resize(length_);
+  weight_.resize(length_);
+  int32 divisor = 0;
+  for (int32 i = 0; i < length_; ++i) {
+    int32 delay = neuron.delays(i);
+    if (delay < 0 || neuron.D2() <= delay) {
+      // Never reached, and delay * C_ overflows for kDisabled
+      cell_[i] = 0;
+      weight_[i] = 0;
+      continue;
+    }
+    cell_[i] = delay * C_ + neuron.containers(i);
+    weight_[i] = static_cast<int32>(floor(neuron.strength(i) * scale + 0.5));
+    divisor = gcd(divisor, weight_[i]);
+  }
+  threshold_ = static_cast<int32>(ceil((neuron.H() - kEpsilon) * scale));
+  if (threshold_ < 1) return false;
+  if (1 < divisor) {
+    for (int32 i = 0; i < length_; ++i) weight_[i] /= divisor;
+    threshold_ = (threshold_ + divisor - 1) / divisor;
+  }
+
+  // Enough bits for the most weight any container and slot can get
+  vector<int32> capacity(slots_ * C_, 0);
+  for (int32 i = 0; i < length_; ++i) {
+    if (weight_[i] == 0) continue;
+    for (int32 delay = 0; delay < D1_; ++delay) {
+      capacity[cell_[i] + delay * C_] += weight_[i];
+    }
+  }
+  int32 most = *max_element(capacity.begin(), capacity.end());
+  planes_ = 1;
+  while (planes_ < 31 && (1 << planes_) <= most) ++planes_;
+
+  counters_.assign(slots_ * C_ * planes_, 0);
+  reached_.assign(slots_ * C_, 0);
+  touched_.clear();
+  fired_.assign(slots_, 0);
+  return true;
+}
+
+void NeuronBitSlice::Expose(const Word* const* words, int32 n,
+                            int32* slots) {
+  CHECK(0 < n && n <= kBatch);
+
+  // Add each signal's word bit, times its synapse's weight, into the
+  // counter of the container and slot it lands in, one ripple-carry add
+  // per bit of the weight
+  //
+  for (int32 w = 0; w < n; ++w) {
+    const uint64 bit = static_cast<uint64>(1) << w;
+    const Word& word = *words[w];
+    for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
+      int32 synapse = it->first;
+      CHECK(0 <= synapse && synapse < length_);
+      int32 weight = weight_[synapse];
+      if (it->second == kDisabled || weight == 0) continue;
+      CHECK(0 <= it->second && it->second < D1_);
+      int32 cell = cell_[synapse] + it->second * C_;
+      if (reached_[cell] == 0) touched_.push_back(cell);
+      reached_[cell] |= bit;
+      uint64* planes = &counters_[cell * planes_];
+      for (int32 b = 0; weight != 0; ++b, weight >>= 1) {
+        if ((weight & 1) == 0) continue;
+        uint64 carry = bit;
+        for (int32 j = b; carry != 0 && j < planes_; ++j) {
+          uint64 t = planes[j] & carry;
+          planes[j] ^= carry;
+          carry = t;
+        }
+      }
+    }
+  }
+
+  // Compare each counter reached with the threshold, from the top bit
+  // down, and reset it
+  //
+  const bool reachable = ((threshold_ >> planes_) == 0);
+  for (int32 t = 0; t < touched_.size(); ++t) {
+    int32 cell = touched_[t];
+    uint64* planes = &counters_[cell * planes_];
+    if (reachable) {
+      uint64 greater = 0;
+      uint64 equal = reached_[cell];
+      for (int32 j = planes_ - 1; 0 <= j; --j) {
+        if ((threshold_ >> j) & 1) {
+          equal &= planes[j];
+        } else {
+          greater |= equal & planes[j];
+          equal &= ~planes[j];
+        }
+      }
+      fired_[cell / C_] |= greater | equal;
+    }
+    for (int32 j = 0; j < planes_; ++j) planes[j] = 0;
+    reached_[cell] = 0;
+  }
+  touched_.clear();
+
+  // Each word fires in the first slot it reaches the threshold in
+  for (int32 w = 0; w < n; ++w) {
+    slots[w] = kDisabled;
+  }
+  uint64 undecided = ~static_cast<uint64>(0);
+  for (int32 d = 0; d < slots_; ++d) {
+    uint64 fired = fired_[d] & undecided;
+    undecided &= ~fired;
+    fired_[d] = 0;
+    for (int32 w = 0; fired != 0 && w < n; ++w) {
+      if ((fired >> w) & 1) slots[w] = d;
+    }
+  }
+}
+
+NeuronPopulation::NeuronPopulation()
+    : size_(0), length_(0), C_(1), D1_(1), D2_(1), slots_(0), H_(1.0),
+      learn_strength_(false), random_(NULL) {
+  random_.reset(CreateRandom());
+}
+
+void NeuronPopulation::Init(const NeuronConfig& config, int32 size) {
+  CHECK(0 < size);
+  CHECK(config.has_c() && config.has_d1() && config.has_d2());
+  CHECK(config.has_h() && config.has_q() && config.has_r());
+  CHECK(1 <= config.c());
+  CHECK(config.d1() <= config.d2());
+  CHECK(1 <= config.h());
+
+  config_ = config;
+  size_ = size;
+  C_ = config.c();
+  D1_ = config.d1();
+  D2_ = config.d2();
+  slots_ = D1_ + D2_;
+  H_ = config.h();
+  length_ = static_cast<int32>(
+      floor(C_ * H_ * config.q() * config.r() + kEpsilon));
+  learn_strength_ = (config.has_g_m() && config.has_h_m());
+
+  delays_.resize(length_ * size_);
+  containers_.resize(length_ * size_);
+  frozen_.assign(length_ * size_, false);
+  strength_.assign(length_ * size_, 1.0);
+  // Neuron by neuron, so that a population drawn from the same stream as
+  // a run of Neurons has the same synapses
+  //
+  for (int32 n = 0; n < size_; ++n) {
+    for (int32 i = 0; i < length_; ++i) {
+      delays_[i * size_ + n] = random_->Rand32() % D2_;
+      containers_[i * size_ + n] = random_->Rand32() % C_;
+    }
+  }
+  sum_.assign((slots_ * C_ + 1) * size_, 0.0);
+  Q_after_.assign(size_, -1.0);
+}
+
+void NeuronPopulation::Load(const vector<const Neuron*>& neurons) {
+  CHECK(0 < neurons.size());
+  const Neuron* first = neurons[0];
+  config_ = first->config();
+  size_ = neurons.size();
+  length_ = first->length();
+  C_ = first->C();
+  D1_ = first->D1();
+  D2_ = first->D2();
+  slots_ = first->slots();
+  H_ = first->H();
+  learn_strength_ = (config_.has_g_m() && config_.has_h_m());
+
+  delays_.resize(length_ * size_);
+  containers_.resize(length_ * size_);
+  frozen_.resize(length_ * size_);
+  strength_.resize(length_ * size_);
+  Q_after_.resize(size_);
+  for (int32 n = 0; n < size_; ++n) {
+    const Neuron* neuron = neurons[n];
+    CHECK(neuron->length() == length_ && neuron->C() == C_
+          && neuron->D1() == D1_ && neuron->D2() == D2_
+          && neuron->H() == H_ && neuron->G_m() == first->G_m()
+          && neuron->H_m() == first->H_m());
+    for (int32 i = 0; i < length_; ++i) {
+      delays_[i * size_ + n] = neuron->delays(i);
+      containers_[i * size_ + n] = neuron->containers(i);
+      frozen_[i * size_ + n] = neuron->frozen(i);
+      strength_[i * size_ + n] = neuron->strength(i);
+    }
+    Q_after_[n] = neuron->Q_after();
+  }
+  sum_.assign((slots_ * C_ + 1) * size_, 0.0);
+}
+
+int32 NeuronPopulation::Expose(const Word& word, int32* slots) {
+  int32 blocks = (size_ + kBlockSize - 1) / kBlockSize;
+  int32 fired = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:fired)
+  for (int32 b = 0; b < blocks; ++b) {
+    fired += ExposeBlock(word, b * kBlockSize,
+                         min(size_, (b + 1) * kBlockSize), false, slots);
+  }
+  return fired;
+}
+
+int32 NeuronPopulation::Train(const Word& word, int32* slots) {
+  int32 blocks = (size_ + kBlockSize - 1) / kBlockSize;
+  int32 fired = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:fired)
+  for (int32 b = 0; b < blocks; ++b) {
+    fired += ExposeBlock(word, b * kBlockSize,
+                         min(size_, (b + 1) * kBlockSize), true, slots);
+  }
+  return fired;
+}
+
+int32 NeuronPopulation::ExposeBlock(const Word& word, int32 first,
+                                    int32 last, bool train, int32* slots) {
+  const int32 N = size_;
+  const uint32 slots_end = slots_;
+  const int32 nowhere = slots_ * C_;
+  double* sum = &sum_[0];
+
+  // Add each signal's strength to the container and slot it lands in,
+  // in word order as Neuron::Expose() does
+  //
+  for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
+    CHECK(0 <= it->first && it->first < length_);
+    const int32 row = it->first * N;
+    const int32 delay = it->second;
+#pragma omp simd
+    for (int32 n = first; n < last; ++n) {
+      uint32 slot = delays_[row + n] + delay;
+      int32 cell = (slot < slots_end ? slot * C_ + containers_[row + n]
+                    : nowhere);
+      sum[cell * N + n] += strength_[row + n];
+    }
+  }
+
+  // The first slot in which any container reaches the threshold
+  for (int32 n = first; n < last; ++n) {
+    slots[n] = kDisabled;
+  }
+  for (int32 d = 0; d < slots_; ++d) {
+    for (int32 i = 0; i < C_; ++i) {
+      const double* cell = &sum[(d * C_ + i) * N];
+#pragma omp simd
+      for (int32 n = first; n < last; ++n) {
+        if (slots[n] == kDisabled && H_ <= cell[n] + kEpsilon) slots[n] = d;
+      }
+    }
+  }
+
+  // Update the synapses that contributed to a container that fired, in
+  // the slot in which it fired, as Neuron::Train() does
+  //
+  if (train) {
+    const double G_m = config_.g_m();
+    for (Word::const_iterator it = word.begin(); it != word.end(); ++it) {
+      const int32 row = it->first * N;
+      const int32 delay = it->second;
+      for (int32 n = first; n < last; ++n) {
+        int32 d = slots[n];
+        if (d == kDisabled || delays_[row + n] + delay != d) continue;
+        if (sum[(d * C_ + containers_[row + n]) * N + n] + kEpsilon < H_) {
+          continue;
+        }
+        if (learn_strength_) strength_[row + n] = G_m;
+        frozen_[row + n] = true;
+      }
+    }
+  }
+
+  int32 fired = 0;
+  for (int32 n = first; n < last; ++n) {
+    if (slots[n] != kDisabled) ++fired;
+  }
+  for (int32 cell = 0; cell <= nowhere; ++cell) {
+    fill(sum + cell * N + first, sum + cell * N + last, 0.0);
+  }
+  return fired;
+}
+
+void NeuronPopulation::StartTraining() {
+  if (learn_strength_) H_ = config_.h();
+}
+
+void NeuronPopulation::FinishTraining() {
+  const int32 N = size_;
+  if (learn_strength_) {
+    H_ = config_.h_m();
+  } else {
+    for (int32 i = 0; i < length_ * N; ++i) {
+      if (!frozen_[i]) {
+        strength_[i] = 0.0;
+        delays_[i] = kDisabled;
+      }
+    }
+  }
+
+  // Synapse by synapse, to walk the population's arrays in order
+  vector<int32> count(N, 0);
+  for (int32 i = 0; i < length_; ++i) {
+    for (int32 n = 0; n < N; ++n) {
+      if (frozen_[i * N + n]) count[n]++;
+    }
+  }
+  for (int32 n = 0; n < N; ++n) {
+    Q_after_[n] = count[n] / static_cast<double>(length_);
+  }
+}
+
 }  // namespace cognon
@@ -81,8 +81,22 @@ class Neuron {
   // A word is a random vector of [0, ..., D1-1, kDisabled] values, with an
   // input signal (non-disabled value) roughly every R slots.
   //
+  // Only the containers the word reaches in each slot are summed,
+  // scanned and reset, so the cost does not depend on C.  A word whose
+  // total strength cannot reach H is rejected without summing any slot,
+  // and slots that cannot reach H are skipped: those with too little of
+  // the word's strength, and after training, those whose synapses are
+  // too weak for any word.
+  //
   int32 Expose(const Word& word);
 
+  // Expose a neuron to a word without a firing threshold: maxima is
+  // set to the largest container summation in each delay slot.  The
+  // neuron would fire at threshold h in the first slot d with
+  // h <= (*maxima)[d] + kEpsilon.
+  //
+  void ExposeMaxima(const Word& word, vector<double>* maxima);
+
   // Train a neuron to recognize a word.
   //
   // A word is a random vector of [0, ..., d1-1, kDisabled] values,
@@ -112,7 +126,7 @@ class Neuron {
   void GetSynapseDelayHistogram(vector<int32>* histogram);
 
   // Various accessor functions to report the Neuron's configuration
-  const NeuronConfig& config() { return config_; }
+  const NeuronConfig& config() const { return config_; }
   const int32 C() const { return C_; }
   const int32 D1() const { return D1_; }
   const int32 D2() const { return D2_; }
@@ -128,21 +142,50 @@ class Neuron {
   void set_H(double value) { H_ = value; }
 
   const int32 delays(int32 i) const { return delays_[i]; }
-  void set_delays(int32 i, int32 value) { delays_[i] = value; }
+  void set_delays(int32 i, int32 value) {
+    delays_[i] = value;
+    has_bounds_ = false;
+  }
 
   const int32 containers(int32 i) const { return containers_[i]; }
-  void set_containers(int32 i, int32 value) { containers_[i] = value; }
+  void set_containers(int32 i, int32 value) {
+    containers_[i] = value;
+    has_bounds_ = false;
+  }
 
   const bool frozen(int32 i) const { return frozen_[i]; }
   void set_frozen(int32 i, bool value) { frozen_[i] = value; }
 
   const double strength(int32 i) const { return strength_[i]; }
-  void set_strength(int32 i, double value) { strength_[i] = value; }
+  void set_strength(int32 i, double value) {
+    strength_[i] = value;
+    has_bounds_ = false;
+  }
+
+  // The number of words exposed (including in training), and the number
+  // of those rejected by their total strength alone
+  //
+  const int64 exposures() const { return exposures_; }
+  const int64 rejections() const { return rejections_; }
 
   const double sum(int32 i) const { return sum_[i]; }
-  void set_sum(int32 i, double value) { sum_[i] = value; }
+  void set_sum(int32 i, double value) {
+    Touch(i);
+    sum_[i] = value;
+  }
 
  private:
+  // Note that container i's sum may be non-zero
+  void Touch(int32 i) {
+    if (!touched_[i]) {
+      touched_[i] = true;
+      touched_list_.push_back(i);
+    }
+  }
+
+  // Reset the sums of the touched containers
+  void ClearSums();
+
   NeuronConfig config_;  // Configuration data
   int32 C_;         // Number of containers
   int32 D1_;        // Number of input delays
@@ -161,9 +204,216 @@ class Neuron {
   vector<bool> frozen_;       // Is the synapse frozen?
   vector<double> strength_;   // Strength of the synapse
   vector<double> sum_;        // Per container summation values
+  vector<bool> touched_;      // Might the container's sum be non-zero?
+  vector<int32> touched_list_;     // The touched containers
+  vector<double> mass_;       // Per slot strength of the word exposed
+  vector<double> slot_bound_;  // Per slot most strength in one container
+  bool has_bounds_;           // Is slot_bound_ up to date?
+  int64 exposures_;           // Words exposed
+  int64 rejections_;          // Words rejected by their total strength
   scoped_ptr<Learn> learn_;        // Modifies neuron during learning
 };
 
+// Several neurons of the same shape (length, C, D1, D2 and H), run in
+// lockstep, each exposed to its own word at the same time.  Their
+// synapses are interleaved lane by lane, and each exposure sums every
+// lane's word into all of its delay slots in one pass and then scans
+// the slots for all of the lanes together, so that the inner loops run
+// across the lanes instead of along one short word.
+//
+// Expose() gives each lane the same slot as Neuron::Expose() would.
+//
+// Not thread safe
+//
+class NeuronLanes {
+ public:
+  static const int32 kMaxLanes = kMaxLockstepLanes;
+
+  NeuronLanes();
+  ~NeuronLanes() { }
+
+  // Copy the synapses of the neurons, one per lane.  The neurons are
+  // not referenced afterwards.
+  //
+  void Load(const vector<const Neuron*>& neurons);
+
+  int32 lanes() const { return lanes_; }
+
+  // Set slots[l] to the slot at which lane l fires on *words[l], or to
+  // kDisabled if it does not fire (or words[l] is NULL).
+  //
+  void Expose(const Word* const* words, int32* slots);
+
+ private:
+  int32 lanes_;
+  int32 length_;
+  int32 C_;
+  int32 D1_;
+  int32 slots_;
+  double H_;
+
+  // Per synapse and lane, at [synapse * lanes_ + lane]
+  vector<int32> delays_;
+  vector<int32> containers_;
+  vector<double> strength_;
+
+  // The words being exposed, signal by signal and lane by lane
+  vector<int32> synapse_;
+  vector<int32> delay_;
+
+  // Per delay slot, container and lane summation values, with a last
+  // row for the signals that land in no slot
+  //
+  vector<double> sum_;
+};
+
+// A batch of up to 64 words exposed to one neuron together, bit-sliced:
+// word w of the batch is bit w of each bit plane.  Each signal adds its
+// word's bit, times its synapse's integer weight, into a vertical
+// counter for the container and slot it lands in, and each counter
+// reached is then compared with the threshold for all of the words at
+// once.  The cost is in proportion to the batch's signals, rather than
+// to its signals times the D1 + D2 slots, which makes it worthwhile for
+// D1 > 1.
+//
+// Expose() gives each word the same slot as Neuron::Expose() would.
+//
+// Not thread safe
+//
+class NeuronBitSlice {
+ public:
+  static const int32 kBatch = 64;
+
+  // Strengths must be multiples of 1 / k for some k up to this
+  static const int32 kMaxScale = 1000;
+
+  NeuronBitSlice();
+  ~NeuronBitSlice() { }
+
+  // Copy the synapses of neuron, which is not referenced afterwards.
+  // Returns false if its strengths or threshold have no common scale.
+  //
+  bool Load(const Neuron& neuron);
+
+  // Set slots[w] to the slot at which the neuron fires on *words[w], or
+  // to kDisabled if it does not fire, for each w < n <= kBatch
+  //
+  void Expose(const Word* const* words, int32 n, int32* slots);
+
+ private:
+  int32 length_;
+  int32 C_;
+  int32 D1_;
+  int32 slots_;
+  int32 planes_;     // Bits in each counter
+  int32 threshold_;  // The weight at which a container fires
+
+  // Per synapse, the counter it adds to with input delay 0, and its
+  // weight
+  //
+  vector<int32> cell_;
+  vector<int32> weight_;
+
+  // Per delay slot and container, planes_ bit planes of the summation,
+  // lowest first, the words that reached it, and the counters reached
+  //
+  vector<uint64> counters_;
+  vector<uint64> reached_;
+  vector<int32> touched_;
+
+  // Per delay slot, the words that fire in it
+  vector<uint64> fired_;
+};
+
+// A population of neurons of one configuration, each with its own
+// random synapses, that all receive the same words.  The synapses are
+// stored synapse by synapse across the population, and each word is
+// exposed to the population one block of kBlockSize neurons at a time,
+// so that a block's summation values stay in cache while the word's
+// signals are added in.  The blocks are spread across threads.
+//
+// Expose() and Train() give each neuron the same slot as
+// Neuron::Expose() and Neuron::Train() would, and training leaves each
+// neuron's synapses as it would leave a Neuron's.
+//
+class NeuronPopulation {
+ public:
+  static const int32 kBlockSize = 128;
+
+  NeuronPopulation();
+  ~NeuronPopulation() { }
+
+  // Initialize size neurons from config, drawing each one's synapses as
+  // Neuron::Init() does
+  //
+  void Init(const NeuronConfig& config, int32 size);
+
+  // Copy the synapses of the neurons, which must share a configuration.
+  // The neurons are not referenced afterwards.
+  //
+  void Load(const vector<const Neuron*>& neurons);
+
+  const NeuronConfig& config() const { return config_; }
+  int32 size() const { return size_; }
+  int32 length() const { return length_; }
+  int32 slots() const { return slots_; }
+  double H() const { return H_; }
+
+  // Set slots[n] to the slot at which neuron n fires on word, or to
+  // kDisabled if it does not fire.  Returns the number of neurons that
+  // fired.
+  //
+  int32 Expose(const Word& word, int32* slots);
+
+  // As Expose(), and then update the synapses that fired each neuron
+  int32 Train(const Word& word, int32* slots);
+
+  void StartTraining();
+  void FinishTraining();
+
+  // Neuron n's Q after training, and its synapses
+  double Q_after(int32 n) const { return Q_after_[n]; }
+  int32 delays(int32 n, int32 i) const { return delays_[i * size_ + n]; }
+  int32 containers(int32 n, int32 i) const {
+    return containers_[i * size_ + n];
+  }
+  bool frozen(int32 n, int32 i) const { return frozen_[i * size_ + n]; }
+  double strength(int32 n, int32 i) const {
+    return strength_[i * size_ + n];
+  }
+
+ private:
+  // Expose (or train) neurons [first, last) on word
+  int32 ExposeBlock(const Word& word, int32 first, int32 last, bool train,
+                    int32* slots);
+
+  NeuronConfig config_;
+  int32 size_;
+  int32 length_;
+  int32 C_;
+  int32 D1_;
+  int32 D2_;
+  int32 slots_;
+  double H_;
+  bool learn_strength_;  // LearnSynapseStrength, else LearnSynapseAtrophy
+
+  scoped_ptr<RandomBase> random_;
+
+  // Per synapse and neuron, at [synapse * size_ + neuron]
+  vector<int32> delays_;
+  vector<int32> containers_;
+  vector<char> frozen_;
+  vector<double> strength_;
+
+  // Per delay slot, container and neuron summation values, at
+  // [(slot * C_ + container) * size_ + neuron], with a last row for the
+  // signals that land in no slot
+  //
+  vector<double> sum_;
+
+  vector<double> Q_after_;
+};
+
 }  // namespace cognon
 
 #endif  // COGNON_NEURON_H_
@@ -487,6 +487,330 @@ TEST_F(NeuronTest, TestWordsetFixed) {
       << prob_false << "\n";
 }
 
+// Neurons run in lockstep fire in the same slots as they do alone
+TEST_F(NeuronTest, CheckNeuronLanes) {
+  const int32 kLanes = 5;
+  NeuronConfig config;
+
+  config.set_c(2);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(5.0);
+  config.set_r(10);
+  config.set_g_m(1.5);
+  config.set_h_m(12.0);
+
+  Neuron neurons[kLanes];
+  Wordset words[kLanes];
+  vector<const Neuron*> lanes_neurons;
+  for (int32 l = 0; l < kLanes; ++l) {
+    neurons[l].Init(config);
+    words[l].Config(200, neurons[l].length(), config.d1(), config.r());
+    neurons[l].StartTraining();
+    for (int32 i = 0; i < words[l].size(); ++i) {
+      neurons[l].Train(words[l].get_word(i));
+    }
+    neurons[l].FinishTraining();
+    lanes_neurons.push_back(&neurons[l]);
+  }
+
+  NeuronLanes lanes;
+  lanes.Load(lanes_neurons);
+  EXPECT_EQ(lanes.lanes(), kLanes);
+  const Word* exposed[kLanes];
+  int32 slots[kLanes];
+  int32 fired = 0;
+  int32 silent = 0;
+
+  // Each lane's own training words, and then another lane's
+  for (int32 shift = 0; shift < 2; ++shift) {
+    for (int32 i = 0; i < words[0].size(); ++i) {
+      for (int32 l = 0; l < kLanes; ++l) {
+        exposed[l] = &words[(l + shift) % kLanes].get_word(i);
+      }
+      exposed[2] = NULL;  // An idle lane
+      lanes.Expose(exposed, slots);
+      for (int32 l = 0; l < kLanes; ++l) {
+        int32 expected = (exposed[l] == NULL ? kDisabled
+                          : neurons[l].Expose(*exposed[l]));
+        EXPECT_EQ(slots[l], expected)
+            << "Lane " << l << " word " << i << ": " << slots[l]
+            << " != " << expected << "\n";
+        if (exposed[l] == NULL) continue;
+        if (expected == kDisabled) ++silent;
+        else ++fired;
+      }
+    }
+  }
+  EXPECT_TRUE(0 < fired && 0 < silent)
+      << "Expected some words to fire and others not\n";
+}
+
+// With many more containers than signals per slot, exposure and
+// training agree with NeuronLanes, which sums every container, and
+// ExposeMaxima() agrees with Expose()
+//
+TEST_F(NeuronTest, CheckManyContainers) {
+  NeuronConfig config;
+
+  config.set_c(500);
+  config.set_d1(2);
+  config.set_d2(3);
+  config.set_h(2);
+  config.set_q(1.0);
+  config.set_r(10);
+
+  Neuron neuron;
+  neuron.Init(config);
+  Wordset words;
+  words.Config(200, neuron.length(), config.d1(), config.r());
+  neuron.StartTraining();
+  int32 trained = 0;
+  for (int32 i = 0; i < words.size(); ++i) {
+    if (neuron.Train(words.get_word(i)) != kDisabled) ++trained;
+  }
+  neuron.FinishTraining();
+  EXPECT_TRUE(0 < trained) << "Expected some training words to fire\n";
+
+  vector<const Neuron*> lanes_neurons(1, &neuron);
+  NeuronLanes lanes;
+  lanes.Load(lanes_neurons);
+  vector<double> maxima;
+  for (int32 i = 0; i < words.size(); ++i) {
+    const Word* word = &words.get_word(i);
+    int32 slot;
+    lanes.Expose(&word, &slot);
+    int32 expected = neuron.Expose(*word);
+    EXPECT_EQ(slot, expected)
+        << "Word " << i << ": " << slot << " != " << expected << "\n";
+
+    neuron.ExposeMaxima(*word, &maxima);
+    int32 d = 0;
+    while (d < maxima.size() && maxima[d] + kEpsilon < neuron.H()) ++d;
+    EXPECT_EQ((d < maxima.size() ? d : kDisabled), expected);
+  }
+}
+
+// Exposure with its strength bounds fires exactly when the sums of
+// ExposeMaxima() reach H, after atrophy and after strengthening, and
+// after atrophy rejects most random words without summing any slot
+//
+TEST_F(NeuronTest, CheckFastReject) {
+  NeuronConfig config;
+
+  config.set_c(2);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(5.0);
+  config.set_r(10);
+
+  for (int32 rule = 0; rule < 2; ++rule) {
+    if (rule == 1) {
+      config.set_g_m(1.3);
+      config.set_h_m(13.0);
+    }
+    Neuron neuron;
+    neuron.Init(config);
+    Wordset words;
+    // Few enough words for atrophy to leave most synapses without strength
+    words.Config((rule == 0 ? 10 : 200), neuron.length(), config.d1(),
+                 config.r());
+    neuron.StartTraining();
+    for (int32 i = 0; i < words.size(); ++i) {
+      neuron.Train(words.get_word(i));
+    }
+    neuron.FinishTraining();
+
+    int64 exposures = neuron.exposures();
+    int64 rejections = neuron.rejections();
+    Wordset test;
+    test.CopyFrom(2000, words);
+    test.Init();
+    vector<double> maxima;
+    int32 fired = 0;
+    for (int32 i = 0; i < words.size() + test.size(); ++i) {
+      const Word& word = (i < words.size() ? words.get_word(i)
+                          : test.get_word(i - words.size()));
+      neuron.ExposeMaxima(word, &maxima);
+      int32 d = 0;
+      while (d < maxima.size() && maxima[d] + kEpsilon < neuron.H()) ++d;
+      int32 expected = (d < maxima.size() ? d : kDisabled);
+      int32 slot = neuron.Expose(word);
+      EXPECT_EQ(slot, expected)
+          << "Rule " << rule << " word " << i << ": " << slot << " != "
+          << expected << "\n";
+      if (slot != kDisabled) ++fired;
+    }
+    EXPECT_EQ(neuron.exposures() - exposures, words.size() + test.size());
+    rejections = neuron.rejections() - rejections;
+    EXPECT_TRUE(0 < fired && rejections + fired <= words.size() + test.size())
+        << "Rule " << rule << ": " << fired << " fired, " << rejections
+        << " rejected\n";
+    if (rule == 0) EXPECT_LE(test.size() / 4, rejections);
+  }
+}
+
+// The bit-sliced kernel fires each word of a batch in the same slot as
+// Neuron::Expose(), with unit weights after atrophy and scaled weights
+// after strengthening, and declines strengths with no common scale
+//
+TEST_F(NeuronTest, CheckNeuronBitSlice) {
+  NeuronConfig config;
+
+  config.set_c(2);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(5.0);
+  config.set_r(10);
+
+  for (int32 rule = 0; rule < 2; ++rule) {
+    if (rule == 1) {
+      config.set_g_m(1.3);
+      config.set_h_m(12.9);
+    }
+    Neuron neuron;
+    neuron.Init(config);
+    Wordset words;
+    words.Config(100, neuron.length(), config.d1(), config.r());
+    neuron.StartTraining();
+    for (int32 i = 0; i < words.size(); ++i) {
+      neuron.Train(words.get_word(i));
+    }
+    neuron.FinishTraining();
+
+    NeuronBitSlice bitslice;
+    EXPECT_TRUE(bitslice.Load(neuron));
+    Wordset test;
+    test.CopyFrom(1000, words);
+    test.Init();
+    const Word* exposed[NeuronBitSlice::kBatch];
+    int32 slots[NeuronBitSlice::kBatch];
+    int32 fired = 0;
+    int32 total = words.size() + test.size();
+    for (int32 first = 0; first < total; first += NeuronBitSlice::kBatch) {
+      int32 n = min(NeuronBitSlice::kBatch, total - first);
+      for (int32 i = 0; i < n; ++i) {
+        int32 k = first + i;
+        exposed[i] = (k < words.size() ? &words.get_word(k)
+                      : &test.get_word(k - words.size()));
+      }
+      bitslice.Expose(exposed, n, slots);
+      for (int32 i = 0; i < n; ++i) {
+        int32 expected = neuron.Expose(*exposed[i]);
+        EXPECT_EQ(slots[i], expected)
+            << "Rule " << rule << " word " << first + i << ": " << slots[i]
+            << " != " << expected << "\n";
+        if (expected != kDisabled) ++fired;
+      }
+    }
+    EXPECT_TRUE(0 < fired && fired < total)
+        << "Rule " << rule << ": expected some words to fire and others"
+        << " not\n";
+
+    neuron.set_strength(0, sqrt(2.0));
+    EXPECT_FALSE(bitslice.Load(neuron));
+  }
+}
+
+// A population trains and exposes each of its neurons as the neurons
+// would be on their own, under both learning rules, and draws the same
+// synapses as a run of Neurons from the same random numbers
+//
+TEST_F(NeuronTest, CheckNeuronPopulation) {
+  const int32 kSize = 2 * NeuronPopulation::kBlockSize + 11;
+  NeuronConfig config;
+
+  config.set_c(2);
+  config.set_d1(4);
+  config.set_d2(7);
+  config.set_h(10);
+  config.set_q(5.0);
+  config.set_r(10);
+
+  for (int32 rule = 0; rule < 2; ++rule) {
+    if (rule == 1) {
+      config.set_g_m(1.5);
+      config.set_h_m(12.0);
+    }
+    RandomBase random;
+    vector<MTRand::uint32> state;
+    random.SaveState(&state);
+
+    vector<Neuron> neurons(kSize);
+    vector<const Neuron*> loaded;
+    for (int32 n = 0; n < kSize; ++n) {
+      neurons[n].Init(config);
+      loaded.push_back(&neurons[n]);
+    }
+    NeuronPopulation population;
+    random.LoadState(state);
+    population.Init(config, kSize);
+    EXPECT_EQ(population.size(), kSize);
+    EXPECT_EQ(population.length(), neurons[0].length());
+    for (int32 n = 0; n < kSize; ++n) {
+      for (int32 i = 0; i < population.length(); ++i) {
+        EXPECT_TRUE(population.delays(n, i) == neurons[n].delays(i)
+                    && population.containers(n, i) == neurons[n].containers(i))
+            << "Neuron " << n << " synapse " << i << " differs\n";
+      }
+    }
+    population.Load(loaded);
+
+    Wordset train;
+    Wordset test;
+    train.Config(60, population.length(), config.d1(), config.r());
+    test.Config(200, population.length(), config.d1(), config.r());
+    vector<int32> slots(kSize);
+    population.StartTraining();
+    for (int32 n = 0; n < kSize; ++n) {
+      neurons[n].StartTraining();
+    }
+    for (int32 w = 0; w < train.size(); ++w) {
+      int32 fired = population.Train(train.get_word(w), &slots[0]);
+      int32 expected_fired = 0;
+      for (int32 n = 0; n < kSize; ++n) {
+        int32 expected = neurons[n].Train(train.get_word(w));
+        EXPECT_EQ(slots[n], expected)
+            << "Rule " << rule << " neuron " << n << " training word " << w
+            << ": " << slots[n] << " != " << expected << "\n";
+        if (expected != kDisabled) ++expected_fired;
+      }
+      EXPECT_EQ(fired, expected_fired);
+    }
+    population.FinishTraining();
+    for (int32 n = 0; n < kSize; ++n) {
+      neurons[n].FinishTraining();
+      EXPECT_EQ(population.Q_after(n), neurons[n].Q_after());
+      for (int32 i = 0; i < population.length(); ++i) {
+        EXPECT_TRUE(population.delays(n, i) == neurons[n].delays(i)
+                    && population.frozen(n, i) == neurons[n].frozen(i)
+                    && population.strength(n, i) == neurons[n].strength(i))
+            << "Rule " << rule << " neuron " << n << " synapse " << i
+            << " differs after training\n";
+      }
+    }
+
+    int32 fired = 0;
+    int32 silent = 0;
+    for (int32 w = 0; w < test.size(); ++w) {
+      population.Expose(test.get_word(w), &slots[0]);
+      for (int32 n = 0; n < kSize; ++n) {
+        int32 expected = neurons[n].Expose(test.get_word(w));
+        EXPECT_EQ(slots[n], expected)
+            << "Rule " << rule << " neuron " << n << " word " << w << ": "
+            << slots[n] << " != " << expected << "\n";
+        if (expected == kDisabled) ++silent;
+        else ++fired;
+      }
+    }
+    EXPECT_TRUE(0 < fired && 0 < silent)
+        << "Expected some words to fire and others not\n";
+  }
+}
+
 }  // namespace cognon
 
 
@@ -495,6 +819,11 @@ int main(int argc, char **argv) {
   CALL_TEST(cognon::CheckSynapseAtrophy);
   CALL_TEST(cognon::CheckSynapseStrength);
   CALL_TEST(cognon::TestWordsetFixed);
+  CALL_TEST(cognon::CheckNeuronLanes);
+  CALL_TEST(cognon::CheckManyContainers);
+  CALL_TEST(cognon::CheckFastReject);
+  CALL_TEST(cognon::CheckNeuronBitSlice);
+  CALL_TEST(cognon::CheckNeuronPopulation);
 
   CALL_TEST(cognon::NAME_TEST_REPLAY_SA(40,1,1,1,10,0.64,10));
   CALL_TEST(cognon::NAME_TEST_REPLAY_SA(925,1,1,1,30,0.69556666,10));
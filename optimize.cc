@@ -0,0 +1,257 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "optimize.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "cognon_stats.h"
+
+namespace cognon {
+
+SearchScheduler::SearchScheduler(int32 repetitions)
+    : repetitions_(repetitions), rounds_(0) {
+}
+
+void SearchScheduler::AddTask(SearchTask* task) {
+  CHECK_NOTNULL(task);
+  tasks_.push_back(task);
+}
+
+void SearchScheduler::Run() {
+  vector<bool> finished(tasks_.size(), false);
+  int32 reported = 0;
+  vector<TrainConfig> configs;
+  vector<double> fidelities;
+  vector<NeuronStatistics> results;
+  vector<TrainConfig> batch;
+  vector<vector<NeuronStatistics> > task_results(tasks_.size());
+
+  // Where each task's batch starts in configs, and its size
+  vector<int32> offsets(tasks_.size());
+  vector<int32> counts(tasks_.size());
+
+  rounds_ = 0;
+  for (;;) {
+    configs.clear();
+    fidelities.clear();
+    for (int32 t = 0; t < tasks_.size(); ++t) {
+      counts[t] = 0;
+      if (finished[t]) continue;
+
+      double fidelity = 1.0;
+      if (!tasks_[t]->Step(&batch, &fidelity)) {
+        finished[t] = true;
+        continue;
+      }
+      offsets[t] = configs.size();
+      counts[t] = batch.size();
+      configs.insert(configs.end(), batch.begin(), batch.end());
+      fidelities.resize(configs.size(), fidelity);
+    }
+
+    // Report the finished tasks in order
+    while (reported < tasks_.size() && finished[reported]) {
+      tasks_[reported++]->Report();
+    }
+    if (configs.size() == 0) break;
+
+    RunConfigurations(repetitions_, fidelities, configs, &results);
+    ++rounds_;
+
+    // Hand each task its results by swapping, so that results and each
+    // task's batch keep their storage from round to round.
+    //
+    for (int32 t = 0; t < tasks_.size(); ++t) {
+      if (finished[t]) continue;
+      vector<NeuronStatistics>& batch_results = task_results[t];
+      batch_results.resize(counts[t]);
+      for (int32 i = 0; i < counts[t]; ++i) {
+        batch_results[i].Swap(&results[offsets[t] + i]);
+      }
+      tasks_[t]->Resume(batch_results);
+    }
+  }
+}
+
+bool RowConstraint::Feasible(const NeuronStatistics& result) const {
+  double d_eff = Mean(result.d_effective());
+  double pL = Mean(result.true_true());
+  double pF = Mean(result.false_true());
+  return (0.4 < d_eff && pF < pL && pF < 0.03);
+}
+
+bool RowConstraint::Hopeless(const NeuronStatistics& predicted) const {
+  return (Mean(predicted.true_true()) < kEpsilon
+          || 0.1 < Mean(predicted.false_true()));
+}
+
+void PredictionError::Add(const NeuronStatistics& predicted,
+                          const NeuronStatistics& simulated) {
+  AddSample(Mean(simulated.true_true()) - Mean(predicted.true_true()),
+            &pL_);
+  AddSample(Mean(simulated.false_true()) - Mean(predicted.false_true()),
+            &pF_);
+  AddSample(Mean(simulated.bits_per_neuron())
+            - Mean(predicted.bits_per_neuron()), &bpn_);
+}
+
+string PredictionError::ToString() const {
+  return StringPrintf("# surrogate: %d pruned, %d compared, "
+                      "pL error %f stddev %f, pF error %f stddev %f, "
+                      "bpn error %f stddev %f\n",
+                      pruned_, compared(), Mean(pL_), Stddev(pL_),
+                      Mean(pF_), Stddev(pF_), Mean(bpn_), Stddev(bpn_));
+}
+
+// Orders candidates for promotion: feasible ones first, then by bits
+// per neuron, then by index so that ties are broken deterministically.
+//
+struct Ranking {
+  int32 index;
+  bool feasible;
+  double bpn;
+};
+
+static bool operator<(const Ranking& a, const Ranking& b) {
+  if (a.feasible != b.feasible) return a.feasible;
+  if (a.bpn != b.bpn) return b.bpn < a.bpn;
+  return a.index < b.index;
+}
+
+SuccessiveHalving::SuccessiveHalving(int32 repetitions,
+                                     const SearchConstraint* constraint)
+    : repetitions_(repetitions), constraint_(constraint),
+      eta_(8), min_fidelity_(1.0 / 512.0), surrogate_(false),
+      warm_start_(-1),
+      fidelity_(1.0), done_(true), best_(-1), best_index_(-1), cost_(0.0) {
+  CHECK_NOTNULL(constraint);
+}
+
+int32 SuccessiveHalving::Search(const vector<TrainConfig>& candidates,
+                                int32 warm_start, NeuronStatistics* optimal) {
+  Start(candidates, warm_start);
+
+  SearchScheduler scheduler(repetitions_);
+  scheduler.AddTask(this);
+  scheduler.Run();
+
+  if (best_ < 0) return -1;
+  optimal->CopyFrom(finalists_[best_index_]);
+  return best_;
+}
+
+void SuccessiveHalving::Start(const vector<TrainConfig>& candidates,
+                              int32 warm_start) {
+  CHECK_LT(1, eta_);
+  candidates_ = candidates;
+  warm_start_ = warm_start;
+  finalists_.clear();
+  best_ = -1;
+  best_index_ = -1;
+  cost_ = 0.0;
+  error_ = PredictionError();
+
+  predicted_.assign(candidates.size(), false);
+  predictions_.resize(candidates.size());
+  alive_.clear();
+  for (int32 i = 0; i < candidates.size(); ++i) {
+    if (surrogate_) {
+      predicted_[i] = PredictConfiguration(candidates[i], &predictions_[i]);
+      if (predicted_[i] && i != warm_start
+          && constraint_->Hopeless(predictions_[i])) {
+        error_.AddPruned();
+        continue;
+      }
+    }
+    alive_.push_back(i);
+  }
+  done_ = (alive_.size() == 0);
+
+  // Start at the fidelity from which repeatedly keeping 1/eta of the
+  // candidates leaves about one at full fidelity.
+  //
+  fidelity_ = 1.0;
+  for (int32 n = alive_.size(); 1 < n; n = (n + eta_ - 1) / eta_) {
+    fidelity_ /= eta_;
+  }
+  if (fidelity_ < min_fidelity_) fidelity_ = min_fidelity_;
+}
+
+bool SuccessiveHalving::Step(vector<TrainConfig>* configs, double* fidelity) {
+  if (done_) return false;
+
+  configs->resize(alive_.size());
+  for (int32 i = 0; i < alive_.size(); ++i) {
+    (*configs)[i].CopyFrom(candidates_[alive_[i]]);
+  }
+  *fidelity = fidelity_;
+  return true;
+}
+
+void SuccessiveHalving::Resume(const vector<NeuronStatistics>& results) {
+  CHECK(!done_ && results.size() == alive_.size());
+  cost_ += fidelity_ * alive_.size();
+
+  if (1.0 <= fidelity_) {
+    Finish(results);
+    return;
+  }
+
+  vector<Ranking> ranking(alive_.size());
+  for (int32 i = 0; i < alive_.size(); ++i) {
+    ranking[i].index = alive_[i];
+    ranking[i].feasible = constraint_->Feasible(results[i]);
+    ranking[i].bpn = Mean(results[i].bits_per_neuron());
+  }
+  sort(ranking.begin(), ranking.end());
+
+  int32 keep = (alive_.size() + eta_ - 1) / eta_;
+  bool kept_warm_start = (warm_start_ < 0);
+  alive_.resize(keep);
+  for (int32 i = 0; i < keep; ++i) {
+    alive_[i] = ranking[i].index;
+    if (alive_[i] == warm_start_) kept_warm_start = true;
+  }
+  if (!kept_warm_start) alive_.push_back(warm_start_);
+  sort(alive_.begin(), alive_.end());
+
+  fidelity_ *= eta_;
+  if (1.0 < fidelity_) fidelity_ = 1.0;
+}
+
+void SuccessiveHalving::Finish(const vector<NeuronStatistics>& results) {
+  finalists_.resize(results.size());
+  for (int32 i = 0; i < results.size(); ++i) {
+    finalists_[i].CopyFrom(results[i]);
+    if (predicted_[alive_[i]]) {
+      error_.Add(predictions_[alive_[i]], results[i]);
+    }
+    if (!constraint_->Feasible(results[i])) continue;
+    if (best_index_ < 0 || (Mean(results[best_index_].bits_per_neuron())
+                            < Mean(results[i].bits_per_neuron()))) {
+      best_index_ = i;
+    }
+  }
+  if (0 <= best_index_) best_ = alive_[best_index_];
+  done_ = true;
+}
+
+}  // namespace cognon
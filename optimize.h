@@ -0,0 +1,223 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Searches over neuron configurations for the one that stores the
+// most bits per neuron, subject to a search's constraints.
+//
+#ifndef COGNON_OPTIMIZE_H_
+#define COGNON_OPTIMIZE_H_
+
+#include "cognon.h"
+
+namespace cognon {
+
+// A resumable search.  Rather than running configurations itself, a
+// search task hands each batch of configurations it wants evaluated to
+// a SearchScheduler and is resumed with their results, so that many
+// searches can share one pool of worker threads.
+//
+class SearchTask {
+ public:
+  virtual ~SearchTask() { }
+
+  // Set configs to the next batch of configurations to evaluate at
+  // fidelity (see RunConfigurations()), or return false once the
+  // search has finished.  Until Resume() is called, repeated calls
+  // return the same batch.
+  //
+  virtual bool Step(vector<TrainConfig>* configs, double* fidelity) = 0;
+
+  // Continue the search with the results of the batch from Step()
+  virtual void Resume(const vector<NeuronStatistics>& results) = 0;
+
+  // Called once the search has finished.  Tasks report in the order
+  // they were added to the scheduler, whatever order they finish in.
+  //
+  virtual void Report() { }
+};
+
+// Runs search tasks in rounds.  Each round collects the pending batch
+// of every unfinished task and evaluates all of them in one parallel
+// pool, then resumes each task with its results.
+//
+// The caller retains ownership of the tasks, but must ensure that they
+// outlive Run().
+//
+class SearchScheduler {
+ public:
+  explicit SearchScheduler(int32 repetitions);
+  ~SearchScheduler() { }
+
+  void AddTask(SearchTask* task);
+
+  // Run every task to completion
+  void Run();
+
+  // The number of rounds taken by the last Run()
+  int32 rounds() const { return rounds_; }
+
+ private:
+  int32 repetitions_;
+  vector<SearchTask*> tasks_;
+  int32 rounds_;
+};
+
+// Decides whether a result satisfies a search's constraints
+class SearchConstraint {
+ public:
+  virtual ~SearchConstraint() { }
+  virtual bool Feasible(const NeuronStatistics& result) const = 0;
+
+  // Whether a predicted result (see PredictConfiguration()) is so far
+  // from feasible, allowing for the model's error, that simulating the
+  // configuration is pointless.  By default nothing is.
+  //
+  virtual bool Hopeless(const NeuronStatistics& predicted) const {
+    return false;
+  }
+};
+
+// The constraints used by OptimizeRow(): d_eff > 0.4, pF < 0.03,
+// and pF < pL.  A prediction is hopeless if it learns nothing or its
+// pF is over 0.1, where the grid walk stops for too many false
+// positives.
+//
+class RowConstraint : public SearchConstraint {
+ public:
+  virtual bool Feasible(const NeuronStatistics& result) const;
+  virtual bool Hopeless(const NeuronStatistics& predicted) const;
+};
+
+// The error of the analytic model's predictions (see
+// PredictConfiguration()) against simulated results, and the number of
+// candidates pruned on its predictions alone.
+//
+class PredictionError {
+ public:
+  PredictionError() : pruned_(0) { }
+  ~PredictionError() { }
+
+  void Add(const NeuronStatistics& predicted,
+           const NeuronStatistics& simulated);
+  void AddPruned() { ++pruned_; }
+
+  int32 pruned() const { return pruned_; }
+  int32 compared() const { return pL_.count(); }
+
+  // A comment line for the table output: the candidates pruned and
+  // compared, and the mean and stddev of simulated minus predicted pL,
+  // pF and bits per neuron.
+  //
+  string ToString() const;
+
+ private:
+  int32 pruned_;
+  Statistic pL_;
+  Statistic pF_;
+  Statistic bpn_;
+};
+
+// Successive halving searches a list of candidate configurations.
+// The first rung evaluates every candidate at a small fraction of the
+// full fidelity (see RunConfigurations()).  Each later rung keeps the
+// best 1/eta of the candidates, feasible ones first and then by bits
+// per neuron, and evaluates them at eta times the fidelity, until the
+// survivors run at full fidelity.  The candidates of a rung all run
+// concurrently.
+//
+// Each rung is one batch, so a SuccessiveHalving can also run as a
+// task alongside other searches: Start() it and add it to a
+// SearchScheduler.
+//
+// The caller retains ownership of constraint, but must ensure that
+// it outlives the SuccessiveHalving.
+//
+class SuccessiveHalving : public SearchTask {
+ public:
+  SuccessiveHalving(int32 repetitions, const SearchConstraint* constraint);
+  virtual ~SuccessiveHalving() { }
+
+  void set_eta(int32 eta) { eta_ = eta; }
+  void set_min_fidelity(double fidelity) { min_fidelity_ = fidelity; }
+
+  // Predict each candidate before the first rung, and drop the ones
+  // the constraint finds hopeless (except the warm start)
+  //
+  void set_surrogate(bool surrogate) { surrogate_ = surrogate; }
+
+  // Search the candidates, always promoting candidates[warm_start]
+  // (e.g. the previous search's optimum) unless warm_start is negative.
+  // Returns the index of the feasible candidate with the most bits per
+  // neuron at full fidelity and sets optimal to its result, or returns
+  // -1 if no finalist was feasible.
+  //
+  int32 Search(const vector<TrainConfig>& candidates, int32 warm_start,
+               NeuronStatistics* optimal);
+
+  // Begin a search without running it
+  void Start(const vector<TrainConfig>& candidates, int32 warm_start);
+
+  virtual bool Step(vector<TrainConfig>* configs, double* fidelity);
+  virtual void Resume(const vector<NeuronStatistics>& results);
+
+  // The result of a finished search: as Search() returns, and the
+  // result of the optimal candidate.
+  //
+  int32 best() const { return best_; }
+  const NeuronStatistics& optimal() const { return finalists_[best_index_]; }
+
+  // The full fidelity results of the last search
+  const vector<NeuronStatistics>& finalists() const { return finalists_; }
+
+  // The cost of the last search, in full fidelity evaluations
+  double cost() const { return cost_; }
+
+  // The surrogate's pruning and error against the finalists in the
+  // last search
+  //
+  const PredictionError& prediction_error() const { return error_; }
+
+ private:
+  void Finish(const vector<NeuronStatistics>& results);
+
+  int32 repetitions_;
+  const SearchConstraint* constraint_;
+  int32 eta_;
+  double min_fidelity_;
+  bool surrogate_;
+
+  // Search state
+  vector<TrainConfig> candidates_;
+  int32 warm_start_;
+  vector<int32> alive_;
+  double fidelity_;
+  bool done_;
+
+  int32 best_;
+  int32 best_index_;
+  vector<NeuronStatistics> finalists_;
+  double cost_;
+
+  // Predictions of the candidates, where the model covers them
+  vector<bool> predicted_;
+  vector<NeuronStatistics> predictions_;
+  PredictionError error_;
+};
+
+}  // namespace cognon
+
+#endif  // COGNON_OPTIMIZE_H_
@@ -0,0 +1,232 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Tests SearchScheduler and SuccessiveHalving.
+//
+
+#include "optimize.h"
+
+#include "cognon_stats.h"
+
+#include <math.h>
+#include <sys/param.h>
+
+namespace cognon {
+
+class OptimizeTest : public testing::Test {
+};
+
+class AlwaysFeasible : public SearchConstraint {
+ public:
+  virtual bool Feasible(const NeuronStatistics& result) const { return true; }
+};
+
+class NeverFeasible : public SearchConstraint {
+ public:
+  virtual bool Feasible(const NeuronStatistics& result) const { return false; }
+};
+
+// Candidates differing only in the number of words trained
+static void MakeCandidates(vector<TrainConfig>* candidates) {
+  candidates->resize(20);
+  for (int32 i = 0; i < candidates->size(); ++i) {
+    TrainConfig& config = (*candidates)[i];
+    config.set_w(5 * (i + 1));
+    config.set_num_test_words(1000);
+    config.mutable_config()->set_c(1);
+    config.mutable_config()->set_d1(1);
+    config.mutable_config()->set_d2(1);
+    config.mutable_config()->set_h(10);
+    config.mutable_config()->set_q(0.362000);
+    config.mutable_config()->set_r(30);
+  }
+}
+
+// Asks for steps batches of size words trained, then reports its
+// order of completion.
+//
+class CountingTask : public SearchTask {
+ public:
+  CountingTask(int32 steps, int32 size, vector<int32>* reports)
+      : steps_(steps), size_(size), resumed_(0), reports_(reports) { }
+  virtual bool Step(vector<TrainConfig>* configs, double* fidelity) {
+    if (steps_ <= resumed_) return false;
+    MakeCandidates(configs);
+    configs->resize(1);
+    (*configs)[0].set_w(size_);
+    *fidelity = 0.5;
+    return true;
+  }
+  virtual void Resume(const vector<NeuronStatistics>& results) {
+    EXPECT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].config().w(), size_);
+    ++resumed_;
+  }
+  virtual void Report() { reports_->push_back(size_); }
+  int32 resumed() const { return resumed_; }
+ private:
+  int32 steps_;
+  int32 size_;
+  int32 resumed_;
+  vector<int32>* reports_;
+};
+
+TEST_F(OptimizeTest, CheckSearchScheduler) {
+  vector<int32> reports;
+  CountingTask a(3, 10, &reports);
+  CountingTask b(1, 20, &reports);
+  CountingTask c(2, 30, &reports);
+
+  SearchScheduler scheduler(1);
+  scheduler.AddTask(&a);
+  scheduler.AddTask(&b);
+  scheduler.AddTask(&c);
+  scheduler.Run();
+
+  // The tasks run together, and report in the order they were added
+  EXPECT_EQ(scheduler.rounds(), 3);
+  EXPECT_EQ(a.resumed(), 3);
+  EXPECT_EQ(b.resumed(), 1);
+  EXPECT_EQ(c.resumed(), 2);
+  EXPECT_EQ(reports.size(), 3);
+  for (int32 i = 0; i < reports.size(); ++i) {
+    EXPECT_EQ(reports[i], 10 * (i + 1));
+  }
+}
+
+TEST_F(OptimizeTest, CheckSuccessiveHalving) {
+  vector<TrainConfig> candidates;
+  MakeCandidates(&candidates);
+
+  // 20 candidates with eta 4: 20 at 1/64, 5 at 1/16, 2 at 1/4, and
+  // 1 at full fidelity
+  AlwaysFeasible feasible;
+  SuccessiveHalving search(1, &feasible);
+  search.set_eta(4);
+  NeuronStatistics optimal;
+  int32 best = search.Search(candidates, -1, &optimal);
+  EXPECT_LE(0, best);
+  EXPECT_EQ(search.finalists().size(), 1);
+  EXPECT_TRUE(fabs(search.cost() - 2.125) < 1e-9)
+      << "Expected cost 2.125: " << search.cost() << "\n";
+  EXPECT_EQ(optimal.config().w(), candidates[best].w());
+  for (int32 i = 0; i < search.finalists().size(); ++i) {
+    EXPECT_LE(Mean(search.finalists()[i].bits_per_neuron()),
+              Mean(optimal.bits_per_neuron()));
+  }
+
+  // The warm start always reaches full fidelity
+  bool found = false;
+  search.Search(candidates, 19, &optimal);
+  for (int32 i = 0; i < search.finalists().size(); ++i) {
+    if (search.finalists()[i].config().w() == candidates[19].w()) found = true;
+  }
+  EXPECT_TRUE(found) << "Warm start was not a finalist\n";
+
+  // Nothing feasible
+  NeverFeasible infeasible;
+  SuccessiveHalving none(1, &infeasible);
+  none.set_eta(4);
+  EXPECT_EQ(none.Search(candidates, -1, &optimal), -1);
+}
+
+TEST_F(OptimizeTest, CheckSurrogate) {
+  // Candidates whose false positives grow with w, so that the model
+  // finds some but not all of them hopeless
+  vector<TrainConfig> candidates;
+  int32 words[] = {5, 10, 20, 40, 60};
+  double Q[] = {1.0, 1.4};
+  for (int32 q = 0; q < 2; ++q) {
+    for (int32 i = 0; i < 5; ++i) {
+      candidates.resize(candidates.size() + 1);
+      TrainConfig& config = candidates.back();
+      config.set_w(words[i]);
+      config.set_num_test_words(1000);
+      config.mutable_config()->set_c(1);
+      config.mutable_config()->set_d1(1);
+      config.mutable_config()->set_d2(1);
+      config.mutable_config()->set_h(40);
+      config.mutable_config()->set_q(Q[q]);
+      config.mutable_config()->set_r(40);
+      config.mutable_config()->set_g_m(1.9);
+      config.mutable_config()->set_h_m(76.0);
+    }
+  }
+
+  RowConstraint constraint;
+  int32 hopeless = 0;
+  NeuronStatistics prediction;
+  for (int32 i = 0; i < candidates.size(); ++i) {
+    EXPECT_TRUE(PredictConfiguration(candidates[i], &prediction));
+    if (constraint.Hopeless(prediction)) ++hopeless;
+  }
+  EXPECT_TRUE(0 < hopeless && hopeless < candidates.size())
+      << "Expected some hopeless candidates: " << hopeless << "\n";
+
+  // Without the surrogate nothing is pruned or compared
+  SuccessiveHalving plain(1, &constraint);
+  plain.set_eta(4);
+  NeuronStatistics optimal;
+  plain.Search(candidates, -1, &optimal);
+  EXPECT_EQ(plain.prediction_error().pruned(), 0);
+  EXPECT_EQ(plain.prediction_error().compared(), 0);
+
+  // With it the hopeless candidates never run, and every finalist is
+  // compared with its prediction
+  SuccessiveHalving search(1, &constraint);
+  search.set_eta(4);
+  search.set_surrogate(true);
+  search.Search(candidates, -1, &optimal);
+  const PredictionError& error = search.prediction_error();
+  EXPECT_EQ(error.pruned(), hopeless);
+  EXPECT_EQ(error.compared(), search.finalists().size());
+  for (int32 i = 0; i < search.finalists().size(); ++i) {
+    const NeuronStatistics& finalist = search.finalists()[i];
+    EXPECT_TRUE(PredictConfiguration(finalist.config(), &prediction));
+    EXPECT_FALSE(constraint.Hopeless(prediction));
+    EXPECT_TRUE(fabs(Mean(finalist.true_true())
+                     - Mean(prediction.true_true())) < 0.1)
+        << "Predicted pL " << Mean(prediction.true_true())
+        << ", simulated " << Mean(finalist.true_true()) << "\n";
+  }
+
+  // A prediction is the same after its model has been evicted by
+  // more recently used ones
+  NeuronStatistics first;
+  EXPECT_TRUE(PredictConfiguration(candidates[0], &first));
+  TrainConfig other(candidates[0]);
+  for (int32 i = 0; i < 20; ++i) {
+    other.mutable_config()->set_h_m(60.0 + i);
+    EXPECT_TRUE(PredictConfiguration(other, &prediction));
+  }
+  EXPECT_TRUE(PredictConfiguration(candidates[0], &prediction));
+  EXPECT_EQ(Mean(prediction.true_true()), Mean(first.true_true()));
+  EXPECT_EQ(Mean(prediction.false_true()), Mean(first.false_true()));
+
+  // Non-simple neurons are not predicted
+  candidates[0].mutable_config()->set_c(2);
+  EXPECT_FALSE(PredictConfiguration(candidates[0], &prediction));
+}
+
+}  // namespace cognon
+
+int main(int argc, char **argv) {
+  CALL_TEST(cognon::CheckSearchScheduler);
+  CALL_TEST(cognon::CheckSuccessiveHalving);
+  CALL_TEST(cognon::CheckSurrogate);
+}
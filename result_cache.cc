@@ -0,0 +1,166 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "result_cache.h"
+
+#include <stdio.h>
+
+namespace cognon {
+
+ResultCache::ResultCache() : seed_(0), bad_records_(0) {
+}
+
+ResultCache::~ResultCache() {
+}
+
+// Each record is the archived seed, the repetition number (from
+// version 4; -1 for the repetitions of Add()) and NeuronStatistics.
+//
+bool ResultCache::Open(const string& filename, int32 seed) {
+  writer_.Close();
+  results_.clear();
+  bad_records_ = 0;
+  seed_ = seed;
+
+  RecordReader reader;
+  if (!reader.Open(filename)) return false;
+
+  const char* data;
+  size_t size;
+  vector<string> upgraded;
+  while (reader.Next(&data, &size)) {
+    int32 record_seed;
+    int32 repetition = -1;
+    NeuronStatistics result;
+    InputArchive in(data, size, reader.version());
+    in & record_seed;
+    if (4 <= reader.version()) in & repetition;
+    in & result;
+    if (!in.ok() || in.position() != size) {
+      ++bad_records_;
+      continue;
+    }
+    if (reader.version() < kArchiveVersion) {
+      upgraded.resize(upgraded.size() + 1);
+      OutputArchive out(&upgraded.back());
+      out & record_seed;
+      out & repetition;
+      out & result;
+    }
+    if (record_seed != seed_) continue;
+    Insert(repetition, result);
+  }
+  if (reader.bad_tail()) ++bad_records_;
+  size_t end = reader.end();
+  bool old = (0 < end && reader.version() < kArchiveVersion);
+  reader.Close();
+
+  // New records are written at this version, so first rewrite the
+  // records of an older file, and atomically replace it.
+  //
+  if (old) {
+    string temp = filename + ".tmp";
+    RecordWriter writer;
+    if (!writer.Open(temp, 0)) return false;
+    for (int32 i = 0; i < upgraded.size(); ++i) {
+      if (!writer.Write(upgraded[i])) return false;
+    }
+    writer.Close();
+    if (rename(temp.c_str(), filename.c_str()) != 0) return false;
+    end = static_cast<size_t>(-1);  // Nothing to drop
+  }
+
+  // Drop any partial record so that new records follow the good ones
+  return writer_.Open(filename, end);
+}
+
+string ResultCache::Key(const TrainConfig& config) const {
+  string key;
+  OutputArchive out(&key);
+  out & seed_;
+  out & config;
+  return key;
+}
+
+void ResultCache::Insert(int32 repetition, const NeuronStatistics& result) {
+  Entry& entry = results_[Key(result.config())];
+  if (repetition < 0) {
+    entry.unnumbered += result;
+    entry.unnumbered_count += result.synapses_per_neuron().count();
+  } else {
+    // A repetition recorded again replaces the earlier one
+    entry.numbered[repetition].CopyFrom(result);
+  }
+}
+
+bool ResultCache::Write(int32 repetition, const NeuronStatistics& result) {
+  string record;
+  OutputArchive out(&record);
+  out & seed_;
+  out & repetition;
+  out & result;
+  return writer_.Write(record);
+}
+
+const ResultCache::Entry* ResultCache::Find(const TrainConfig& config) const {
+  CHECK(config.has_num_test_words());
+  map<string, Entry>::const_iterator it = results_.find(Key(config));
+  return (it == results_.end() ? NULL : &it->second);
+}
+
+int32 ResultCache::Lookup(const TrainConfig& config,
+                          NeuronStatistics* result) const {
+  const Entry* entry = Find(config);
+  if (entry == NULL) return 0;
+
+  result->Clear();
+  result->mutable_config()->CopyFrom(config);
+  *result += entry->unnumbered;
+  for (map<int32, NeuronStatistics>::const_iterator it =
+           entry->numbered.begin(); it != entry->numbered.end(); ++it) {
+    *result += it->second;
+  }
+  return result->synapses_per_neuron().count();
+}
+
+bool ResultCache::Add(const NeuronStatistics& result) {
+  CHECK(result.config().has_num_test_words());
+
+  // Only the summary statistics are kept
+  NeuronStatistics summary;
+  summary.CopyFrom(result);
+  NeuronStatisticsStripValues(&summary);
+  if (!Write(-1, summary)) return false;
+  Insert(-1, summary);
+  return true;
+}
+
+bool ResultCache::AddRepetition(int32 repetition,
+                                const NeuronStatistics& result) {
+  CHECK(result.config().has_num_test_words());
+  CHECK(0 <= repetition);
+
+  NeuronStatistics summary;
+  summary.CopyFrom(result);
+  NeuronStatisticsStripValues(&summary);
+  if (!Write(repetition, summary)) return false;
+  Insert(repetition, summary);
+  return true;
+}
+
+}  // namespace cognon
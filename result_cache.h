@@ -0,0 +1,113 @@
+// Copyright 2009-2011 Carl Staelin. All Rights Reserved.
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Author: carl.staelin@gmail.com (Carl Staelin)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A persistent cache of simulation results.  Each record holds the
+// results of some repetitions of one configuration; records for the
+// same configuration accumulate, so a later run can add repetitions to
+// the ones already cached instead of redoing them.
+//
+// Records written as each repetition finishes also make the cache a
+// checkpoint: a run that is killed and restarted with the same cache
+// repeats only the repetitions that were in progress.
+//
+#ifndef COGNON_RESULT_CACHE_H_
+#define COGNON_RESULT_CACHE_H_
+
+#include <map>
+#include <string>
+
+#include "archive.h"
+#include "cognon.h"
+
+namespace cognon {
+
+class ResultCache {
+ public:
+  ResultCache();
+  ~ResultCache();
+
+  // Load the records in filename (a file of records, see archive.h),
+  // which is created if it does not exist, and append new records to
+  // it.  The records are keyed by seed as well as configuration, so
+  // different seeds give independent sets of results.  Returns false
+  // if the file could not be opened.
+  //
+  bool Open(const string& filename, int32 seed);
+
+  // Set result to the accumulated results for config, which must have
+  // its num_test_words set (the per-neuron fidelity), and return the
+  // number of repetitions it holds; or return zero if there are none.
+  //
+  int32 Lookup(const TrainConfig& config, NeuronStatistics* result) const;
+
+  // Record more repetitions of result.config().  Returns false, and
+  // records nothing, if the record could not be written.
+  //
+  bool Add(const NeuronStatistics& result);
+
+  // Record repetition number repetition of result.config(), which
+  // result holds alone.  Returns false, and records nothing, if the
+  // record could not be written.
+  //
+  bool AddRepetition(int32 repetition, const NeuronStatistics& result);
+
+  // The repetitions cached for a configuration
+  struct Entry {
+    Entry() : unnumbered_count(0) { }
+
+    // The repetitions recorded by Add(), which count as the
+    // configuration's first ones, and how many there are
+    //
+    NeuronStatistics unnumbered;
+    int32 unnumbered_count;
+
+    // The repetitions recorded by AddRepetition(), by number
+    map<int32, NeuronStatistics> numbered;
+  };
+
+  // The repetitions cached for config, or NULL if there are none.  The
+  // entry is valid until the next Open(), Add() or AddRepetition().
+  //
+  const Entry* Find(const TrainConfig& config) const;
+
+  // The number of records loaded by Open() that could not be read,
+  // such as one truncated by a crash while it was being written, which
+  // Open() removes.
+  //
+  int32 bad_records() const { return bad_records_; }
+
+ private:
+  // The cache key for config: its serialized form, plus the seed
+  string Key(const TrainConfig& config) const;
+
+  // Add a record's repetitions to its entry
+  void Insert(int32 repetition, const NeuronStatistics& result);
+
+  // Write a record, stripping result's values.  Returns false if the
+  // record could not be written.
+  //
+  bool Write(int32 repetition, const NeuronStatistics& result);
+
+  RecordWriter writer_;
+  int32 seed_;
+  int32 bad_records_;
+  map<string, Entry> results_;
+};
+
+}  // namespace cognon
+
+#endif  // COGNON_RESULT_CACHE_H_
@@ -25,17 +25,105 @@
 // the highest L (bpn) value that also meets the two
 // homology constraints.
 //
+// With -s it instead screens the whole grid by successive
+// halving (see optimize.h), warm-started from the optimum for
+// the previous H.  With -r FILE results are cached in FILE (see
+// result_cache.h), so a rerun only simulates what is missing.  With
+// -p the analytic model (see cognon_stats.h) screens each candidate
+// first, and those it predicts to be hopeless are not simulated; the
+// model's error against the simulated candidates follows each row.
+//
+
+#include <unistd.h>
+
+#include <map>
+#include <utility>
 
 #include "cognon.h"
+#include "cognon_stats.h"
 #include "monograph.h"
+#include "optimize.h"
+#include "result_cache.h"
 
 namespace cognon {
 
+static bool surrogate = false;
+
+// The homology constraints: 0.4 < R * pL < max_rpl, d_eff > 0.4,
+// and pF < 0.1.  A prediction is hopeless if its R * pL or pF misses
+// by more than a factor of two.
+//
+class HomologyConstraint : public SearchConstraint {
+ public:
+  explicit HomologyConstraint(double max_rpl) : max_rpl_(max_rpl) { }
+  virtual bool Feasible(const NeuronStatistics& result) const {
+    double rpl = result.config().config().r() * Mean(result.true_true());
+    double d_eff = Mean(result.d_effective());
+    double pF = Mean(result.false_true());
+    return (0.4 < rpl && rpl < max_rpl_ && 0.4 < d_eff && pF < 0.1);
+  }
+  virtual bool Hopeless(const NeuronStatistics& predicted) const {
+    double rpl = (predicted.config().config().r()
+                  * Mean(predicted.true_true()));
+    double pF = Mean(predicted.false_true());
+    return (rpl < 0.2 || 2.0 * max_rpl_ < rpl || 0.2 < pF);
+  }
+ private:
+  double max_rpl_;
+};
+
+void SearchConfiguration(int32 H, int32 R, double max_rpl) {
+  const int32 repetitions = 10;
+  static map<pair<int32, double>, TrainConfig> previous;
+
+  // Warm start from the optimum for the previous H with this R
+  map<pair<int32, double>, TrainConfig>::const_iterator warm =
+      previous.find(make_pair(R, max_rpl));
+  vector<TrainConfig> candidates;
+  int32 warm_start = -1;
+  double warm_distance = 0.0;
+
+  for (double G_m = 1.9; 1.0 < G_m ; G_m -= 0.1) {
+    double H_m = (double)H * G_m;
+    for (double Q = 0.5; Q < 1.5; Q += 0.1) {
+      for (int32 w = 1; w <= 100; w += (w < 10 ? 1 : 10)) {
+        candidates.resize(candidates.size() + 1);
+        SetTableConfig(w, -1, 1, 1, 1, H, Q, R, G_m, H_m, &candidates.back());
+        if (warm == previous.end()) continue;
+
+        // Distance in grid steps from the previous optimum
+        const NeuronConfig& optimum = warm->second.config();
+        double distance = fabs(G_m - optimum.g_m()) / 0.1
+            + fabs(Q - optimum.q()) / 0.1
+            + fabs(log(w / static_cast<double>(warm->second.w()))) / log(2.0);
+        if (warm_start < 0 || distance < warm_distance) {
+          warm_start = candidates.size() - 1;
+          warm_distance = distance;
+        }
+      }
+    }
+  }
+
+  HomologyConstraint constraint(max_rpl);
+  SuccessiveHalving search(repetitions, &constraint);
+  search.set_surrogate(surrogate);
+  NeuronStatistics optimal;
+  int32 best = search.Search(candidates, warm_start, &optimal);
+  if (surrogate) fputs(search.prediction_error().ToString().c_str(), stdout);
+  if (0 <= best) {
+    previous[make_pair(R, max_rpl)].CopyFrom(optimal.config());
+    PrintTableResults(optimal);
+  }
+}
+
 void OptimizeConfiguration(int32 H, int32 R, double max_rpl) {
   double optimal_bpn = -1.0;
   NeuronStatistics optimal;
   NeuronStatistics result;
   TrainConfig config;
+  HomologyConstraint constraint(max_rpl);
+  NeuronStatistics prediction;
+  PredictionError error;
 
   for (double G_m = 1.9; 1.0 < G_m ; G_m -= 0.1) {
     double H_m = (double)H * G_m;
@@ -46,14 +134,22 @@ void OptimizeConfiguration(int32 H, int32 R, double max_rpl) {
         config.clear();
         result.clear();
 
+        // A hopeless prediction is skipped without being simulated.
+        // Only simulated results count towards the early stops, and
+        // small w can be hopeless where larger w are not.
+        //
+        SetTableConfig(w, -1, 1, 1, 1, H, Q, R, G_m, H_m, &config);
+        bool predicted = (surrogate
+                          && PredictConfiguration(config, &prediction));
+        if (predicted && constraint.Hopeless(prediction)) {
+          error.AddPruned();
+          continue;
+        }
         RunTableRow(w, -1, 1, 1, 1, H, Q, R, G_m, H_m, &config, &result);
+        if (predicted) error.Add(prediction, result);
 
-        double rpl = result.config().config().r() * Mean(result.true_true());
         double bpn = Mean(result.bits_per_neuron());
-        double d_eff = Mean(result.d_effective());
-        double pF = Mean(result.false_true());
-
-        if (0.4 < rpl && rpl < max_rpl && 0.4 < d_eff && pF < 0.1) {
+        if (constraint.Feasible(result)) {
           if (optimal_bpn < bpn) {
             optimal.CopyFrom(result);
             optimal_bpn = Mean(optimal.bits_per_neuron());
@@ -65,11 +161,14 @@ void OptimizeConfiguration(int32 H, int32 R, double max_rpl) {
           break;  // Early stop due to declining bpn
         if (max_bpn < 0.0 || max_bpn < bpn) max_bpn = bpn;
       }
+      // A Q whose every w was pruned gives no reason to stop
+      if (max_bpn < 0.0) continue;
       if (max_bpn_G < max_bpn) max_bpn_G = max_bpn;
       if (max_bpn < 0.8 * max_bpn_G) break;
     }
-    if (max_bpn_G < 0.8 * optimal_bpn) break;
+    if (0.0 <= max_bpn_G && max_bpn_G < 0.8 * optimal_bpn) break;
   }
+  if (surrogate) fputs(error.ToString().c_str(), stdout);
   if (0.0 < optimal_bpn)
     PrintTableResults(optimal);
 }
@@ -77,19 +176,52 @@ void OptimizeConfiguration(int32 H, int32 R, double max_rpl) {
 }  // namespace cognon
 
 int main(int argc, char **argv) {
+  bool successive_halving = false;
+  int c;
+  cognon::ResultCache cache;
+  while ((c = getopt(argc, argv, "pr:s")) != EOF) {
+    switch (c) {
+    case 'p':
+      cognon::surrogate = true;
+      break;
+    case 'r':
+      if (!cache.Open(optarg, 0)) {
+        fprintf(stderr, "Cannot open result cache %s\n", optarg);
+        exit(1);
+      }
+      cognon::SetResultCache(&cache);
+      break;
+    case 's':
+      successive_halving = true;
+      break;
+    default:
+      fprintf(stderr, "Unknown option %c\n", c);
+      exit(1);
+      break;
+    }
+  }
+
   cognon::PrintTableHeader();
 
   for (int32 H = 10; H <= 40; H += 10) {
     for (int32 R = 10; R <= 40; R += 10) {
       if (H < R) continue;
-      cognon::OptimizeConfiguration(H, R, 2.0);
+      if (successive_halving) {
+        cognon::SearchConfiguration(H, R, 2.0);
+      } else {
+        cognon::OptimizeConfiguration(H, R, 2.0);
+      }
     }
   }
 
   for (int32 H = 10; H <= 40; H += 10) {
     for (int32 R = 10; R <= 40; R += 10) {
       if (H < R) continue;
-      cognon::OptimizeConfiguration(H, R, 50.0);
+      if (successive_halving) {
+        cognon::SearchConfiguration(H, R, 50.0);
+      } else {
+        cognon::OptimizeConfiguration(H, R, 50.0);
+      }
     }
   }
   return 0;
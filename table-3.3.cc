@@ -19,11 +19,123 @@
 // C, D1, D2, S, and H configuration sets finding the optimal
 // settings for G_m, Q, and W for each configuration.
 //
+// Each C, D1, D2, S and G_max column searches its H values in turn,
+// but the columns are resumable search tasks that all run together on
+// one SearchScheduler, so that their rows share the worker threads.
+// Each column's output is printed, in order, once it has finished.
+//
+// With -s each row is searched by successive halving, warm-started
+// from the column's optimum for the previous H.  With -r FILE
+// results are cached in FILE (see result_cache.h), so a rerun only
+// simulates what is missing.
+//
+
+#include <unistd.h>
 
 #include "cognon.h"
 #include "monograph.h"
+#include "optimize.h"
+#include "result_cache.h"
+
+// Optimizes the rows for increasing H until the bits per neuron
+// decline.
+//
+class ColumnSearch : public cognon::SearchTask {
+ public:
+  ColumnSearch(int32 S, int32 C, int32 D1, int32 D2,
+               double G_max, double G_step)
+      : S_(S), C_(C), D1_(D1), D2_(D2), G_max_(G_max), G_step_(G_step),
+        optimal_bpn_(-1.0), H_(5.0),
+        max_H_(0.9 * (S / static_cast<double>(C))), step_H_(5.0),
+        have_warm_start_(false) {
+    StartRow();
+  }
+  virtual ~ColumnSearch() { }
+
+  virtual bool Step(vector<cognon::TrainConfig>* configs, double* fidelity) {
+    while (row_.get() != NULL) {
+      if (row_->Step(configs, fidelity)) return true;
+      FinishRow();
+    }
+    return false;
+  }
+
+  virtual void Resume(const vector<cognon::NeuronStatistics>& results) {
+    row_->Resume(results);
+  }
+
+  virtual void Report() {
+    fputs(output_.c_str(), stdout);
+    fflush(stdout);
+  }
+
+ private:
+  void StartRow() {
+    if (max_H_ + cognon::kEpsilon < H_) {
+      row_.reset(NULL);
+      return;
+    }
+    output_ += StringPrintf("# OptimizeRow(%f, %d, %d, %d, %d, %f, %f)\n",
+                            H_, S_, C_, D1_, D2_, G_max_, G_step_);
+    row_.reset(cognon::NewRowSearch(H_, S_, C_, D1_, D2_, G_max_, G_step_,
+                                    (have_warm_start_ ? &warm_start_ : NULL),
+                                    &output_));
+  }
+
+  void FinishRow() {
+    double bpn = row_->bpn();
+    if (0.0 < bpn) {
+      warm_start_.CopyFrom(row_->optimal().config());
+      have_warm_start_ = true;
+    }
+    if ((10.0 < optimal_bpn_ || sqrt(S_ / (double)C_) < H_)
+        && cognon::kEpsilon < optimal_bpn_ && bpn < 0.8 * optimal_bpn_) {
+      row_.reset(NULL);
+      return;
+    } else if (optimal_bpn_ * 0.8 < bpn && step_H_ != 5.0) {
+      step_H_ = 5.0;
+    }
+    if (optimal_bpn_ < bpn)
+      optimal_bpn_ = bpn;
+
+    H_ += step_H_;
+    StartRow();
+  }
+
+  int32 S_, C_, D1_, D2_;
+  double G_max_, G_step_;
+  double optimal_bpn_;
+  double H_;
+  double max_H_;
+  double step_H_;
+  scoped_ptr<cognon::RowSearch> row_;
+  cognon::TrainConfig warm_start_;
+  bool have_warm_start_;
+  string output_;
+};
 
 int main(int argc, char **argv) {
+  int c;
+  cognon::ResultCache cache;
+  while ((c = getopt(argc, argv, "r:s")) != EOF) {
+    switch (c) {
+    case 'r':
+      if (!cache.Open(optarg, 0)) {
+        fprintf(stderr, "Cannot open result cache %s\n", optarg);
+        exit(1);
+      }
+      cognon::SetResultCache(&cache);
+      break;
+    case 's':
+      cognon::SetSearchAlgorithm(cognon::SUCCESSIVE_HALVING);
+      break;
+    default:
+      fprintf(stderr, "Unknown option %c\n", c);
+      exit(1);
+      break;
+    }
+  }
+
   cognon::PrintTableHeader();
 
   int32 S[] = {200, 1000, 10000};
@@ -33,34 +145,24 @@ int main(int argc, char **argv) {
   double G_step[] = {0.2, 0.1};
   CHECK(sizeof(G_max) == sizeof(G_step));
 
+  vector<ColumnSearch*> columns;
+  cognon::SearchScheduler scheduler(cognon::kTableRepetitions);
   for (int32 s = 0; s < sizeof(S) / sizeof(int32); ++s) {
     for (int32 g = 0; g < sizeof(G_max) / sizeof(double); ++g) {
       for (int32 d = 0; d < sizeof(D1) / sizeof(int32); ++d) {
         int32 D2 = 2 * D1[d] - 1;
         for (int32 c = 0; c < sizeof(C) / sizeof(int32); ++c) {
-          double optimal_bpn = -1.0;
-          double start_H = 5.0;
-          double max_H = 0.9 * (S[s] / static_cast<double>(C[c]));
-          double step_H = 5;
-          for (double H = start_H; H <= max_H + cognon::kEpsilon; H += step_H) {
-            printf("# OptimizeRow(%f, %d, %d, %d, %d, %f, %f)\n",
-                   H, S[s], C[c], D1[d], D2, G_max[g], G_step[g]);
-            double bpn = cognon::OptimizeRow(H, S[s], C[c], D1[d], D2,
-                                             G_max[g], G_step[g]);
-            if ((10.0 < optimal_bpn || sqrt(S[s] / (double)C[c]) < H)
-                && cognon::kEpsilon < optimal_bpn && bpn < 0.8 * optimal_bpn) {
-              break;
-              step_H = (max_H - start_H) / 20.0;
-            } else if (optimal_bpn * 0.8 < bpn && step_H != 5.0) {
-              step_H = 5.0;
-            }
-            if (optimal_bpn < bpn)
-              optimal_bpn = bpn;
-          }
+          columns.push_back(new ColumnSearch(S[s], C[c], D1[d], D2,
+                                             G_max[g], G_step[g]));
+          scheduler.AddTask(columns.back());
         }
       }
     }
   }
+  scheduler.Run();
 
+  for (int32 i = 0; i < columns.size(); ++i) {
+    delete columns[i];
+  }
   return 0;
 }